@@ -30,7 +30,6 @@
 #include "eigenSTLContainers.h"
 #include <Eigen/Dense>
 #include <ctype.h>
-#include <set>
 #include <vector>
 
 namespace xgandalf
@@ -40,7 +39,8 @@ namespace xgandalf
       public:
         typedef std::vector<uint32_t> cluster_t;
 
-        // maxEpsilon defines performance. Best performance for maxEpsilon == epsilon. Too small maxEpsilon means very big discretizationVolume
+        // Points are binned into cubic cells of width maxEpsilon. Best performance for maxEpsilon == epsilon. Only occupied cells are stored, so the
+        // memory scales with the number of points. maxPossiblePointNorm is not needed anymore and only kept for compatibility
         Dbscan(float maxEpsilon, float maxPossiblePointNorm);
         Dbscan();
 
@@ -62,18 +62,25 @@ namespace xgandalf
             EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
         } binEntry_t;
 
-        typedef std::vector<binEntry_t> bin_t;
+        // occupied cell. Its entries are binEntries[firstEntry, firstEntry + entriesCount)
+        typedef struct
+        {
+            uint64_t key;
+            uint32_t firstEntry;
+            uint32_t entriesCount;
+            int32_t neighbourCells[27]; // -1 for empty cells. Index 0 is the cell itself
+        } cell_t;
 
         class Neighbour
         {
           public:
-            Neighbour(bin_t* bin, binEntry_t* binEntry)
-                : bin(bin)
+            Neighbour(uint32_t cellIndex, binEntry_t* binEntry)
+                : cellIndex(cellIndex)
                 , binEntry(binEntry)
             {
             }
 
-            bin_t* bin;
+            uint32_t cellIndex;
             binEntry_t* binEntry;
 
             inline bool isVisited() const
@@ -121,28 +128,28 @@ namespace xgandalf
         std::vector<Neighbour> mainNeighbourhood;
         std::vector<Neighbour> neighbourNeighbourhood;
 
-        // stuff for dicretizationVolume
+        // stuff for the sparse cell grid, rebuilt in every call of computeClusters
         float maxEpsilon;
+        float binWidth_reciprocal;
 
-        std::vector<bin_t> discretizationVolume;
-        std::set<bin_t*> usedBins;
-
-        int32_t neighbourBinIndexOffsets[27];
+        std::vector<binEntry_t, Eigen::aligned_allocator<binEntry_t>> binEntries; // sorted by cell
+        std::vector<cell_t> cells;                                                // sorted by key
+        std::vector<std::pair<uint64_t, uint32_t>> pointKeys;                     // cell key and point index
 
-        float binWidth, binWidth_reciprocal;
-        int binsPerDimension;
-        uint32_t binCount, binCountMinus1;
-        Eigen::Vector3f bin1Position;
-        Eigen::Vector3d strides;
+        int neighbourSlots[27]; // index into neighbourCells for the offset (x + 1) * 9 + (y + 1) * 3 + (z + 1)
 
-        void fillDiscretizationVolume(const Eigen::Matrix3Xf& points);
-        void cleanUpDiscretizationVolume();
+        void fillCells(const Eigen::Matrix3Xf& points);
 
-        // fast, but insecure: if point lies out of scope, it gets relocated somewhere inside the scope.
-        inline uint32_t getIndex(const Eigen::Vector3f& position) const
+        // 21 bits per dimension, z most significant, so the cells are ordered like the bins of a dense volume. Cells far outside of the +-2^20 cells
+        // range get merged at the border, which only costs performance
+        inline uint64_t getKey(const Eigen::Vector3f& position) const
         {
-            Eigen::Vector3d temp = ((position - bin1Position) * binWidth_reciprocal).cast<double>().array().floor().matrix();
-            return std::min((uint32_t)(temp[0] + temp.tail(2).dot(strides.tail(2))), binCountMinus1); // min could be avoided for the price of unsafety
+            const float maxCoordinate = (1 << 20) - 2;
+            Eigen::Vector3f cellCoordinates = (position * binWidth_reciprocal).array().floor().max(-maxCoordinate).min(maxCoordinate);
+            uint64_t x = (uint64_t)((int64_t)cellCoordinates.x() + (1 << 20));
+            uint64_t y = (uint64_t)((int64_t)cellCoordinates.y() + (1 << 20));
+            uint64_t z = (uint64_t)((int64_t)cellCoordinates.z() + (1 << 20));
+            return x | (y << 21) | (z << 42);
         }
 
       public:
@@ -28,12 +28,21 @@
 
 #include <Eigen/Dense>
 #include <InverseSpaceTransform.h>
+#include <WorkerPool.h>
+#include <vector>
 
 namespace xgandalf
 {
     class HillClimbingOptimizer
     {
       public:
+        // refinement of the local phases. leastSquaresSnap replaces the local calm down steps by a closed form fit of every position to its close points
+        enum class LocalRefinementMode
+        {
+            hillClimbing,
+            leastSquaresSnap
+        };
+
         typedef struct
         {
             float gamma;
@@ -55,6 +64,17 @@ namespace xgandalf
             float optionalFunctionArgument;
             float maxCloseToPointDeviation;
 
+            // Local phases only: a position is removed from the working set, once its step length stayed below convergedStepLength or its evaluation
+            // changed less than convergedEvaluationChange for convergedIterationCount consecutive steps. 0 disables the convergence tracking
+            int convergedIterationCount = 0;
+            float convergedStepLength = 0;
+            float convergedEvaluationChange = 0;
+
+            // With leastSquaresSnap every position s is moved to the weighted least squares solution of p_i * s = round(p_i * s) over its close points p_i
+            // after the local fit steps. The snap is repeated up to leastSquaresSnapIterationCount times, until the rounded values do not change anymore
+            LocalRefinementMode localRefinementMode = LocalRefinementMode::hillClimbing;
+            int leastSquaresSnapIterationCount = 0;
+
             stepComputationAccuracyConstants_t stepComputationAccuracyConstants;
         } hillClimbingAccuracyConstants_t;
 
@@ -63,32 +83,84 @@ namespace xgandalf
         void performOptimization(const Eigen::Matrix3Xf& pointsToTransform, Eigen::Matrix3Xf& positionsToOptimize);
         Eigen::RowVectorXf& getLastInverseTransformEvaluation();
         Eigen::RowVectorXf& getCloseToPointsCount();
+        // only available after a performOptimization() with setKeepPointsCloseToEvaluationPositions(true)
+        PointIndicesOnVectors& getPointsCloseToEvaluationPositions();
         std::vector<std::vector<uint16_t>>& getPointsCloseToEvaluationPositions_indices();
 
+        // transform calls and evaluated positions of the last performOptimization(), including the final evaluation
+        uint64_t getLastTransformCallsCount() const;
+        uint64_t getLastEvaluatedPositionsCount() const;
+
         void setHillClimbingAccuracyConstants(hillClimbingAccuracyConstants_t accuracyConstants);
 
         // optional
         void setPointsToTransformWeights(const Eigen::RowVectorXf& pointsToTransformWeights);
+        // collects the points close to the optimized positions in the final evaluation of every chunk. Off by default
+        void setKeepPointsCloseToEvaluationPositions(bool flag);
+        // the chunks of positionsToOptimize are processed in parallel. The result does not depend on the thread count. 0 selects the number of hardware threads
+        void setThreadCount(uint32_t threadCount);
 
       public:
         void setStepComputationAccuracyConstants(stepComputationAccuracyConstants_t stepComputationAccuracyConstants);
 
         // watch out! gradient, closeToPointsCount and inverseTransformEvaluation are changed in this function (for performance reasons)!
-        void computeStep(Eigen::Matrix3Xf& gradient, Eigen::RowVectorXf& closeToPointsCount, Eigen::RowVectorXf& inverseTransformEvaluation,
-                         bool useStepOrthogonalization);
-
-        void performOptimizationStep(Eigen::Matrix3Xf& positionsToOptimize, bool useStepOrthogonalization);
+        // previousStepDirection and previousStepLength are the step state of the positions and get updated
+        static void computeStep(Eigen::Matrix3Xf& gradient, Eigen::RowVectorXf& closeToPointsCount, Eigen::RowVectorXf& inverseTransformEvaluation,
+                                bool useStepOrthogonalization, const stepComputationAccuracyConstants_t& stepComputationAccuracyConstants,
+                                Eigen::Matrix3Xf& step, Eigen::Matrix3Xf& previousStepDirection, Eigen::Array<float, 1, Eigen::Dynamic>& previousStepLength);
 
         InverseSpaceTransform transform;
         hillClimbingAccuracyConstants_t hillClimbingAccuracyConstants;
 
         // interna
-        Eigen::Matrix3Xf step;
+        Eigen::RowVectorXf lastInverseTransformEvaluation;
 
-        Eigen::Matrix3Xf previousStepDirection;
-        Eigen::Array<float, 1, Eigen::Dynamic> previousStepLength;
+      private:
+        Eigen::RowVectorXf lastCloseToPointsCount;
+        bool keepPointsCloseToEvaluationPositions;
+        std::vector<PointIndicesOnVectors> chunkPointsCloseToEvaluationPositions;
+        PointIndicesOnVectors lastPointsCloseToEvaluationPositions;
+        std::vector<std::vector<uint16_t>> lastPointsCloseToEvaluationPositions_indices;
+        bool lastPointsCloseToEvaluationPositionsKept;
+        bool lastPointsCloseToEvaluationPositionsIndicesUpToDate;
 
-        Eigen::RowVectorXf lastInverseTransformEvaluation;
+        uint64_t lastTransformCallsCount;
+        uint64_t lastEvaluatedPositionsCount;
+
+        typedef struct
+        {
+            InverseSpaceTransform transform;
+            stepComputationAccuracyConstants_t stepComputationAccuracyConstants;
+
+            Eigen::Matrix3Xf positionsToOptimize;
+            Eigen::Matrix3Xf step;
+            Eigen::Matrix3Xf previousStepDirection;
+            Eigen::Array<float, 1, Eigen::Dynamic> previousStepLength;
+
+            uint64_t transformCallsCount;
+            uint64_t evaluatedPositionsCount;
+
+            // active set of the local phases, only used with convergence tracking
+            Eigen::Matrix3Xf activePositions;
+            std::vector<uint32_t> activeColumns; // column in positionsToOptimize for every active position
+            std::vector<uint16_t> convergedIterationCounts;
+            Eigen::RowVectorXf evaluation;
+            Eigen::RowVectorXf previousEvaluation;
+
+            // least squares snap
+            Eigen::Matrix3Xf snappedPositions;
+            std::vector<int> roundedProjections; // INT_MIN for points that are not close
+        } chunkWorker_t;
+
+        void setFinalEvaluationFlags(InverseSpaceTransform& transform) const;
+        void optimizeChunk(chunkWorker_t& worker);
+        void snapToLeastSquaresSolution(chunkWorker_t& worker);
+        void beginActiveSet(chunkWorker_t& worker);
+        void updateActiveSet(chunkWorker_t& worker);
+        void endActiveSet(chunkWorker_t& worker);
+
+        WorkerPool workerPool;
+        std::vector<chunkWorker_t> chunkWorkers;
     };
 } // namespace xgandalf
 
@@ -27,7 +27,9 @@
 #define INDEXERAUTOCORRPREFIT_H_
 
 #include "HillClimbingOptimizer.h"
+#include "WorkerPool.h"
 #include <IndexerBase.h>
+#include <memory>
 
 namespace xgandalf
 {
@@ -50,6 +52,9 @@ namespace xgandalf
         void setSamplingPitch(SamplingPitch samplingPitch);
         void setSamplingPitch(float unitPitch);
 
+        // threads used to compute the point autocorrelation. 0 selects the number of hardware threads
+        void setAutocorrelationThreadCount(uint32_t threadCount);
+
       private:
         void precompute();
 
@@ -58,7 +63,7 @@ namespace xgandalf
         void autocorrPrefit(const Eigen::Matrix3Xf& reciprocalPeaks_A, Eigen::Matrix3Xf& samplePoints,
                             HillClimbingOptimizer::hillClimbingAccuracyConstants_t hillClimbing_accuracyConstants_autocorr);
 
-        Eigen::Matrix3Xf precomputedSamplePoints;
+        std::shared_ptr<const Eigen::Matrix3Xf> precomputedSamplePoints; // shared with the process wide grid cache
 
         HillClimbingOptimizer hillClimbingOptimizer;
         SparsePeakFinder sparsePeakFinder;
@@ -69,6 +74,8 @@ namespace xgandalf
         float minNormInAutocorrelation;
         float dbscanEpsilon;
         Dbscan dbscan;
+
+        WorkerPool autocorrelationWorkerPool;
     };
 } // namespace xgandalf
 #endif /* INDEXERAUTOCORRPREFIT_H_ */
@@ -26,68 +26,77 @@
 #ifndef INDEXERPLAIN_H_
 #define INDEXERPLAIN_H_
 
-#include "HillClimbingOptimizer.h"
+#include "IndexingPlan.h"
+#include "IndexingWorkspace.h"
+#include "WorkerPool.h"
 #include <IndexerBase.h>
+#include <memory>
 
 namespace xgandalf
 {
     class IndexerPlain : public IndexerBase
     {
       public:
-        enum class SamplingPitch
-        {
-            extremelyLoose,
-            loose,
-            standard,
-            dense,
-            extremelyDense,
-
-            standardWithSeondaryMillerIndices,
-            denseWithSeondaryMillerIndices,
-            extremelyDenseWithSeondaryMillerIndices
-        };
-
-        enum class GradientDescentIterationsCount
-        {
-            exremelyFew,
-            few,
-            standard,
-            many,
-            manyMany,
-            extremelyMany,
-
-            custom
-        };
+        typedef IndexingPlan::SamplingPitch SamplingPitch;
+        typedef IndexingPlan::GradientDescentIterationsCount GradientDescentIterationsCount;
+        typedef IndexingPlan::SamplingStrategy SamplingStrategy;
+        typedef IndexingPlan::ShellSamplePointsSource ShellSamplePointsSource;
+        typedef IndexingPlan::PeaksRefinementMode PeaksRefinementMode;
+        typedef IndexingPlan::indexingStatistics_t IndexingStatistics;
 
         IndexerPlain(const ExperimentSettings& experimentSettings);
 
         void index(std::vector<Lattice>& assembledLattices, const Eigen::Matrix3Xf& reciprocalPeaks_1_per_A);
         void index(std::vector<Lattice>& assembledLattices, const Eigen::Matrix3Xf& reciprocalPeaks_1_per_A, std::vector<int>& peakCountOnLattices);
+        // additionally reports the wall time and counters of every stage
+        void index(std::vector<Lattice>& assembledLattices, const Eigen::Matrix3Xf& reciprocalPeaks_1_per_A, std::vector<int>& peakCountOnLattices,
+                   IndexingStatistics& indexingStatistics);
+
+        // Indexes many frames at once with the batch worker pool. The indexing plan is shared between the workers, every worker has its own workspace.
+        // The results are in the order of the input frames and are identical to calling index() on every frame.
+        void indexBatch(std::vector<std::vector<Lattice>>& assembledLattices, const std::vector<Eigen::Matrix3Xf>& reciprocalPeaks_1_per_A);
+        void indexBatch(std::vector<std::vector<Lattice>>& assembledLattices, const std::vector<Eigen::Matrix3Xf>& reciprocalPeaks_1_per_A,
+                        std::vector<std::vector<int>>& peakCountOnLattices);
+        // additionally reports the wall time and counters of every frame, in the order of the input frames
+        void indexBatch(std::vector<std::vector<Lattice>>& assembledLattices, const std::vector<Eigen::Matrix3Xf>& reciprocalPeaks_1_per_A,
+                        std::vector<std::vector<int>>& peakCountOnLattices, std::vector<IndexingStatistics>& indexingStatistics);
+        void indexBatch(std::vector<Lattice>* assembledLattices, const Eigen::Matrix3Xf* reciprocalPeaks_1_per_A, std::vector<int>* peakCountOnLattices,
+                        uint32_t framesCount);
+        // indexingStatistics may be nullptr
+        void indexBatch(std::vector<Lattice>* assembledLattices, const Eigen::Matrix3Xf* reciprocalPeaks_1_per_A, std::vector<int>* peakCountOnLattices,
+                        IndexingStatistics* indexingStatistics, uint32_t framesCount);
+
+        // 0 selects the number of hardware threads
+        void setBatchThreadCount(uint32_t threadCount);
+        // threads used by index() to parallelize the hill climbing of a single frame. 0 selects the number of hardware threads
+        void setHillClimbingThreadCount(uint32_t threadCount);
+        // threads used by index() to parallelize the lattice assembly of a single frame. 0 selects the number of hardware threads
+        void setLatticeAssemblyThreadCount(uint32_t threadCount);
 
         void setSamplingPitch(SamplingPitch samplingPitch);
         void setSamplingPitch(float unitPitch, bool coverSecondaryMillerIndices);
+        void setShellSamplePointsSource(ShellSamplePointsSource shellSamplePointsSource);
+        // hierarchical search: hill climbing only around the best points of a coarser grid. See IndexingPlan::setSamplingStrategy()
+        void setSamplingStrategy(SamplingStrategy samplingStrategy);
+        void setCoarseToFineParameters(float coarsePitchFactor, float keptCoarsePointsFraction);
         void setRefineWithExactLattice(bool flag);
         void setMaxPeaksToUseForIndexing(int maxPeaksToUseForIndexing);
 
         void setGradientDescentIterationsCount(GradientDescentIterationsCount gradientDescentIterationsCount);
+        void setPeaksRefinementMode(PeaksRefinementMode peaksRefinementMode);
 
-      private:
-        void precompute();
-        void reducePeakCount(Eigen::Matrix3Xf& reciprocalPeaks_1_per_A);
-
-        Eigen::Matrix3Xf precomputedSamplePoints;
+        // The plan can be shared with other threads, which index with their own IndexingWorkspace. Setters called afterwards on this indexer do not
+        // modify the shared plan, but create a new one.
+        std::shared_ptr<const IndexingPlan> getIndexingPlan() const;
 
-        HillClimbingOptimizer hillClimbingOptimizer;
-        SparsePeakFinder sparsePeakFinder;
-        InverseSpaceTransform inverseSpaceTransform;
+      private:
+        IndexingPlan& getModifiablePlan();
 
-        float maxCloseToPointDeviation;
-        int maxPeaksToUseForIndexing;
+        std::shared_ptr<IndexingPlan> plan;
 
-        HillClimbingOptimizer::hillClimbingAccuracyConstants_t hillClimbing_accuracyConstants_global;
-        HillClimbingOptimizer::hillClimbingAccuracyConstants_t hillClimbing_accuracyConstants_additionalGlobal;
-        HillClimbingOptimizer::hillClimbingAccuracyConstants_t hillClimbing_accuracyConstants_peaks;
-        LatticeAssembler::accuracyConstants_t accuracyConstants_LatticeAssembler;
+        IndexingWorkspace workspace;
+        std::vector<IndexingWorkspace> batchWorkspaces;
+        WorkerPool batchWorkerPool;
     };
 } // namespace xgandalf
 #endif /* INDEXERPLAIN_H_ */
@@ -0,0 +1,172 @@
+/*
+ * IndexingPlan.h
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INDEXINGPLAN_H_
+#define INDEXINGPLAN_H_
+
+#include "ExperimentSettings.h"
+#include "HillClimbingOptimizer.h"
+#include "IndexingWorkspace.h"
+#include "Lattice.h"
+#include "LatticeAssembler.h"
+#include "SamplePointsGenerator.h"
+#include "SparsePeakFinder.h"
+#include <Eigen/Dense>
+#include <memory>
+#include <vector>
+
+namespace xgandalf
+{
+    // Everything that is needed for indexing and does not change from frame to frame: the experiment settings, the precomputed sample points, the peak
+    // finder grid and all accuracy constants. The setters are meant for configuring the plan. Once it is shared between threads it must not be changed
+    // anymore. index() is const and can be called from several threads concurrently, as long as every thread uses its own IndexingWorkspace.
+    class IndexingPlan
+    {
+      public:
+        enum class SamplingPitch
+        {
+            extremelyLoose,
+            loose,
+            standard,
+            dense,
+            extremelyDense,
+
+            standardWithSeondaryMillerIndices,
+            denseWithSeondaryMillerIndices,
+            extremelyDenseWithSeondaryMillerIndices
+        };
+
+        enum class GradientDescentIterationsCount
+        {
+            exremelyFew,
+            few,
+            standard,
+            many,
+            manyMany,
+            extremelyMany,
+
+            custom
+        };
+
+        enum class SamplingStrategy
+        {
+            uniform,     // hill climbing from all sample points
+            coarseToFine // hill climbing only from the sample points around the best evaluated points of a coarser grid
+        };
+
+        typedef SamplePointsGenerator::ShellSamplePointsSource ShellSamplePointsSource;
+        typedef HillClimbingOptimizer::LocalRefinementMode PeaksRefinementMode;
+
+        // wall times and counters of the stages of a single index() call
+        typedef struct
+        {
+            double coarseSamplingTime_s; // evaluation of the coarse grid and selection of the sample points. Only for SamplingStrategy::coarseToFine
+            double globalHillClimbingTime_s;
+            double additionalGlobalHillClimbingTime_s;
+            double peakFindingTime_s;
+            double peaksHillClimbingTime_s; // including the final evaluation of the peaks with all reciprocal peaks
+            double latticeAssemblyTime_s;
+            double totalTime_s;
+
+            uint32_t reciprocalPeaksCount;
+            uint32_t usedReciprocalPeaksCount;      // after reducing to maxPeaksToUseForIndexing
+            uint32_t hillClimbingSamplePointsCount; // sample points the global hill climbing starts from
+            uint64_t transformCallsCount;
+            uint64_t evaluatedSamplePointsCount; // summed over all transform calls
+            uint32_t foundPeaksCount;            // found by the sparse peak finder in both global hill climbing results
+            uint32_t keptPeaksCount;             // with the highest evaluation, passed to the peaks hill climbing
+
+            LatticeAssembler::assemblyStatistics_t latticeAssemblyStatistics;
+        } indexingStatistics_t;
+
+        IndexingPlan(const ExperimentSettings& experimentSettings);
+
+        void index(IndexingWorkspace& workspace, std::vector<Lattice>& assembledLattices, const Eigen::Matrix3Xf& reciprocalPeaks_1_per_A,
+                   std::vector<int>& peakCountOnLattices) const;
+        void index(IndexingWorkspace& workspace, std::vector<Lattice>& assembledLattices, const Eigen::Matrix3Xf& reciprocalPeaks_1_per_A,
+                   std::vector<int>& peakCountOnLattices, indexingStatistics_t& indexingStatistics) const;
+
+        void setSamplingPitch(SamplingPitch samplingPitch);
+        void setSamplingPitch(float unitPitch, bool coverSecondaryMillerIndices);
+        // only affects known lattice parameters. The generated sample points have exactly the requested pitch and tolerance
+        void setShellSamplePointsSource(ShellSamplePointsSource shellSamplePointsSource);
+        // Default is uniform. coarseToFine evaluates a grid with coarsePitchFactor times the sampling pitch and starts the hill climbing only from the
+        // sample points, whose closest coarse grid point is among the keptCoarsePointsFraction best evaluated ones. Both setters throw, if the coarse grid
+        // would have fewer than minCoarseSamplePointsCount points. If a later change of the sampling pitch leads there, all sample points are used
+        void setSamplingStrategy(SamplingStrategy samplingStrategy);
+        void setCoarseToFineParameters(float coarsePitchFactor, float keptCoarsePointsFraction);
+        static const uint32_t minCoarseSamplePointsCount = 100;
+        void setRefineWithExactLattice(bool flag);
+        void setMaxPeaksToUseForIndexing(int maxPeaksToUseForIndexing);
+
+        void setGradientDescentIterationsCount(GradientDescentIterationsCount gradientDescentIterationsCount);
+        // refinement after the local fit of the peaks hill climbing. Default is hillClimbing
+        void setPeaksRefinementMode(PeaksRefinementMode peaksRefinementMode);
+
+        const ExperimentSettings& getExperimentSettings() const;
+        const Eigen::Matrix3Xf& getPrecomputedSamplePoints() const;
+
+      private:
+        void precompute();
+        std::shared_ptr<const Eigen::Matrix3Xf> getSamplePoints(float unitPitch, bool coverSecondaryMillerIndices);
+        void precomputeCoarseSamplePoints();
+        // returns the number of transform calls
+        uint32_t selectSamplePoints(IndexingWorkspace& workspace, Eigen::Matrix3Xf& samplePoints, const Eigen::Matrix3Xf& reciprocalPeaks_1_per_A) const;
+        void reducePeakCount(Eigen::Matrix3Xf& reciprocalPeaks_1_per_A) const;
+        void prepareWorkspace(IndexingWorkspace& workspace) const;
+        void configurationChanged();
+
+        ExperimentSettings experimentSettings;
+        SamplePointsGenerator samplePointsGenerator;
+
+        std::shared_ptr<const Eigen::Matrix3Xf> precomputedSamplePoints; // shared with the process wide grid cache
+        float samplingUnitPitch;
+        bool samplingCoversSecondaryMillerIndices;
+
+        SamplingStrategy samplingStrategy;
+        float coarsePitchFactor;
+        float keptCoarsePointsFraction;
+        std::shared_ptr<const Eigen::Matrix3Xf> coarseSamplePoints; // only for SamplingStrategy::coarseToFine with a fine enough coarse grid
+        std::vector<uint32_t> closestCoarseSamplePointIndices;     // for every precomputed sample point
+
+        // configured prototypes for the workspaces. Never used for indexing directly
+        SparsePeakFinder sparsePeakFinder;
+        InverseSpaceTransform inverseSpaceTransform;
+        InverseSpaceTransform coarseSamplingTransform;
+        LatticeAssembler latticeAssembler;
+
+        float maxCloseToPointDeviation;
+        int maxPeaksToUseForIndexing;
+        PeaksRefinementMode peaksRefinementMode;
+
+        HillClimbingOptimizer::hillClimbingAccuracyConstants_t hillClimbing_accuracyConstants_global;
+        HillClimbingOptimizer::hillClimbingAccuracyConstants_t hillClimbing_accuracyConstants_additionalGlobal;
+        HillClimbingOptimizer::hillClimbingAccuracyConstants_t hillClimbing_accuracyConstants_peaks;
+        LatticeAssembler::accuracyConstants_t accuracyConstants_LatticeAssembler;
+
+        uint64_t configurationId; // unique for every configuration state, used to detect outdated workspaces
+    };
+} // namespace xgandalf
+#endif /* INDEXINGPLAN_H_ */
@@ -0,0 +1,70 @@
+/*
+ * IndexingWorkspace.h
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INDEXINGWORKSPACE_H_
+#define INDEXINGWORKSPACE_H_
+
+#include "HillClimbingOptimizer.h"
+#include "InverseSpaceTransform.h"
+#include "LatticeAssembler.h"
+#include "SparsePeakFinder.h"
+#include <cstdint>
+#include <vector>
+
+namespace xgandalf
+{
+    class IndexingPlan;
+
+    // Scratch data that is modified while indexing a single frame with an IndexingPlan. A workspace is created empty and gets configured by the plan on
+    // first use, so it does not hold any large precomputed data. One workspace must not be used by several threads at the same time.
+    class IndexingWorkspace
+    {
+      public:
+        IndexingWorkspace();
+
+        // threads used inside the hill climbing of a single frame. 0 selects the number of hardware threads
+        void setHillClimbingThreadCount(uint32_t threadCount);
+        // threads used inside the lattice assembly of a single frame. 0 selects the number of hardware threads
+        void setLatticeAssemblyThreadCount(uint32_t threadCount);
+
+      private:
+        friend class IndexingPlan;
+
+        uint64_t configurationId; // configuration of the plan this workspace has been prepared for. 0 if not prepared
+        uint32_t latticeAssemblyThreadCount; // kept here, because the lattice assembler is replaced by the prototype of the plan
+
+        HillClimbingOptimizer hillClimbingOptimizer;
+        SparsePeakFinder sparsePeakFinder;
+        InverseSpaceTransform inverseSpaceTransform;
+        InverseSpaceTransform coarseSamplingTransform;
+        LatticeAssembler latticeAssembler;
+
+        std::vector<uint32_t> sortIndices; // to avoid frequent reallocation
+        std::vector<uint8_t> coarseSamplePointKept;
+        Eigen::Matrix3Xf coarseSamplePointsChunk;
+        Eigen::RowVectorXf coarseSamplePointsEvaluation;
+    };
+} // namespace xgandalf
+#endif /* INDEXINGWORKSPACE_H_ */
@@ -27,6 +27,7 @@
 #define INVERSESPACETRANSFORM_H_
 
 #include "BadInputException.h"
+#include "PointIndicesOnVectors.h"
 #include <Eigen/Dense>
 #include <ctype.h>
 #include <vector>
@@ -37,12 +38,23 @@ namespace xgandalf
     class InverseSpaceTransform
     {
       public:
+        // evaluation of sine and cosine in function 1. exact uses the standard library, high and fast use polynomials after range reduction (max error about
+        // 1 ulp for high, about 1e-6 for the sine and 1.2e-5 for the cosine for fast)
+        enum class TrigonometryAccuracy
+        {
+            exact,
+            high,
+            fast
+        };
+
         typedef struct
         {
             int functionSelection;
             float optionalFunctionArgument;
             bool localTransform;
             bool radialWeighting;
+            bool fusedKernel;
+            TrigonometryAccuracy trigonometryAccuracy;
 
             float maxCloseToPointDeviation;
         } accuracyConstants_t;
@@ -51,9 +63,14 @@ namespace xgandalf
         InverseSpaceTransform(float maxCloseToPointDeviation);
 
         void performTransform(const Eigen::Matrix3Xf& positionsToEvaluate);
+        // Only the inverse transform evaluation and the close to points count, without the slope and the gradient. The close points for
+        // getPointsCloseToEvaluationPositions() are only kept with computeCloseToPoints. getGradient() is not available afterwards
+        void performEvaluation(const Eigen::Matrix3Xf& positionsToEvaluate, bool computeCloseToPoints = false);
 
         void setPointsToTransform(const Eigen::Matrix3Xf& pointsToTransform);
         void setPointsToTransformWeights(const Eigen::RowVectorXf& pointsToTransformWeights);
+        // copies points to transform, weights and accuracy constants, but not the results of the last transform
+        void copySettings(const InverseSpaceTransform& other);
 
         void setMaxCloseToPointDeviation(float maxCloseToPointDeviation);
         void setFunctionSelection(int functionSelection);
@@ -62,15 +79,29 @@ namespace xgandalf
         void clearLocalTransformFlag();
         void setRadialWeightingFlag();
         void clearRadialWeightingFlag();
+        // use the fused SIMD kernel for functions 1 and 9, if the machine supports it. Set by default
+        void setFusedKernelFlag();
+        void clearFusedKernelFlag();
+        // exact disables the fused kernel for function 1. Default is high
+        void setTrigonometryAccuracy(TrigonometryAccuracy trigonometryAccuracy);
+
+        const Eigen::Matrix3Xf& getPointsToTransform() const;
+        // user preset weights, multiplied by the radial weight if the radial weighting flag is set
+        const Eigen::RowVectorXf& getPointsToTransformWeights() const;
+        float getMaxCloseToPointDeviation() const;
 
         Eigen::Matrix3Xf& getGradient();
         Eigen::RowVectorXf& getInverseTransformEvaluation();
         Eigen::RowVectorXf& getCloseToPointsCount();
 
+        // indices of the points close to every evaluation position, built directly from the close to point masks of the last transform
+        PointIndicesOnVectors& getPointsCloseToEvaluationPositions();
         std::vector<std::vector<uint16_t>>& getPointsCloseToEvaluationPositions_indices();
 
       private:
-        void onePeriodicFunction(Eigen::ArrayXXf& x);
+        void onePeriodicFunction(Eigen::ArrayXXf& x, bool computeSlope);
+        bool performFusedTransform(const Eigen::Matrix3Xf& positionsToEvaluate, bool evaluationOnly, bool computeCloseToPointMasks); // false, if not applicable
+        void computeCloseToPointsCount();
 
         void update_pointsToTransformWeights();
 
@@ -90,11 +121,19 @@ namespace xgandalf
         Eigen::ArrayXXf slope;
         Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic> closeToPoint;
 
+        PointIndicesOnVectors pointsCloseToEvaluationPositions;
         std::vector<std::vector<uint16_t>> pointsCloseToEvaluationPositions_indices;
 
         float inverseTransformEvaluationScalingFactor;
 
         bool resultsUpToDate;
+        bool gradientUpToDate;     // false after performEvaluation()
+        bool closeToPointUpToDate; // false after performEvaluation() without close to points
+
+        // close to point information of the fused kernel, replaces closeToPoint
+        bool closeToPointFromMasks;
+        uint32_t closeToPointMasksTileWidth;
+        std::vector<uint16_t> closeToPointMasks;
     };
 } // namespace xgandalf
 #endif /* INVERSESPACETRANSFORM_H_ */
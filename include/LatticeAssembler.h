@@ -27,9 +27,10 @@
 #define LATTICEASSEMBLER_H_
 
 #include "Lattice.h"
+#include "PointIndicesOnVectors.h"
+#include "WorkerPool.h"
 #include <Eigen/Dense>
 #include <array>
-#include <list>
 #include <vector>
 
 namespace xgandalf
@@ -57,6 +58,23 @@ namespace xgandalf
             bool refineWithExactLattice;
         } accuracyConstants_t;
 
+        // counters of the last assembleLattices() call. Every filter count is the number of candidates passing it
+        typedef struct
+        {
+            uint32_t candidateVectorsCount; // with at least minPointsOnLattice points
+            uint32_t compatiblePairsCount;  // edges of the pair compatibility graph
+            uint64_t testedTripletsCount;
+            uint64_t passingDeterminantFilterCount;
+            uint64_t passingPointsOnLatticeFilterCount;
+            uint32_t passingLatticeParametersFilterCount; // candidate lattices
+            uint32_t passingGlobalWeightFilterCount;
+            uint32_t passingLocalWeightFilterCount;
+            uint32_t passingRelativeDefectFilterCount;
+            uint32_t selectedLatticesCount;
+            uint32_t refinementCallsCount;              // solver calls of the refinement of the selected lattices, one per reassignment of the peaks
+            uint32_t levenbergMarquardtIterationsCount; // summed over all solver calls. Only the refinement without exact lattice uses Levenberg-Marquardt
+        } assemblyStatistics_t;
+
         LatticeAssembler();
         LatticeAssembler(const Eigen::Vector2f& determinantRange);
         LatticeAssembler(const Eigen::Vector2f& determinantRange, const Lattice& sampleRealLattice_A, float knownLatticeTolerance);
@@ -68,19 +86,25 @@ namespace xgandalf
         void setDeterminantRange(const Eigen::Vector2f& determinantRange);
         void setDeterminantRange(float min, float max);
         void setKnownLatticeParameters(const Lattice& sampleRealLattice_A, float tolerance);
+        // threads used for the candidate lattice enumeration and scoring. 0 selects the number of hardware threads. The result does not depend on it
+        void setThreadCount(uint32_t threadCount);
 
         void assembleLattices(std::vector<Lattice>& assembledLattices, Eigen::Matrix3Xf& candidateVectors, Eigen::RowVectorXf& candidateVectorWeights,
                               std::vector<std::vector<uint16_t>>& pointIndicesOnVector, Eigen::Matrix3Xf& pointsToFitInReciprocalSpace);
         void assembleLattices(std::vector<Lattice>& assembledLattices, std::vector<assembledLatticeStatistics_t>& assembledLatticesStatistics,
                               Eigen::Matrix3Xf& candidateVectors, Eigen::RowVectorXf& candidateVectorWeights,
                               std::vector<std::vector<uint16_t>>& pointIndicesOnVector, Eigen::Matrix3Xf& pointsToFitInReciprocalSpace);
+        void assembleLattices(std::vector<Lattice>& assembledLattices, std::vector<assembledLatticeStatistics_t>& assembledLatticesStatistics,
+                              Eigen::Matrix3Xf& candidateVectors, Eigen::RowVectorXf& candidateVectorWeights, const PointIndicesOnVectors& pointIndicesOnVector,
+                              Eigen::Matrix3Xf& pointsToFitInReciprocalSpace);
 
         accuracyConstants_t getAccuracyConstants();
+        const assemblyStatistics_t& getLastAssemblyStatistics() const;
 
       private:
         void setStandardValues();
         void reset();
-        bool checkLatticeParameters(Lattice& lattice);
+        bool checkLatticeParameters(Lattice& lattice) const;
         void refineLattice(Lattice& lattice, std::vector<uint16_t>& pointOnLatticeIndices, const Eigen::Matrix3Xf& reciprocalPeaks_1_per_A);
         void refineLattice_peaksAndAngle(Lattice& realSpaceLattice, const Eigen::Matrix3Xf& pointsToFitInReciprocalSpace);
         void refineLattice_peaksAndAngle_fixedBasisParameters(Lattice& realSpaceLattice, const Eigen::Matrix3Xf& pointsToFitInReciprocalSpace);
@@ -95,6 +119,8 @@ namespace xgandalf
 
         accuracyConstants_t accuracyConstants;
 
+        assemblyStatistics_t lastAssemblyStatistics;
+
         // internal
         typedef struct
         {
@@ -110,15 +136,47 @@ namespace xgandalf
 
         std::vector<candidateLattice_t> candidateLattices;
         void computeCandidateLattices(Eigen::Matrix3Xf& candidateVectors, Eigen::RowVectorXf& candidateVectorWeights,
-                                      std::vector<std::vector<uint16_t>>& pointIndicesOnVector);
-        void computeAssembledLatticeStatistics(candidateLattice_t& candidateLattice, const Eigen::Matrix3Xf& pointsToFitInReciprocalSpace);
+                                      const PointIndicesOnVectors& pointIndicesOnVector);
+        void computeAssembledLatticeStatistics(candidateLattice_t& candidateLattice, const Eigen::Matrix3Xf& pointsToFitInReciprocalSpace) const;
         void selectBestLattices(std::vector<Lattice>& assembledLattices, std::vector<assembledLatticeStatistics_t>& assembledLatticesStatistics,
-                                std::list<candidateLattice_t>& finalCandidateLattices);
+                                std::vector<candidateLattice_t>& finalCandidateLattices);
+
+        // to avoid frequent reallocation in selectBestLattices
+        std::vector<candidateLattice_t> selectionCandidateLattices;
+        std::vector<uint32_t> selectionOrder;
+        std::vector<uint64_t> selectionPointBitsets;
+        std::vector<uint64_t> selectionCombinedPointBitset;
 
         std::vector<uint32_t> sortIndices; // to avoid frequent reallocation
         std::vector<Lattice> validLattices;
 
-        uint16_t countUniqueColumns(const Eigen::Matrix3Xf& millerIndices);
+        // to avoid frequent reallocation in computeCandidateLattices
+        PointIndicesOnVectors pointIndicesOnVector_converted;
+        std::vector<uint32_t> candidateVectorIndices;
+        // the points on every remaining candidate vector as a bitset, so that intersections are AND plus popcount
+        std::vector<uint64_t> pointBitsetsOnVectors;
+        uint32_t pointBitsetsWordsCount;
+        std::vector<uint64_t> pointBitsetOnTwoVectors; // one bitset per worker
+        // upper triangle of the pair compatibility graph, one bitset of compatibleVectorsWordsCount words per candidate vector
+        uint32_t compatibleVectorsWordsCount;
+        std::vector<uint64_t> compatibleVectors;
+        void computeCompatibleVectorPairs(const Eigen::Matrix3Xf& candidateVectors, uint32_t pointBitsetWordsCount);
+
+        typedef struct
+        {
+            uint64_t testedTripletsCount;
+            uint64_t passingDeterminantFilterCount;
+            uint64_t passingPointsOnLatticeFilterCount;
+        } candidateLatticesCounters_t;
+        std::vector<std::vector<candidateLattice_t>> candidateLatticesOfFirstVector;
+        std::vector<candidateLatticesCounters_t> candidateLatticesCountersOfFirstVector;
+        void computeCandidateLatticesOfFirstVector(uint16_t i, const Eigen::Matrix3Xf& candidateVectors, const Eigen::RowVectorXf& candidateVectorWeights,
+                                                   uint64_t* pointsOnBothVectors, std::vector<candidateLattice_t>& newCandidateLattices,
+                                                   candidateLatticesCounters_t& counters) const;
+
+        WorkerPool workerPool;
+
+        static uint16_t countUniqueColumns(const Eigen::Matrix3Xf& millerIndices);
 
         void filterCandidateLatticesByWeight(uint32_t maxToTakeCount);
         void filterCandidateBasesByMeanRelativeDefect(uint32_t maxToTakeCount);
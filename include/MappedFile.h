@@ -0,0 +1,61 @@
+/*
+ * MappedFile.h
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+
+namespace xgandalf
+{
+    // read only memory mapping of a whole file. Not copyable
+    class MappedFile
+    {
+      public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // false if the file does not exist or cannot be mapped
+        bool open(const std::string& path);
+        void close();
+
+        bool isOpen() const;
+        const char* getData() const;
+        size_t getSize() const;
+
+      private:
+        const char* data;
+        size_t size;
+#ifdef _WIN32
+        void* fileHandle;
+        void* mappingHandle;
+#endif
+    };
+} // namespace xgandalf
+#endif /* MAPPEDFILE_H_ */
@@ -0,0 +1,69 @@
+/*
+ * PointIndicesOnVectors.h
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef POINTINDICESONVECTORS_H_
+#define POINTINDICESONVECTORS_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace xgandalf
+{
+    // Indices of the points that lie close to each of a set of vectors, in compressed sparse row layout. The indices of vector i are
+    // pointIndices[offsets[i]] ... pointIndices[offsets[i + 1] - 1], sorted ascending. One allocation for all vectors instead of one per vector.
+    class PointIndicesOnVectors
+    {
+      public:
+        PointIndicesOnVectors()
+            : offsets(1, 0)
+        {
+        }
+
+        uint32_t getVectorsCount() const
+        {
+            return offsets.size() - 1;
+        }
+        uint32_t getPointsCount(uint32_t vectorIndex) const
+        {
+            return offsets[vectorIndex + 1] - offsets[vectorIndex];
+        }
+        const uint16_t* begin(uint32_t vectorIndex) const
+        {
+            return pointIndices.data() + offsets[vectorIndex];
+        }
+        const uint16_t* end(uint32_t vectorIndex) const
+        {
+            return pointIndices.data() + offsets[vectorIndex + 1];
+        }
+
+        // copies and sorts the indices of every vector
+        void assign(const std::vector<std::vector<uint16_t>>& pointIndicesOnVector);
+        void toVectors(std::vector<std::vector<uint16_t>>& pointIndicesOnVector) const;
+
+        std::vector<uint32_t> offsets; // vectorsCount + 1 entries
+        std::vector<uint16_t> pointIndices;
+    };
+} // namespace xgandalf
+#endif /* POINTINDICESONVECTORS_H_ */
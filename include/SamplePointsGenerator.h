@@ -26,8 +26,12 @@
 #ifndef SAMPLEPOINTSGENERATOR_H_
 #define SAMPLEPOINTSGENERATOR_H_
 
+#include "MappedFile.h"
+#include "samplePointsFile.h"
 #include <Eigen/Dense>
+#include <memory>
 #include <string.h>
+#include <string>
 
 namespace xgandalf
 {
@@ -35,16 +39,49 @@ namespace xgandalf
     class SamplePointsGenerator
     {
       public:
+        enum class ShellSamplePointsSource
+        {
+            precomputed, // closest stored pitch and tolerance. Falls back to generated, if no precomputed data is found
+            generated    // exact pitch and tolerance, computed on the fly
+        };
+
         SamplePointsGenerator();
 
+        void setShellSamplePointsSource(ShellSamplePointsSource shellSamplePointsSource);
+        ShellSamplePointsSource getShellSamplePointsSource() const;
+
         void getDenseGrid(Eigen::Matrix3Xf& samplePoints, float unitPitch, float minRadius, float maxRadius);
 
         void getTightGrid(Eigen::Matrix3Xf& samplePoints, float unitPitch, float tolerance, const Eigen::VectorXf radii);
 
+        // Grids are cached process wide and shared by all callers requesting the same parameters. Thread safe. A grid stays in the cache as long as any
+        // caller holds a reference to it
+        std::shared_ptr<const Eigen::Matrix3Xf> getDenseGrid(float unitPitch, float minRadius, float maxRadius);
+        std::shared_ptr<const Eigen::Matrix3Xf> getTightGrid(float unitPitch, float tolerance, const Eigen::VectorXf& radii);
+
+        // quasi uniform points on the upper half of a unit spherical shell of thickness 2 * tolerance, with the same layout as the precomputed grids
+        static void generateSamplePointsOnShell(Eigen::Matrix3Xf& samplePoints, float unitPitch, float tolerance);
+
       private:
+        ShellSamplePointsSource shellSamplePointsSource;
+
         std::string precomputedSamplePointsPath;
+        std::string precomputedSamplePointsBinaryPath;
+
+        // binary file with all grids (see samplePointsFile.h), mapped on first use and shared process wide. Null if not available
+        std::shared_ptr<const MappedFile> samplePointsFile;
+        bool samplePointsFileChecked;
+        // only used if the binary file is not available
+        Eigen::Array<float, 1, Eigen::Dynamic> pitches, tolerances;
 
         void loadPrecomputedSamplePoints(Eigen::Matrix3Xf& samplePoints, float unitPitch, float tolerance);
+        void loadPrecomputedSamplePointsFromBinaryFile(Eigen::Matrix3Xf& samplePoints, float unitPitch, float tolerance);
+        void loadPrecomputedSamplePointsFromTextFiles(Eigen::Matrix3Xf& samplePoints, float unitPitch, float tolerance);
+        void mapSamplePointsFile();
+        bool isPrecomputedDataAvailable();
+
+        static void computeDenseGrid(Eigen::Matrix3Xf& samplePoints, float unitPitch, float minRadius, float maxRadius);
+        void computeTightGrid(Eigen::Matrix3Xf& samplePoints, float unitPitch, float tolerance, const Eigen::VectorXf& radii, bool generateShells);
     };
 
 } // namespace xgandalf
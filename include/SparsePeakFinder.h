@@ -29,6 +29,7 @@
 #include "WrongUsageException.h"
 #include <Eigen/Dense>
 #include <algorithm>
+#include <cstdint>
 #include <ctype.h>
 #include <vector>
 
@@ -47,15 +48,31 @@ namespace xgandalf
         void findPeaks_fast(Eigen::Matrix3Xf& pointPositions, Eigen::RowVectorXf& pointValues);
 
       private:
-        // fast, but insecure: if point lies out of scope, it gets relocated somewhere inside the scope. Maximum bins per direction is 200;
-        inline uint32_t getIndex(const Eigen::Vector3f& position) const
+        // 21 bits per dimension, y most significant and x least significant, so the key order is the scan order of a dense volume. Points far out of
+        // scope get merged into the outermost bins. The neighbour offsets of bins at coordinate 0 wrap to keys that never exist
+        inline uint64_t getKey(const Eigen::Vector3f& position) const
         {
-            return std::min((uint32_t)((position - bin1Position) * binWidth_reciprocal).array().floor().matrix().dot(strides),
-                            binCountMinus1); // min could be avoided for the price of unsafety
+            const float maxCoordinate = (1 << 21) - 2;
+            Eigen::Vector3f binCoordinates = ((position - bin1Position) * binWidth_reciprocal).array().floor().max(0.0f).min(maxCoordinate);
+            return (uint64_t)binCoordinates.x() | ((uint64_t)binCoordinates.z() << 21) | ((uint64_t)binCoordinates.y() << 42);
         }
+        // points out of scope are only used as neighbours, they are never reported as peaks
+        inline bool isInScope(uint64_t key) const
+        {
+            const uint64_t coordinateMask = (1 << 21) - 1;
+            const uint64_t maxCoordinate = binsPerDimension - 2;
+            const uint64_t x = key & coordinateMask, z = (key >> 21) & coordinateMask, y = key >> 42;
+            return x >= 1 && x <= maxCoordinate && y >= 1 && y <= maxCoordinate && z >= 1 && z <= maxCoordinate;
+        }
+        inline uint32_t getHashSlot(uint64_t key) const
+        {
+            return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> hashTableShift);
+        }
+        inline int32_t findBin(uint64_t key) const;
 
         typedef struct
         {
+            uint64_t key;
             int pointIndex;
             float value;
         } bin_t;
@@ -66,12 +83,14 @@ namespace xgandalf
 
         float binWidth, binWidth_reciprocal;
         int binsPerDimension;
-        uint32_t binCountMinus1;
         Eigen::Vector3f bin1Position;
-        Eigen::Vector3f strides;
 
-        std::vector<bin_t> discretizationVolume;
-        int32_t neighbourBinIndexOffsets[26];
+        std::vector<bin_t> occupiedBins;
+        std::vector<int32_t> hashTable; // index in occupiedBins or -1
+        uint32_t hashTableMask;
+        uint32_t hashTableShift;
+        std::vector<uint32_t> sortedBinIndices;
+        uint64_t neighbourKeyOffsets[26];
 
         bool precomputed;
 
@@ -0,0 +1,84 @@
+/*
+ * WorkerPool.h
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKERPOOL_H_
+#define WORKERPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xgandalf
+{
+    // Persistent pool of worker threads. Threads are only spawned on the first run() that needs them and are reused afterwards.
+    // Copying a pool copies its thread count only, the copy spawns its own threads.
+    class WorkerPool
+    {
+      public:
+        WorkerPool();
+        explicit WorkerPool(uint32_t threadCount);
+        WorkerPool(const WorkerPool& other);
+        WorkerPool& operator=(const WorkerPool& other);
+        ~WorkerPool();
+
+        // threadCount = 0 selects the number of hardware threads. The calling thread is counted as one of the workers.
+        void setThreadCount(uint32_t threadCount);
+        uint32_t getThreadCount() const;
+
+        // Calls task(taskIndex, workerIndex) for every taskIndex in [0, taskCount) and returns when all tasks are done. Tasks are handed out dynamically,
+        // workerIndex is in [0, getThreadCount()) and can be used to address per-worker scratch data. The calling thread participates as worker 0.
+        // The first exception thrown by a task is rethrown in the calling thread. Nested calls (from inside a task, also through runs of other pools on
+        // the same thread) are executed serially by the calling worker with its own workerIndex. A pool must not be run from several threads concurrently.
+        void run(uint32_t taskCount, const std::function<void(uint32_t taskIndex, uint32_t workerIndex)>& task);
+
+      private:
+        void startThreads();
+        void stopThreads();
+        void workerLoop(uint32_t workerIndex, uint64_t startGeneration);
+        void work(uint32_t workerIndex);
+
+        uint32_t threadCount;
+        std::vector<std::thread> threads;
+
+        std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::condition_variable workDone;
+        bool stopRequested;
+        uint64_t generation;
+        uint32_t busyWorkersCount;
+
+        const std::function<void(uint32_t, uint32_t)>* currentTask;
+        uint32_t currentTaskCount;
+        std::atomic<uint32_t> nextTaskIndex;
+        std::exception_ptr firstException;
+    };
+} // namespace xgandalf
+
+#endif /* WORKERPOOL_H_ */
@@ -61,6 +61,46 @@ typedef enum {
     GRADIENT_DESCENT_ITERATION_COUNT_lastEnum
 } gradientDescentIterationsCount_t;
 
+typedef enum {
+    SAMPLING_STRATEGY_uniform = 0,
+    SAMPLING_STRATEGY_coarseToFine = 1,
+
+    SAMPLING_STRATEGY_lastEnum
+} samplingStrategy_t;
+
+
+typedef struct {
+    // wall times in seconds
+    double coarseSamplingTime_s; // only for the coarse to fine sampling strategy
+    double globalHillClimbingTime_s;
+    double additionalGlobalHillClimbingTime_s;
+    double peakFindingTime_s;
+    double peaksHillClimbingTime_s;
+    double latticeAssemblyTime_s;
+    double totalTime_s;
+
+    int reciprocalPeaksCount;
+    int usedReciprocalPeaksCount;
+    int hillClimbingSamplePointsCount;
+    long long transformCallsCount;
+    long long evaluatedSamplePointsCount;
+    int foundPeaksCount;
+    int keptPeaksCount;
+
+    // lattice assembly
+    int candidateVectorsCount;
+    int compatiblePairsCount;
+    long long testedTripletsCount;
+    long long passingDeterminantFilterCount;
+    long long passingPointsOnLatticeFilterCount;
+    int passingLatticeParametersFilterCount;
+    int passingGlobalWeightFilterCount;
+    int passingLocalWeightFilterCount;
+    int passingRelativeDefectFilterCount;
+    int selectedLatticesCount;
+    int refinementCallsCount;
+    int levenbergMarquardtIterationsCount;
+} indexingStatistics_t;
 
 typedef struct IndexerPlain IndexerPlain;
 
@@ -69,11 +109,15 @@ void IndexerPlain_delete(IndexerPlain* indexerPlain);
 
 void IndexerPlain_setSamplingPitch(IndexerPlain* indexerPlain, samplingPitch_t samplingPitch);
 void IndexerPlain_setGradientDescentIterationsCount(IndexerPlain* indexerPlain, gradientDescentIterationsCount_t gradientDescentIterationsCount);
+void IndexerPlain_setSamplingStrategy(IndexerPlain* indexerPlain, samplingStrategy_t samplingStrategy);
 void IndexerPlain_setRefineWithExactLattice(IndexerPlain* indexerPlain, int flag);
 void IndexerPlain_setMaxPeaksToUseForIndexing(IndexerPlain* indexerPlain, int maxPeaksToUseForIndexing);
 
 void IndexerPlain_index(IndexerPlain* indexerPlain, Lattice_t* assembledLattices, int* assembledLatticesCount, int maxAssambledLatticesCount,
                         reciprocalPeaks_1_per_A_t reciprocalPeaks_1_per_A, int* peakCountOnLattices);
+// indexingStatistics may be NULL
+void IndexerPlain_indexWithStatistics(IndexerPlain* indexerPlain, Lattice_t* assembledLattices, int* assembledLatticesCount, int maxAssambledLatticesCount,
+                                      reciprocalPeaks_1_per_A_t reciprocalPeaks_1_per_A, int* peakCountOnLattices, indexingStatistics_t* indexingStatistics);
 
 void backProjectDetectorPeaks(reciprocalPeaks_1_per_A_t* reciprocalPeaks_1_per_A, const ExperimentSettings* experimentSettings, const float* coordinates_x,
                               const float* coordinates_y, int peakCount);
@@ -0,0 +1,69 @@
+/*
+ * bitOperations.h
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITOPERATIONS_H_
+#define BITOPERATIONS_H_
+
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace xgandalf
+{
+    // index of the lowest set bit. x must not be 0
+    static inline uint32_t countTrailingZeros(uint32_t x)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, x);
+        return index;
+#else
+        return __builtin_ctz(x);
+#endif
+    }
+
+    // index of the lowest set bit. x must not be 0
+    static inline uint32_t countTrailingZeros(uint64_t x)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, x);
+        return index;
+#else
+        return __builtin_ctzll(x);
+#endif
+    }
+
+    static inline uint32_t popCount(uint64_t x)
+    {
+#ifdef _MSC_VER
+        return (uint32_t)__popcnt64(x);
+#else
+        return __builtin_popcountll(x);
+#endif
+    }
+} // namespace xgandalf
+#endif /* BITOPERATIONS_H_ */
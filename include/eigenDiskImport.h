@@ -31,6 +31,7 @@
 #include <algorithm>
 #include <fstream>
 #include <iterator>
+#include <sstream>
 #include <string.h>
 #include <vector>
 
@@ -48,17 +49,16 @@ namespace xgandalf
             throw BadInputException(errStream.str());
         }
 
-        std::istream_iterator<typename T::RealScalar> startFile(file), end;
-        std::vector<typename T::RealScalar> numbers(startFile, end);
-
-        file.clear();
-        file.seekg(std::ios::beg);
+        // the first line determines the number of columns, the rest of the file is parsed in the same pass
         std::string firstLine;
         getline(file, firstLine);
         std::istringstream iss(firstLine);
-        std::vector<typename T::RealScalar> firstLineNumbers(std::istream_iterator<typename T::RealScalar>(iss), end);
+        std::istream_iterator<typename T::RealScalar> end;
+        std::vector<typename T::RealScalar> numbers(std::istream_iterator<typename T::RealScalar>(iss), end);
+        const size_t firstLineNumbersCount = numbers.size();
+        numbers.insert(numbers.end(), std::istream_iterator<typename T::RealScalar>(file), end);
 
-        int cols = (int)firstLineNumbers.size();
+        int cols = (int)firstLineNumbersCount;
         int rows = (int)numbers.size() / cols;
 
         bool constexpr checkDynamicRows = T::RowsAtCompileTime != Eigen::Dynamic;
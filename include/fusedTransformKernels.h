@@ -0,0 +1,77 @@
+/*
+ * fusedTransformKernels.h
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FUSEDTRANSFORMKERNELS_H_
+#define FUSEDTRANSFORMKERNELS_H_
+
+#include <cstdint>
+
+// This header is included by translation units that are compiled with special instruction set flags. It must not include any headers with inline
+// functions (like Eigen or the STL), otherwise those could be emitted with instructions that are not available on the executing machine.
+
+namespace xgandalf
+{
+    // Arguments of the fused inverse space transform. The positions are processed in tiles of getFusedTransformTileWidth() positions. For every tile all
+    // points are streamed once, computing the projection, the periodic function, the close to point test and all reductions in registers.
+    typedef struct
+    {
+        // input
+        const float* pointsToTransform; // 3 x pointsCount, column major
+        const float* pointsToTransformWeights;
+        uint32_t pointsCount;
+        const float* positionsToEvaluate; // 3 x positionsCount, column major
+        uint32_t positionsCount;
+
+        int functionSelection; // 1 or 9
+        int exponent;          // integer exponent, at least 1
+        float slopeScaling;    // function 1 only
+        bool fastTrigonometry; // function 1 only, use the low degree sine and cosine polynomials
+        float closeToPointThreshold; // function 1: minimum function value, function 9: maximum distance to the closest integer
+        bool localTransform;
+        float inverseTransformEvaluationScalingFactor;
+        bool evaluationOnly; // skips the slope and the gradient
+
+        // output
+        float* gradient; // 3 x positionsCount, column major. Not written with evaluationOnly
+        float* inverseTransformEvaluation;
+        float* closeToPointsCount;
+        // pointsCount masks per tile. Bit i of closeToPointMasks[tileIndex * pointsCount + pointIndex] is set, if the point is close to position i of the tile.
+        // nullptr to skip
+        uint16_t* closeToPointMasks;
+    } fusedTransformArguments_t;
+
+    const uint32_t fusedTransformMaxTileWidth = 16;
+
+    // 0 if no fused kernel is available for the executing machine
+    uint32_t getFusedTransformTileWidth();
+    void performFusedTransform(const fusedTransformArguments_t& arguments);
+
+#ifdef XGANDALF_SIMD_KERNELS
+    void performFusedTransform_avx2(const fusedTransformArguments_t& arguments);
+    void performFusedTransform_avx512(const fusedTransformArguments_t& arguments);
+#endif
+} // namespace xgandalf
+
+#endif /* FUSEDTRANSFORMKERNELS_H_ */
@@ -26,6 +26,7 @@
 #ifndef POINTAUTOCORRELATION_H_
 #define POINTAUTOCORRELATION_H_
 
+#include "WorkerPool.h"
 #include <Eigen/Dense>
 #include <limits>
 
@@ -34,11 +35,19 @@ namespace xgandalf
 
     // all autocorrelation results will have only half of the possible points, since symmetric points (at z < 0) will be removed
 
+    // Only pairs of points in neighbouring cells of a grid with cell width maxNormInAutocorrelation are compared, so memory is proportional to the
+    // number of returned points. The points are ordered by center point index and then by shifted point index, as if all pairs were filtered.
+    // The variants with a workerPool process blocks of center points in parallel and yield the same result.
+
     void getPointAutocorrelation(Eigen::Matrix3Xf& autocorrelationPoints, const Eigen::Matrix3Xf& points, float minNormInAutocorrelation,
                                  float maxNormInAutocorrelation);
+    void getPointAutocorrelation(Eigen::Matrix3Xf& autocorrelationPoints, const Eigen::Matrix3Xf& points, float minNormInAutocorrelation,
+                                 float maxNormInAutocorrelation, WorkerPool& workerPool);
 
     void getPointAutocorrelation(Eigen::Matrix3Xf& autocorrelationPoints, Eigen::VectorXi& centerPointIndices, Eigen::VectorXi& shiftedPointIndices,
                                  const Eigen::Matrix3Xf& points, float minNormInAutocorrelation, float maxNormInAutocorrelation);
+    void getPointAutocorrelation(Eigen::Matrix3Xf& autocorrelationPoints, Eigen::VectorXi& centerPointIndices, Eigen::VectorXi& shiftedPointIndices,
+                                 const Eigen::Matrix3Xf& points, float minNormInAutocorrelation, float maxNormInAutocorrelation, WorkerPool& workerPool);
 
 } // namespace xgandalf
 #endif /* POINTAUTOCORRELATION_H_ */
@@ -41,6 +41,8 @@ namespace xgandalf
     // M: miller indices (reciprocal)
     // N: reciprocal peaks
     void getGradient_detectorAngleMatch(Eigen::Matrix3f& gradient, const Eigen::Matrix3f& B, const Eigen::Matrix3Xf& M, const Eigen::Matrix3Xf& N);
+    // numeric differentiation in double, only used for testing the analytic version
+    void getGradient_detectorAngleMatch_numeric(Eigen::Matrix3f& gradient, const Eigen::Matrix3f& B, const Eigen::Matrix3Xf& M, const Eigen::Matrix3Xf& N);
 
     // B: reciprocal basis
     // M: miller indices (reciprocal)
@@ -58,13 +60,24 @@ namespace xgandalf
     // N: reciprocal peaks
     void refineReciprocalBasis_meanDist_peaksAndAngle(Eigen::Matrix3f& B, const Eigen::Matrix3Xf& M, const Eigen::Matrix3Xf& N);
 
+    // Same objective as refineReciprocalBasis_meanDist_peaksAndAngle, minimized with Levenberg-Marquardt steps over the 9 basis entries, starting from
+    // B or from the least squares basis, whichever is better. Stops when the objective changes less than 1e-7 relatively. Bases whose determinant
+    // differs by more than a factor of 2 from the one of the initial B are rejected. Returns the iterations count
+    // B: reciprocal basis
+    // M: miller indices (reciprocal)
+    // N: reciprocal peaks
+    int refineReciprocalBasis_meanDist_peaksAndAngle_levenbergMarquardt(Eigen::Matrix3f& B, const Eigen::Matrix3Xf& M, const Eigen::Matrix3Xf& N);
+
     // B: reciprocal basis
     // M: miller indices (reciprocal)
     // N: reciprocal peaks
-    // TODO: Function can be made faster easily... nevertheless double is really necessary...
     void getGradient_detectorAngleMatchFixedLattice(Eigen::Vector3f& rotationAnglesGradient_detectorAngle,
                                                     Eigen::Vector3f& rotationAnglesGradient_distFromPoints, const Eigen::Matrix3f& B, const Eigen::Matrix3Xf& M,
                                                     const Eigen::Matrix3Xf& N);
+    // numeric differentiation in double, only used for testing the analytic version
+    void getGradient_detectorAngleMatchFixedLattice_numeric(Eigen::Vector3f& rotationAnglesGradient_detectorAngle,
+                                                            Eigen::Vector3f& rotationAnglesGradient_distFromPoints, const Eigen::Matrix3f& B,
+                                                            const Eigen::Matrix3Xf& M, const Eigen::Matrix3Xf& N);
     // B: reciprocal basis
     // B_sample: sample reciprocal basis (with correct lattice parameters)
     // M: miller indices (reciprocal)
@@ -0,0 +1,73 @@
+/*
+ * samplePointsFile.h
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMPLEPOINTSFILE_H_
+#define SAMPLEPOINTSFILE_H_
+
+#include <cstdint>
+
+namespace xgandalf
+{
+    // Binary file containing all precomputed sample point grids, meant to be memory mapped. Layout (all offsets in bytes from the start of the file):
+    //   samplePointsFileHeader_t
+    //   float pitches[pitchesCount]
+    //   float tolerances[tolerancesCount]
+    //   samplePointsFileGrid_t grids[gridsCount]
+    //   grid data, every grid 3 x pointsCount float32, column major (x, y, z of every point), starting at a multiple of samplePointsFileAlignment
+    // Written in the byte order of the converting machine. byteOrderMark detects files written on a machine with different byte order.
+
+    const char samplePointsFileMagic[8] = {'X', 'G', 'S', 'P', 'O', 'I', 'N', 'T'};
+    const uint32_t samplePointsFileVersion = 1;
+    const uint32_t samplePointsFileByteOrderMark = 0x01020304;
+    const uint32_t samplePointsFileAlignment = 64;
+    const char samplePointsFileName[] = "samplePoints.bin";
+
+    typedef struct
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrderMark;
+        uint64_t fileSize;
+
+        uint32_t pitchesCount;
+        uint32_t tolerancesCount;
+        uint32_t gridsCount;
+        uint32_t reserved;
+
+        uint64_t pitchesOffset;
+        uint64_t tolerancesOffset;
+        uint64_t gridsOffset;
+    } samplePointsFileHeader_t;
+
+    typedef struct
+    {
+        float pitch;
+        float tolerance;
+        uint32_t pointsCount;
+        uint32_t reserved;
+        uint64_t dataOffset;
+    } samplePointsFileGrid_t;
+} // namespace xgandalf
+#endif /* SAMPLEPOINTSFILE_H_ */
@@ -28,10 +28,21 @@
 
 #include "BadInputException.h"
 #include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
 
 namespace xgandalf
 {
     void filterSamplePointsForNorm(Eigen::Matrix3Xf& samplePoints, const Eigen::ArrayXf& allowedNorms, float allowedTolerance);
+
+    // output is sorted by descending evaluation. sortIndices is scratch space
+    void keepSamplePointsWithHighestEvaluation(Eigen::Matrix3Xf& samplePoints, Eigen::RowVectorXf& samplePointsEvaluation, uint32_t maxToTakeCount,
+                                               std::vector<uint32_t>& sortIndices);
+
+    // index of the closest coarse sample point for every sample point. The search is done in cells of size maxDistance and is exact for all sample points
+    // that have a coarse sample point within maxDistance
+    void assignSamplePointsToClosestCoarseSamplePoints(std::vector<uint32_t>& closestCoarseSamplePointIndices, const Eigen::Matrix3Xf& samplePoints,
+                                                       const Eigen::Matrix3Xf& coarseSamplePoints, float maxDistance);
 }
 
 #endif /* SAMPLEPOINTSFILTERING_H_ */
@@ -34,8 +34,10 @@ namespace xgandalf
     void test_fixedBasisRefinementKabsch();
     void test_fixedBasisRefinement();
     void test_mixedGradientDescentRefinement();
+    void test_levenbergMarquardtRefinement();
     void test_gradientDescentRefinement();
     void test_getGradient();
+    void test_detectorAngleMatchGradients();
     void test_latticeReorder();
     void test_crystfelAdaption2();
     void test_crystfelAdaption();
@@ -45,10 +47,14 @@ namespace xgandalf
     void test_dbscan();
     void test_pointAutocorrelation();
     void test_latticeAssembler();
+    void test_latticeAssemblerKnownObliqueCell();
     void test_sparsePeakFinder();
     void test_hillClimbing();
     void test_computeStep();
     void test_InverseSpaceTransform();
+    void test_trigonometryAccuracy();
+    void test_evaluationOnlyTransform();
+    void test_workerPoolNesting();
 
 } // namespace xgandalf
 
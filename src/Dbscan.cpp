@@ -26,6 +26,7 @@
  */
 
 #include <Dbscan.h>
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -37,11 +38,7 @@ namespace xgandalf
     Dbscan::Dbscan()
         : squaredEpsilon(0)
         , maxEpsilon(0)
-        , binWidth(0)
         , binWidth_reciprocal(0)
-        , binsPerDimension(0)
-        , binCount(0)
-        , binCountMinus1(0)
     {
     }
 
@@ -53,32 +50,12 @@ namespace xgandalf
     void Dbscan::init(float maxEpsilon, float maxPossiblePointNorm)
     {
         this->maxEpsilon = maxEpsilon;
+        squaredEpsilon = 0;
 
-        if (maxEpsilon < maxPossiblePointNorm / 50)
-        {
-            cout << "dbscan histogram would take too much memory! Reducing performance in trade of memory!" << endl << endl;
-            this->maxEpsilon = maxPossiblePointNorm / 50;
-        }
-
-        binWidth = this->maxEpsilon;
-
-        binWidth_reciprocal = 1 / binWidth;
+        binWidth_reciprocal = 1 / maxEpsilon;
 
-        binsPerDimension = 2 * ceil(maxPossiblePointNorm / binWidth) + 2 + 1; //+2 for one extra border bin, where nothing should be inside.
-        binCount = binsPerDimension * binsPerDimension * binsPerDimension;
-        binCountMinus1 = binCount - 1;
-        bin1Position.setConstant(-1.0f * binsPerDimension / 2 * binWidth);
-        strides << 1, binsPerDimension, binsPerDimension * binsPerDimension;
-
-        discretizationVolume.resize(binCount);
-
-        const uint32_t typicalMaxPointsPerBin = 50;
-        for (auto bin = discretizationVolume.begin(); bin != discretizationVolume.end(); ++bin)
-        {
-            bin->reserve(typicalMaxPointsPerBin);
-        }
-
-        neighbourBinIndexOffsets[0] = 0;
+        // same order as the neighbour bins of a dense volume
+        neighbourSlots[1 * 9 + 1 * 3 + 1] = 0;
         int neighboursIndex = 1;
         for (int x = -1; x <= 1; x++)
         {
@@ -88,15 +65,16 @@ namespace xgandalf
                 {
                     if (!(x == 0 && y == 0 && z == 0))
                     {
-                        neighbourBinIndexOffsets[neighboursIndex] = x + y * strides.y() + z * strides.z();
+                        neighbourSlots[(x + 1) * 9 + (y + 1) * 3 + (z + 1)] = neighboursIndex;
                         neighboursIndex++;
                     }
                 }
             }
         }
 
-        mainNeighbourhood.reserve(27 * typicalMaxPointsPerBin);
-        neighbourNeighbourhood.reserve(27 * typicalMaxPointsPerBin);
+        const uint32_t typicalMaxNeighboursCount = 50;
+        mainNeighbourhood.reserve(typicalMaxNeighboursCount);
+        neighbourNeighbourhood.reserve(typicalMaxNeighboursCount);
     }
 
     void Dbscan::computeClusters(vector<cluster_t>& clusters, const Matrix3Xf& points, uint16_t minPoints, float epsilon)
@@ -114,20 +92,19 @@ namespace xgandalf
 
         clusters.reserve(50); // just for performance
 
-        fillDiscretizationVolume(points);
+        fillCells(points);
 
-        const auto end = usedBins.end();
-        for (auto bin_p = usedBins.begin(); bin_p != end; ++bin_p)
+        for (uint32_t cellIndex = 0; cellIndex < cells.size(); ++cellIndex)
         {
-            bin_t& bin = **bin_p;
-            for (uint32_t i = 0; i < bin.size(); ++i)
+            const cell_t& cell = cells[cellIndex];
+            for (uint32_t i = cell.firstEntry; i < cell.firstEntry + cell.entriesCount; ++i)
             {
-                if (bin[i].visited)
+                if (binEntries[i].visited)
                 {
                     continue;
                 }
 
-                Neighbour currentPoint(*bin_p, &bin[i]);
+                Neighbour currentPoint(cellIndex, &binEntries[i]);
 
                 currentPoint.markVisited();
 
@@ -140,8 +117,6 @@ namespace xgandalf
                 }
             }
         }
-
-        cleanUpDiscretizationVolume();
     }
 
     void Dbscan::expandCluster(cluster_t& cluster, std::vector<Neighbour>& neighbourhood, Neighbour& currentPoint, uint16_t minPoints)
@@ -149,9 +124,9 @@ namespace xgandalf
         cluster.push_back(currentPoint.pointIndex());
         currentPoint.markIsMemberOfCluster();
 
-        for (vector<Neighbour>::iterator neighbour_i = neighbourhood.begin(); neighbour_i != neighbourhood.end(); ++neighbour_i)
-        { // cannot be made a for-each loop, since neighbourhood size changes
-            Neighbour& neighbour = *neighbour_i;
+        for (size_t i = 0; i < neighbourhood.size(); ++i)
+        { // cannot be made a for-each loop, since neighbourhood size changes. Neighbour is a copy, because inserting can reallocate
+            Neighbour neighbour = neighbourhood[i];
             if (!neighbour.isVisited())
             {
                 neighbour.markVisited();
@@ -175,20 +150,25 @@ namespace xgandalf
         nieghbourhood.clear();
 
         const Vector4f& currentPointPos = currentPoint.point();
+        const cell_t& currentCell = cells[currentPoint.cellIndex];
         for (int j = 0; j < 27; j++)
         {
-            int neighbourBinIndexOffset = neighbourBinIndexOffsets[j];
+            const int32_t neighbourCellIndex = currentCell.neighbourCells[j];
+            if (neighbourCellIndex < 0)
+            {
+                continue;
+            }
 
-            bin_t& neighbourBin = *(currentPoint.bin + neighbourBinIndexOffset);
-            for (uint32_t i = 0; i < neighbourBin.size(); ++i)
+            const cell_t& neighbourCell = cells[neighbourCellIndex];
+            for (uint32_t i = neighbourCell.firstEntry; i < neighbourCell.firstEntry + neighbourCell.entriesCount; ++i)
             {
-                const Vector4f& neighbourPos = neighbourBin[i].point;
+                const Vector4f& neighbourPos = binEntries[i].point;
                 if ((currentPointPos - neighbourPos).squaredNorm() <= squaredEpsilon)
                 {
                     validNeighboursCount++;
-                    if (!neighbourBin[i].visitedAndMemberOfCluster)
+                    if (!binEntries[i].visitedAndMemberOfCluster)
                     {
-                        nieghbourhood.emplace_back(&neighbourBin, &neighbourBin[i]);
+                        nieghbourhood.emplace_back(neighbourCellIndex, &binEntries[i]);
                     }
                 }
             }
@@ -197,34 +177,67 @@ namespace xgandalf
         return validNeighboursCount;
     }
 
-    void Dbscan::fillDiscretizationVolume(const Eigen::Matrix3Xf& points)
+    void Dbscan::fillCells(const Eigen::Matrix3Xf& points)
     {
         uint32_t pointsCount = points.cols();
 
+        // sorting by key and point index groups the points by cell, keeping the point order inside of every cell
+        pointKeys.resize(pointsCount);
+        for (uint32_t i = 0; i < pointsCount; ++i)
+        {
+            pointKeys[i] = make_pair(getKey(points.col(i)), i);
+        }
+        sort(pointKeys.begin(), pointKeys.end());
+
+        binEntries.resize(pointsCount);
+        cells.clear();
         for (uint32_t i = 0; i < pointsCount; ++i)
         {
-            const Vector3f& point = points.col(i);
-            const uint32_t index = getIndex(point);
-            bin_t& bin = discretizationVolume[index];
+            const uint32_t pointIndex = pointKeys[i].second;
+            const Vector3f& point = points.col(pointIndex);
 
-            bin.emplace_back();
-            auto& entry = bin.back();
+            auto& entry = binEntries[i];
             entry.point = Vector4f(point.x(), point.y(), point.z(), 0);
-            entry.pointIndex = i;
+            entry.pointIndex = pointIndex;
             entry.visited = false;
             entry.isMemberOfCluster = false;
             entry.visitedAndMemberOfCluster = false;
 
-            usedBins.insert(&bin);
+            if (cells.empty() || cells.back().key != pointKeys[i].first)
+            {
+                cells.emplace_back();
+                cells.back().key = pointKeys[i].first;
+                cells.back().firstEntry = i;
+                cells.back().entriesCount = 0;
+            }
+            cells.back().entriesCount++;
         }
-    }
 
-    void Dbscan::cleanUpDiscretizationVolume()
-    {
-        const auto end = usedBins.end();
-        for (auto bin_p = usedBins.begin(); bin_p != end; bin_p++)
+        // the cells with neighbouring x are adjacent in key order, so one search per neighbouring (y, z) row is enough
+        const auto keyLess = [](const cell_t& cell, uint64_t key) { return cell.key < key; };
+        for (cell_t& cell : cells)
         {
-            (*bin_p)->clear();
+            for (int z = -1; z <= 1; z++)
+            {
+                for (int y = -1; y <= 1; y++)
+                {
+                    const uint64_t rowKey = cell.key + (uint64_t)((int64_t)y << 21) + (uint64_t)((int64_t)z << 42);
+                    auto neighbourCell = lower_bound(cells.begin(), cells.end(), rowKey - 1, keyLess);
+                    for (int x = -1; x <= 1; x++)
+                    {
+                        const int slot = neighbourSlots[(x + 1) * 9 + (y + 1) * 3 + (z + 1)];
+                        if (neighbourCell != cells.end() && neighbourCell->key == rowKey + x)
+                        {
+                            cell.neighbourCells[slot] = neighbourCell - cells.begin();
+                            ++neighbourCell;
+                        }
+                        else
+                        {
+                            cell.neighbourCells[slot] = -1;
+                        }
+                    }
+                }
+            }
         }
     }
 } // namespace xgandalf
\ No newline at end of file
@@ -26,9 +26,15 @@
  */
 
 #include <HillClimbingOptimizer.h>
+#include <WrongUsageException.h>
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <sstream>
 
 using namespace Eigen;
 using namespace std;
@@ -38,6 +44,11 @@ namespace xgandalf
     HillClimbingOptimizer::HillClimbingOptimizer()
         : transform()
         , hillClimbingAccuracyConstants()
+        , keepPointsCloseToEvaluationPositions(false)
+        , lastPointsCloseToEvaluationPositionsKept(false)
+        , lastPointsCloseToEvaluationPositionsIndicesUpToDate(false)
+        , lastTransformCallsCount(0)
+        , lastEvaluatedPositionsCount(0)
     {
     }
 
@@ -46,13 +57,109 @@ namespace xgandalf
         //    std::ofstream ofs("workfolder/tmp", std::ofstream::out);
         //    ofs << positionsToOptimize.transpose().eval() << endl;
 
-        float& gamma = hillClimbingAccuracyConstants.stepComputationAccuracyConstants.gamma;
-        float& maxStep = hillClimbingAccuracyConstants.stepComputationAccuracyConstants.maxStep;
-        float& minStep = hillClimbingAccuracyConstants.stepComputationAccuracyConstants.minStep;
+        transform.setPointsToTransform(pointsToTransform);
+
+        // chunks are independent of each other, so they are processed in parallel. Every worker has its own transform and step buffers
+        const uint32_t maxPositionsPerIteration = 100; // TODO: find sweet spot. Maybe choose dependent on pointsToTransform.cols()
+        const uint32_t chunksCount = (positionsToOptimize.cols() + maxPositionsPerIteration - 1) / maxPositionsPerIteration;
+
+        // the pool may hand a chunk to any of its workers, so all of them are configured
+        chunkWorkers.resize(workerPool.getThreadCount());
+        for (chunkWorker_t& worker : chunkWorkers)
+        {
+            worker.transform.copySettings(transform);
+            worker.transformCallsCount = 0;
+            worker.evaluatedPositionsCount = 0;
+        }
+        lastInverseTransformEvaluation.resize(positionsToOptimize.cols());
+        lastCloseToPointsCount.resize(positionsToOptimize.cols());
+        if (keepPointsCloseToEvaluationPositions)
+        {
+            chunkPointsCloseToEvaluationPositions.resize(chunksCount);
+        }
+
+        workerPool.run(chunksCount, [&](uint32_t chunkIndex, uint32_t workerIndex) {
+            chunkWorker_t& worker = chunkWorkers[workerIndex];
+
+            int64_t positionsProcessedCount = (int64_t)chunkIndex * maxPositionsPerIteration;
+            uint32_t positionsCount_local = min((int64_t)maxPositionsPerIteration, positionsToOptimize.cols() - positionsProcessedCount);
+
+            worker.positionsToOptimize = positionsToOptimize.block(0, positionsProcessedCount, 3, positionsCount_local);
+            optimizeChunk(worker);
+            positionsToOptimize.block(0, positionsProcessedCount, 3, positionsCount_local) = worker.positionsToOptimize;
+
+            // final evaluation chunk by chunk, so the memory of the transform does not grow with the number of positions
+            setFinalEvaluationFlags(worker.transform);
+            worker.transform.performEvaluation(worker.positionsToOptimize, keepPointsCloseToEvaluationPositions);
+            worker.transformCallsCount++;
+            worker.evaluatedPositionsCount += positionsCount_local;
+            lastInverseTransformEvaluation.segment(positionsProcessedCount, positionsCount_local) = worker.transform.getInverseTransformEvaluation();
+            lastCloseToPointsCount.segment(positionsProcessedCount, positionsCount_local) = worker.transform.getCloseToPointsCount();
+            if (keepPointsCloseToEvaluationPositions)
+            {
+                swap(chunkPointsCloseToEvaluationPositions[chunkIndex], worker.transform.getPointsCloseToEvaluationPositions());
+            }
+        });
+
+        if (chunksCount > 0)
+        {
+            setFinalEvaluationFlags(transform);
+        }
+
+        // the chunks are concatenated in the order of the positions
+        lastPointsCloseToEvaluationPositionsKept = keepPointsCloseToEvaluationPositions;
+        lastPointsCloseToEvaluationPositionsIndicesUpToDate = false;
+        if (keepPointsCloseToEvaluationPositions)
+        {
+            vector<uint32_t>& offsets = lastPointsCloseToEvaluationPositions.offsets;
+            vector<uint16_t>& pointIndices = lastPointsCloseToEvaluationPositions.pointIndices;
+            offsets.assign(1, 0);
+            pointIndices.clear();
+            for (uint32_t chunkIndex = 0; chunkIndex < chunksCount; ++chunkIndex)
+            {
+                const PointIndicesOnVectors& chunkPoints = chunkPointsCloseToEvaluationPositions[chunkIndex];
+                uint32_t pointIndicesOffset = pointIndices.size();
+                pointIndices.insert(pointIndices.end(), chunkPoints.pointIndices.begin(), chunkPoints.pointIndices.end());
+                for (uint32_t i = 1; i < chunkPoints.offsets.size(); ++i)
+                {
+                    offsets.push_back(pointIndicesOffset + chunkPoints.offsets[i]);
+                }
+            }
+        }
+
+        lastTransformCallsCount = 0;
+        lastEvaluatedPositionsCount = 0;
+        for (const chunkWorker_t& worker : chunkWorkers)
+        {
+            lastTransformCallsCount += worker.transformCallsCount;
+            lastEvaluatedPositionsCount += worker.evaluatedPositionsCount;
+        }
+    }
+
+    // the final evaluation uses the flags of the last optimization phase
+    void HillClimbingOptimizer::setFinalEvaluationFlags(InverseSpaceTransform& transform) const
+    {
+        if (hillClimbingAccuracyConstants.localFitIterationCount > 0 || hillClimbingAccuracyConstants.localCalmDownIterationCount > 0)
+        {
+            transform.setLocalTransformFlag();
+            transform.clearRadialWeightingFlag();
+        }
+        else if (hillClimbingAccuracyConstants.initialIterationCount > 0 || hillClimbingAccuracyConstants.calmDownIterationCount > 0)
+        {
+            transform.clearLocalTransformFlag();
+            transform.setRadialWeightingFlag();
+        }
+    }
+
+    void HillClimbingOptimizer::optimizeChunk(chunkWorker_t& worker)
+    {
+        InverseSpaceTransform& transform = worker.transform;
+        Matrix3Xf& positionsToOptimize_local = worker.positionsToOptimize;
 
-        const float gamma_initial = gamma;
-        const float maxStep_initial = maxStep;
-        const float minStep_initial = minStep;
+        worker.stepComputationAccuracyConstants = hillClimbingAccuracyConstants.stepComputationAccuracyConstants;
+        float& gamma = worker.stepComputationAccuracyConstants.gamma;
+        float& maxStep = worker.stepComputationAccuracyConstants.maxStep;
+        float& minStep = worker.stepComputationAccuracyConstants.minStep;
 
         const int initialIterationCount = hillClimbingAccuracyConstants.initialIterationCount;
         const int calmDownIterationCount = hillClimbingAccuracyConstants.calmDownIterationCount;
@@ -61,88 +168,252 @@ namespace xgandalf
         const int localCalmDownIterationCount = hillClimbingAccuracyConstants.localCalmDownIterationCount;
         const float localCalmDownFactor = hillClimbingAccuracyConstants.localCalmDownFactor;
 
-        transform.setPointsToTransform(pointsToTransform);
-        const uint32_t maxPositionsPerIteration = 100; // TODO: find sweet spot. Maybe choose dependent on pointsToTransform.cols()
-        Matrix3Xf positionsToOptimize_local;
-        for (int64_t positionsProcessedCount = 0; positionsProcessedCount < positionsToOptimize.cols(); positionsProcessedCount += maxPositionsPerIteration)
-        {
-            uint32_t remainingPositionsCount = positionsToOptimize.cols() - positionsProcessedCount;
-            uint32_t positionsCount_local = min(maxPositionsPerIteration, remainingPositionsCount);
-            positionsToOptimize_local = positionsToOptimize.block(0, positionsProcessedCount, 3, positionsCount_local);
+        worker.previousStepDirection = Matrix3Xf::Zero(3, positionsToOptimize_local.cols());
+        worker.previousStepLength = Array<float, 1, Eigen::Dynamic>::Constant(1, positionsToOptimize_local.cols(), minStep + (maxStep - minStep) / 4);
 
-            previousStepDirection = Matrix3Xf::Zero(3, positionsToOptimize_local.cols());
-            previousStepLength = Array<float, 1, Eigen::Dynamic>::Constant(1, positionsToOptimize_local.cols(), minStep + (maxStep - minStep) / 4);
+        const bool trackConvergence = hillClimbingAccuracyConstants.convergedIterationCount > 0;
 
-            for (int i = 0; i < initialIterationCount; i++)
+        auto performOptimizationStep = [&](Matrix3Xf& positions, bool useStepOrthogonalization) {
+            transform.performTransform(positions);
+            worker.transformCallsCount++;
+            worker.evaluatedPositionsCount += positions.cols();
+            if (trackConvergence)
             {
-                transform.clearLocalTransformFlag();
-                transform.setRadialWeightingFlag();
-                bool useStepOrthogonalization = true;
+                worker.evaluation = transform.getInverseTransformEvaluation(); // overwritten by computeStep
+            }
+            computeStep(transform.getGradient(), transform.getCloseToPointsCount(), transform.getInverseTransformEvaluation(), useStepOrthogonalization,
+                        worker.stepComputationAccuracyConstants, worker.step, worker.previousStepDirection, worker.previousStepLength);
+            positions += worker.step;
+        };
+
+        for (int i = 0; i < initialIterationCount; i++)
+        {
+            transform.clearLocalTransformFlag();
+            transform.setRadialWeightingFlag();
+            bool useStepOrthogonalization = true;
+
+            performOptimizationStep(positionsToOptimize_local, useStepOrthogonalization);
+            //        ofs << positionsToOptimize.transpose().eval() << endl;
+        }
 
-                performOptimizationStep(positionsToOptimize_local, useStepOrthogonalization);
-                //        ofs << positionsToOptimize.transpose().eval() << endl;
+        for (int i = 0; i < calmDownIterationCount; i++)
+        {
+            transform.clearLocalTransformFlag();
+            transform.setRadialWeightingFlag();
+            bool useStepOrthogonalization = true;
+
+            maxStep = maxStep * calmDownFactor;
+            minStep = minStep * calmDownFactor;
+            gamma = gamma * calmDownFactor;
+
+            performOptimizationStep(positionsToOptimize_local, useStepOrthogonalization);
+            //        ofs << positionsToOptimize.transpose().eval() << endl;
+        }
+
+        // in the local phases converged positions are removed from the working set, so later steps transform fewer positions
+        Matrix3Xf& localPositions = trackConvergence ? worker.activePositions : positionsToOptimize_local;
+        if (trackConvergence)
+        {
+            beginActiveSet(worker);
+        }
+
+        for (int i = 0; i < localFitIterationCount && localPositions.cols() > 0; i++)
+        {
+            transform.setLocalTransformFlag();
+            transform.clearRadialWeightingFlag();
+            bool useStepOrthogonalization = true;
+
+            performOptimizationStep(localPositions, useStepOrthogonalization);
+            if (trackConvergence)
+            {
+                updateActiveSet(worker);
             }
+            //        ofs << positionsToOptimize.transpose().eval() << endl;
+        }
+
+        const bool snapToLeastSquaresSolution = hillClimbingAccuracyConstants.localRefinementMode == LocalRefinementMode::leastSquaresSnap;
+        for (int i = 0; i < localCalmDownIterationCount && localPositions.cols() > 0 && !snapToLeastSquaresSolution; i++)
+        {
+            transform.setLocalTransformFlag();
+            transform.clearRadialWeightingFlag();
+            bool useStepOrthogonalization = false;
+
+            maxStep = maxStep * localCalmDownFactor;
+            minStep = minStep * localCalmDownFactor;
+            gamma = gamma * localCalmDownFactor;
 
-            for (int i = 0; i < calmDownIterationCount; i++)
+            performOptimizationStep(localPositions, useStepOrthogonalization);
+            if (trackConvergence)
             {
-                transform.clearLocalTransformFlag();
-                transform.setRadialWeightingFlag();
-                bool useStepOrthogonalization = true;
+                updateActiveSet(worker);
+            }
+            //        ofs << positionsToOptimize.transpose().eval() << endl;
+        }
+
+        if (trackConvergence)
+        {
+            endActiveSet(worker);
+        }
 
-                maxStep = maxStep * calmDownFactor;
-                minStep = minStep * calmDownFactor;
-                gamma = gamma * calmDownFactor;
+        if (snapToLeastSquaresSolution)
+        {
+            transform.setLocalTransformFlag();
+            transform.clearRadialWeightingFlag();
+            this->snapToLeastSquaresSolution(worker);
+        }
+    }
 
-                performOptimizationStep(positionsToOptimize_local, useStepOrthogonalization);
-                //        ofs << positionsToOptimize.transpose().eval() << endl;
+    // Moves every position s to the weighted least squares solution of p_i * s = n_i, where n_i = round(p_i * s) for the points p_i close to s. The
+    // solution is a 3x3 linear system. Positions with too few or degenerate close points are kept, as well as snaps that lower the evaluation of the
+    // transform (outliers within maxCloseToPointDeviation pull the least squares solution)
+    void HillClimbingOptimizer::snapToLeastSquaresSolution(chunkWorker_t& worker)
+    {
+        InverseSpaceTransform& transform = worker.transform;
+        const Matrix3Xf& points = transform.getPointsToTransform();
+        const RowVectorXf& weights = transform.getPointsToTransformWeights();
+        const float maxCloseToPointDeviation = transform.getMaxCloseToPointDeviation();
+        const int iterationCount = hillClimbingAccuracyConstants.leastSquaresSnapIterationCount;
+        const int notClose = numeric_limits<int>::min();
+
+        vector<int>& roundedProjections = worker.roundedProjections;
+        roundedProjections.assign(points.cols(), notClose);
+
+        // returns the number of close points and whether any rounded projection changed
+        auto assignClosePoints = [&](const Vector3f& position, bool& assignmentChanged) {
+            uint32_t closeCount = 0;
+            assignmentChanged = false;
+            for (int i = 0; i < points.cols(); i++)
+            {
+                const float projection = points.col(i).dot(position);
+                const float roundedProjection = round(projection);
+                const int assignment = abs(projection - roundedProjection) < maxCloseToPointDeviation ? (int)roundedProjection : notClose;
+                assignmentChanged |= assignment != roundedProjections[i];
+                roundedProjections[i] = assignment;
+                closeCount += assignment != notClose;
             }
+            return closeCount;
+        };
 
-            for (int i = 0; i < localFitIterationCount; i++)
+        Matrix3Xf& positions = worker.positionsToOptimize;
+        Matrix3Xf& snappedPositions = worker.snappedPositions;
+        snappedPositions = positions;
+        for (int positionIndex = 0; positionIndex < snappedPositions.cols(); positionIndex++)
+        {
+            bool assignmentChanged;
+            uint32_t closeCount = assignClosePoints(snappedPositions.col(positionIndex), assignmentChanged);
+            for (int iteration = 0; iteration < iterationCount && closeCount >= 3; iteration++)
             {
-                transform.setLocalTransformFlag();
-                transform.clearRadialWeightingFlag();
-                bool useStepOrthogonalization = true;
+                Matrix3d A = Matrix3d::Zero();
+                Vector3d b = Vector3d::Zero();
+                for (int i = 0; i < points.cols(); i++)
+                {
+                    if (roundedProjections[i] != notClose)
+                    {
+                        const Vector3d point = points.col(i).cast<double>();
+                        A.selfadjointView<Lower>().rankUpdate(point, weights[i]);
+                        b += (weights[i] * roundedProjections[i]) * point;
+                    }
+                }
+                A.triangularView<StrictlyUpper>() = A.transpose();
+                if (b.isZero()) // all close points round to 0, the solution would be the zero vector
+                {
+                    break;
+                }
 
-                performOptimizationStep(positionsToOptimize_local, useStepOrthogonalization);
-                //        ofs << positionsToOptimize.transpose().eval() << endl;
+                SelfAdjointEigenSolver<Matrix3d> eigenSolver;
+                eigenSolver.computeDirect(A, EigenvaluesOnly);
+                if (eigenSolver.eigenvalues()[0] <= 1e-6 * eigenSolver.eigenvalues()[2]) // close points (nearly) in a plane
+                {
+                    break;
+                }
+
+                snappedPositions.col(positionIndex) = A.ldlt().solve(b).cast<float>();
+                closeCount = assignClosePoints(snappedPositions.col(positionIndex), assignmentChanged);
+                if (!assignmentChanged)
+                {
+                    break;
+                }
             }
+        }
 
-            for (int i = 0; i < localCalmDownIterationCount; i++)
+        transform.performEvaluation(positions);
+        worker.evaluation = transform.getInverseTransformEvaluation();
+        transform.performEvaluation(snappedPositions);
+        const RowVectorXf& snappedEvaluation = transform.getInverseTransformEvaluation();
+        worker.transformCallsCount += 2;
+        worker.evaluatedPositionsCount += 2 * positions.cols();
+
+        for (int positionIndex = 0; positionIndex < positions.cols(); positionIndex++)
+        {
+            if (snappedEvaluation[positionIndex] > worker.evaluation[positionIndex])
             {
-                transform.setLocalTransformFlag();
-                transform.clearRadialWeightingFlag();
-                bool useStepOrthogonalization = false;
+                positions.col(positionIndex) = snappedPositions.col(positionIndex);
+            }
+        }
+    }
 
-                maxStep = maxStep * localCalmDownFactor;
-                minStep = minStep * localCalmDownFactor;
-                gamma = gamma * localCalmDownFactor;
+    void HillClimbingOptimizer::beginActiveSet(chunkWorker_t& worker)
+    {
+        const uint32_t positionsCount = worker.positionsToOptimize.cols();
 
-                performOptimizationStep(positionsToOptimize_local, useStepOrthogonalization);
-                //        ofs << positionsToOptimize.transpose().eval() << endl;
-            }
+        worker.activePositions = worker.positionsToOptimize;
+        worker.activeColumns.resize(positionsCount);
+        iota(worker.activeColumns.begin(), worker.activeColumns.end(), 0);
+        worker.convergedIterationCounts.assign(positionsCount, 0);
+        worker.previousEvaluation.setConstant(positionsCount, numeric_limits<float>::infinity());
+    }
+
+    // Writes converged positions back to positionsToOptimize and compacts the remaining ones, keeping their order. The step state (previous step
+    // direction and length) is compacted the same way
+    void HillClimbingOptimizer::updateActiveSet(chunkWorker_t& worker)
+    {
+        const int convergedIterationCount = hillClimbingAccuracyConstants.convergedIterationCount;
+        const float convergedStepLength = hillClimbingAccuracyConstants.convergedStepLength;
+        const float convergedEvaluationChange = hillClimbingAccuracyConstants.convergedEvaluationChange;
+
+        const uint32_t activeCount = worker.activePositions.cols();
+        uint32_t keptCount = 0;
+        for (uint32_t i = 0; i < activeCount; i++)
+        {
+            const bool stalled = worker.previousStepLength[i] < convergedStepLength ||
+                                 abs(worker.evaluation[i] - worker.previousEvaluation[i]) < convergedEvaluationChange;
+            worker.convergedIterationCounts[i] = stalled ? worker.convergedIterationCounts[i] + 1 : 0;
 
-            positionsToOptimize.block(0, positionsProcessedCount, 3, positionsCount_local) = positionsToOptimize_local;
+            if (worker.convergedIterationCounts[i] >= convergedIterationCount)
+            {
+                worker.positionsToOptimize.col(worker.activeColumns[i]) = worker.activePositions.col(i);
+                continue;
+            }
 
-            gamma = gamma_initial;
-            maxStep = maxStep_initial;
-            minStep = minStep_initial;
+            if (keptCount != i)
+            {
+                worker.activePositions.col(keptCount) = worker.activePositions.col(i);
+                worker.previousStepDirection.col(keptCount) = worker.previousStepDirection.col(i);
+                worker.previousStepLength[keptCount] = worker.previousStepLength[i];
+                worker.activeColumns[keptCount] = worker.activeColumns[i];
+                worker.convergedIterationCounts[keptCount] = worker.convergedIterationCounts[i];
+            }
+            worker.previousEvaluation[keptCount] = worker.evaluation[i];
+            keptCount++;
         }
 
-        // can be optimized! Does not always need to compute slope, closeToPoints and gradient
-        transform.performTransform(positionsToOptimize);
-        lastInverseTransformEvaluation = transform.getInverseTransformEvaluation();
+        if (keptCount < activeCount)
+        {
+            worker.activePositions.conservativeResize(NoChange, keptCount);
+            worker.previousStepDirection.conservativeResize(NoChange, keptCount);
+            worker.previousStepLength.conservativeResize(keptCount);
+            worker.activeColumns.resize(keptCount);
+            worker.convergedIterationCounts.resize(keptCount);
+            worker.previousEvaluation.conservativeResize(keptCount);
+        }
     }
 
-    void HillClimbingOptimizer::performOptimizationStep(Matrix3Xf& positionsToOptimize, bool useStepOrthogonalization)
+    void HillClimbingOptimizer::endActiveSet(chunkWorker_t& worker)
     {
-        transform.performTransform(positionsToOptimize);
-        Matrix3Xf& gradient = transform.getGradient();
-        RowVectorXf& closeToPointsCount = transform.getCloseToPointsCount();
-        RowVectorXf& inverseTransformEvaluation = transform.getInverseTransformEvaluation();
-        computeStep(gradient, closeToPointsCount, inverseTransformEvaluation, useStepOrthogonalization);
-        //    cout << "step: " << endl << step << endl << endl;
-        positionsToOptimize += step;
-        //    cout << "positionsToOptimize: " << endl << positionsToOptimize << endl << endl;
+        for (uint32_t i = 0; i < worker.activeColumns.size(); i++)
+        {
+            worker.positionsToOptimize.col(worker.activeColumns[i]) = worker.activePositions.col(i);
+        }
     }
 
     void HillClimbingOptimizer::setPointsToTransformWeights(const RowVectorXf& pointsToTransformWeights)
@@ -157,16 +428,53 @@ namespace xgandalf
 
     RowVectorXf& HillClimbingOptimizer::getCloseToPointsCount()
     {
-        return transform.getCloseToPointsCount();
+        return lastCloseToPointsCount;
+    }
+
+    PointIndicesOnVectors& HillClimbingOptimizer::getPointsCloseToEvaluationPositions()
+    {
+        if (!lastPointsCloseToEvaluationPositionsKept)
+        {
+            stringstream errStream;
+            errStream << "Points close to the evaluation positions not kept, call setKeepPointsCloseToEvaluationPositions(true) before performOptimization().";
+            throw WrongUsageException(errStream.str());
+        }
+        return lastPointsCloseToEvaluationPositions;
     }
 
     vector<vector<uint16_t>>& HillClimbingOptimizer::getPointsCloseToEvaluationPositions_indices()
     {
-        return transform.getPointsCloseToEvaluationPositions_indices();
+        if (!lastPointsCloseToEvaluationPositionsIndicesUpToDate)
+        {
+            getPointsCloseToEvaluationPositions().toVectors(lastPointsCloseToEvaluationPositions_indices);
+            lastPointsCloseToEvaluationPositionsIndicesUpToDate = true;
+        }
+        return lastPointsCloseToEvaluationPositions_indices;
+    }
+
+    uint64_t HillClimbingOptimizer::getLastTransformCallsCount() const
+    {
+        return lastTransformCallsCount;
+    }
+
+    uint64_t HillClimbingOptimizer::getLastEvaluatedPositionsCount() const
+    {
+        return lastEvaluatedPositionsCount;
+    }
+
+    void HillClimbingOptimizer::setKeepPointsCloseToEvaluationPositions(bool flag)
+    {
+        keepPointsCloseToEvaluationPositions = flag;
+    }
+
+    void HillClimbingOptimizer::setThreadCount(uint32_t threadCount)
+    {
+        workerPool.setThreadCount(threadCount);
     }
 
     void HillClimbingOptimizer::computeStep(Matrix3Xf& gradient, RowVectorXf& closeToPointsCount, RowVectorXf& inverseTransformEvaluation,
-                                            bool useStepOrthogonalization)
+                                            bool useStepOrthogonalization, const stepComputationAccuracyConstants_t& stepComputationAccuracyConstants,
+                                            Matrix3Xf& step, Matrix3Xf& previousStepDirection, Array<float, 1, Dynamic>& previousStepLength)
     {
         // reuse memory for processing for performance reasons
         Matrix3Xf& stepDirection = gradient;
@@ -192,7 +500,7 @@ namespace xgandalf
                 if (directionChange(i) < -0.4)
                 {
                     stepDirection.col(i) = (stepDirection.col(i) + previousStepDirection.col(i)).normalized();
-                    stepDirectionFactor(i) = hillClimbingAccuracyConstants.stepComputationAccuracyConstants.directionChangeFactor;
+                    stepDirectionFactor(i) = stepComputationAccuracyConstants.directionChangeFactor;
                 }
             }
         }
@@ -200,9 +508,9 @@ namespace xgandalf
 
         previousStepDirection = stepDirection;
 
-        const float minStep = hillClimbingAccuracyConstants.stepComputationAccuracyConstants.minStep;
-        const float maxStep = hillClimbingAccuracyConstants.stepComputationAccuracyConstants.maxStep;
-        const float gamma = hillClimbingAccuracyConstants.stepComputationAccuracyConstants.gamma;
+        const float minStep = stepComputationAccuracyConstants.minStep;
+        const float maxStep = stepComputationAccuracyConstants.maxStep;
+        const float gamma = stepComputationAccuracyConstants.gamma;
 
         Array<float, 1, Eigen::Dynamic>& stepLength = previousStepLength; // reuse memory
         stepLength = ((0.5 * (minStep + (maxStep - minStep) * gamma) + 0.5 * previousStepLength) * stepDirectionFactor * closeToPointsFactor.array() *
@@ -93,23 +93,28 @@ namespace xgandalf
             // float tolerance = max(unitPitch, experimentSettings.getTolerance());
             float tolerance = experimentSettings.getTolerance();
 
-            samplePointsGenerator.getTightGrid(precomputedSamplePoints, unitPitch, tolerance, experimentSettings.getDifferentRealLatticeVectorLengths_A());
+            precomputedSamplePoints = samplePointsGenerator.getTightGrid(unitPitch, tolerance, experimentSettings.getDifferentRealLatticeVectorLengths_A());
         }
         else
         {
             float minRadius = experimentSettings.getMinRealLatticeVectorLength_A() * 0.98;
             float maxRadius = experimentSettings.getMaxRealLatticeVectorLength_A() * 1.02;
 
-            samplePointsGenerator.getDenseGrid(precomputedSamplePoints, unitPitch, minRadius, maxRadius);
+            precomputedSamplePoints = samplePointsGenerator.getDenseGrid(unitPitch, minRadius, maxRadius);
         }
     }
 
+    void IndexerAutocorrPrefit::setAutocorrelationThreadCount(uint32_t threadCount)
+    {
+        autocorrelationWorkerPool.setThreadCount(threadCount);
+    }
+
     void IndexerAutocorrPrefit::getGoodAutocorrelationPoints(Matrix3Xf& goodAutocorrelationPoints, RowVectorXf& goodAutocorrelationPointWeights,
                                                              const Matrix3Xf& points, uint32_t maxAutocorrelationPointsCount)
     {
         Matrix3Xf autocorrelationPoints;
 
-        getPointAutocorrelation(autocorrelationPoints, points, minNormInAutocorrelation, maxNormInAutocorrelation);
+        getPointAutocorrelation(autocorrelationPoints, points, minNormInAutocorrelation, maxNormInAutocorrelation, autocorrelationWorkerPool);
 
         vector<Dbscan::cluster_t> clusters;
         uint16_t minPoints = 2;
@@ -211,7 +216,7 @@ namespace xgandalf
         inverseSpaceTransform.setOptionalFunctionArgument(4);
         inverseSpaceTransform.clearLocalTransformFlag();
         inverseSpaceTransform.clearRadialWeightingFlag();
-        inverseSpaceTransform.performTransform(samplePoints);
+        inverseSpaceTransform.performEvaluation(samplePoints);
 
         Matrix3Xf samplePointsPeaks_autocorr98 = samplePoints;
         RowVectorXf samplePointsPeaksEvaluation_autocorr98 = inverseSpaceTransform.getInverseTransformEvaluation();
@@ -225,7 +230,7 @@ namespace xgandalf
         inverseSpaceTransform.setOptionalFunctionArgument(4);
         inverseSpaceTransform.clearLocalTransformFlag();
         inverseSpaceTransform.clearRadialWeightingFlag();
-        inverseSpaceTransform.performTransform(samplePoints);
+        inverseSpaceTransform.performEvaluation(samplePoints);
 
         Matrix3Xf samplePointsPeaks_standard98 = samplePoints;
         RowVectorXf samplePointsPeaksEvaluation_standard98 = inverseSpaceTransform.getInverseTransformEvaluation();
@@ -246,12 +251,12 @@ namespace xgandalf
 
     void IndexerAutocorrPrefit::index(std::vector<Lattice>& assembledLattices, const Eigen::Matrix3Xf& reciprocalPeaks_1_per_A)
     {
-        if (precomputedSamplePoints.size() == 0)
+        if (!precomputedSamplePoints || precomputedSamplePoints->size() == 0)
         {
             precompute();
         }
 
-        Matrix3Xf samplePoints = precomputedSamplePoints;
+        Matrix3Xf samplePoints = *precomputedSamplePoints;
 
         //////// autocorr prefit
         HillClimbingOptimizer::hillClimbingAccuracyConstants_t hillClimbing_accuracyConstants_autocorr;
@@ -342,7 +347,7 @@ namespace xgandalf
         inverseSpaceTransform.setOptionalFunctionArgument(4);
         inverseSpaceTransform.setLocalTransformFlag();
         inverseSpaceTransform.clearRadialWeightingFlag();
-        inverseSpaceTransform.performTransform(samplePoints);
+        inverseSpaceTransform.performEvaluation(samplePoints, true);
 
         LatticeAssembler::accuracyConstants_t accuracyConstants_LatticeAssembler;
         accuracyConstants_LatticeAssembler.maxCountGlobalPassingWeightFilter = 500;
@@ -361,7 +366,7 @@ namespace xgandalf
         vector<LatticeAssembler::assembledLatticeStatistics_t> assembledLatticesStatistics;
         Matrix3Xf& candidateVectors = samplePoints;
         RowVectorXf& candidateVectorWeights = inverseSpaceTransform.getInverseTransformEvaluation();
-        vector<vector<uint16_t>>& pointIndicesOnVector = inverseSpaceTransform.getPointsCloseToEvaluationPositions_indices();
+        const PointIndicesOnVectors& pointIndicesOnVector = inverseSpaceTransform.getPointsCloseToEvaluationPositions();
         Matrix3Xf reciprocalPeaksCopy_1_per_A = reciprocalPeaks_1_per_A;
         latticeAssembler.assembleLattices(assembledLattices, assembledLatticesStatistics, candidateVectors, candidateVectorWeights, pointIndicesOnVector,
                                           reciprocalPeaksCopy_1_per_A);
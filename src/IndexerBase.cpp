@@ -26,6 +26,7 @@
  */
 
 #include <IndexerBase.h>
+#include <samplePointsFiltering.h>
 #include <algorithm>
 #include <cstdint>
 #include <iterator>
@@ -60,25 +61,6 @@ namespace xgandalf
 
     void IndexerBase::keepSamplePointsWithHighestEvaluation(Eigen::Matrix3Xf& samplePoints, RowVectorXf& samplePointsEvaluation, uint32_t maxToTakeCount)
     {
-        uint32_t toTakeCount = min(maxToTakeCount, (uint32_t)samplePointsEvaluation.size());
-
-        sortIndices.resize(samplePointsEvaluation.size());
-        iota(sortIndices.begin(), sortIndices.end(), 0);
-        nth_element(sortIndices.begin(), sortIndices.begin() + toTakeCount, sortIndices.end(),
-                    [&](uint32_t i, uint32_t j) { return samplePointsEvaluation[i] > samplePointsEvaluation[j]; });
-
-        sortIndices.resize(toTakeCount);
-        sort(sortIndices.begin(), sortIndices.end(), [&](uint32_t i, uint32_t j) { return samplePointsEvaluation[i] > samplePointsEvaluation[j]; });
-
-        Matrix3Xf samplePoints_filtered(3, toTakeCount);
-        RowVectorXf samplePointsEvaluation_filtered(toTakeCount);
-        for (uint32_t i = 0; i < toTakeCount; ++i)
-        {
-            samplePoints_filtered.col(i) = samplePoints.col(sortIndices[i]);
-            samplePointsEvaluation_filtered[i] = samplePointsEvaluation[sortIndices[i]];
-        }
-
-        samplePoints.swap(samplePoints_filtered);
-        samplePointsEvaluation.swap(samplePointsEvaluation_filtered);
+        xgandalf::keepSamplePointsWithHighestEvaluation(samplePoints, samplePointsEvaluation, maxToTakeCount, sortIndices);
     }
 } // namespace xgandalf
\ No newline at end of file
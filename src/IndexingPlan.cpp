@@ -0,0 +1,714 @@
+/*
+ * IndexingPlan.cpp
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <IndexingPlan.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <samplePointsFiltering.h>
+#include <sstream>
+#include <vector>
+
+using namespace Eigen;
+using namespace std;
+
+namespace xgandalf
+{
+    static atomic<uint64_t> nextConfigurationId(1);
+
+    // returns the seconds since stageStart and restarts it
+    static double getSecondsSince(chrono::steady_clock::time_point& stageStart)
+    {
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        double seconds = chrono::duration<double>(now - stageStart).count();
+        stageStart = now;
+        return seconds;
+    }
+
+    IndexingPlan::IndexingPlan(const ExperimentSettings& experimentSettings)
+        : experimentSettings(experimentSettings)
+        , configurationId(0)
+    {
+        precompute();
+    }
+
+    void IndexingPlan::precompute()
+    {
+        maxCloseToPointDeviation = 0.15;
+        maxPeaksToUseForIndexing = 250;
+        peaksRefinementMode = PeaksRefinementMode::hillClimbing;
+        samplingStrategy = SamplingStrategy::uniform;
+        coarsePitchFactor = 2;
+        keptCoarsePointsFraction = 0.25;
+
+        setSamplingPitch(SamplingPitch::standard);
+        setGradientDescentIterationsCount(GradientDescentIterationsCount::standard);
+
+        float minSpacingBetweenPeaks = experimentSettings.getDifferentRealLatticeVectorLengths_A().minCoeff() * 0.2;
+        float maxPossiblePointNorm = experimentSettings.getDifferentRealLatticeVectorLengths_A().maxCoeff() * 1.2;
+
+        sparsePeakFinder.precompute(minSpacingBetweenPeaks, maxPossiblePointNorm);
+
+        inverseSpaceTransform = InverseSpaceTransform(maxCloseToPointDeviation);
+        inverseSpaceTransform.setFunctionSelection(9);
+        inverseSpaceTransform.setOptionalFunctionArgument(8);
+        inverseSpaceTransform.setLocalTransformFlag();
+        inverseSpaceTransform.clearRadialWeightingFlag();
+
+        // same objective as the global hill climbing
+        coarseSamplingTransform = InverseSpaceTransform(maxCloseToPointDeviation);
+        coarseSamplingTransform.setFunctionSelection(1);
+        coarseSamplingTransform.setOptionalFunctionArgument(1);
+        coarseSamplingTransform.clearLocalTransformFlag();
+        coarseSamplingTransform.setRadialWeightingFlag();
+
+        accuracyConstants_LatticeAssembler.maxCountGlobalPassingWeightFilter = 500;
+        accuracyConstants_LatticeAssembler.maxCountLocalPassingWeightFilter = 15;
+        accuracyConstants_LatticeAssembler.maxCountPassingRelativeDefectFilter = 50;
+        accuracyConstants_LatticeAssembler.minPointsOnLattice = 5;
+        accuracyConstants_LatticeAssembler.maxCloseToPointDeviation = maxCloseToPointDeviation;
+        accuracyConstants_LatticeAssembler.refineWithExactLattice = false;
+        latticeAssembler.setAccuracyConstants(accuracyConstants_LatticeAssembler);
+
+        if (experimentSettings.isLatticeParametersKnown())
+        {
+            //    latticeAssembler.setDeterminantRange(experimentSettings.getMinRealLatticeDeterminant_A3(),
+            //    experimentSettings.getMaxRealLatticeDeterminant_A3());
+            latticeAssembler.setDeterminantRange(experimentSettings.getRealLatticeDeterminant_A3() * 0.8,
+                                                 experimentSettings.getRealLatticeDeterminant_A3() * 1.2); // debug
+            latticeAssembler.setKnownLatticeParameters(experimentSettings.getSampleRealLattice_A(), experimentSettings.getTolerance());
+        }
+        else
+        {
+            latticeAssembler.setDeterminantRange(experimentSettings.getMinRealLatticeDeterminant_A3(), experimentSettings.getMaxRealLatticeDeterminant_A3());
+        }
+
+        configurationChanged();
+    }
+
+    void IndexingPlan::setSamplingPitch(SamplingPitch samplingPitch)
+    {
+        float unitPitch = 0;
+        bool coverSecondaryMillerIndices = false;
+
+        switch (samplingPitch)
+        {
+            case SamplingPitch::extremelyLoose:
+                unitPitch = 0.10;
+                break;
+            case SamplingPitch::loose:
+                unitPitch = 0.075;
+                break;
+            case SamplingPitch::standard:
+                unitPitch = 0.05;
+                break;
+            case SamplingPitch::dense:
+                unitPitch = 0.025;
+                break;
+            case SamplingPitch::extremelyDense:
+                unitPitch = 0.01;
+                break;
+
+            case SamplingPitch::standardWithSeondaryMillerIndices:
+                unitPitch = 0.05;
+                coverSecondaryMillerIndices = true;
+                break;
+            case SamplingPitch::denseWithSeondaryMillerIndices:
+                unitPitch = 0.025;
+                coverSecondaryMillerIndices = true;
+                break;
+            case SamplingPitch::extremelyDenseWithSeondaryMillerIndices:
+                unitPitch = 0.01;
+                coverSecondaryMillerIndices = true;
+                break;
+        }
+
+        setSamplingPitch(unitPitch, coverSecondaryMillerIndices);
+    }
+
+    void IndexingPlan::setSamplingPitch(float unitPitch, bool coverSecondaryMillerIndices)
+    {
+        samplingUnitPitch = unitPitch;
+        samplingCoversSecondaryMillerIndices = coverSecondaryMillerIndices;
+
+        precomputedSamplePoints = getSamplePoints(unitPitch, coverSecondaryMillerIndices);
+        precomputeCoarseSamplePoints();
+
+        configurationChanged();
+    }
+
+    shared_ptr<const Matrix3Xf> IndexingPlan::getSamplePoints(float unitPitch, bool coverSecondaryMillerIndices)
+    {
+        if (experimentSettings.isLatticeParametersKnown())
+        {
+            // float tolerance = max(unitPitch, experimentSettings.getTolerance());
+            float tolerance = experimentSettings.getTolerance();
+
+            if (!coverSecondaryMillerIndices)
+            {
+                return samplePointsGenerator.getTightGrid(unitPitch, tolerance, experimentSettings.getDifferentRealLatticeVectorLengths_A());
+            }
+            else
+            {
+                const Matrix3f& sampleRealBasis = experimentSettings.getSampleRealLattice_A().getBasis();
+
+                vector<float> radii(6);
+                radii[0] = sampleRealBasis.col(0).norm();
+                radii[1] = sampleRealBasis.col(1).norm();
+                radii[2] = sampleRealBasis.col(2).norm();
+                radii[3] = (sampleRealBasis.col(0) + sampleRealBasis.col(1)).norm();
+                radii[4] = (sampleRealBasis.col(1) + sampleRealBasis.col(2)).norm();
+                radii[5] = (sampleRealBasis.col(2) + sampleRealBasis.col(0)).norm();
+
+                sort(radii.begin(), radii.end());
+                auto it = std::unique(radii.begin(), radii.end());
+                radii.resize(std::distance(radii.begin(), it));
+
+                ArrayXf radii_array = Eigen::Map<ArrayXf>(radii.data(), radii.size(), 1);
+
+                return samplePointsGenerator.getTightGrid(unitPitch, tolerance, radii_array);
+            }
+        }
+        else
+        {
+            if (!coverSecondaryMillerIndices)
+            {
+                float minRadius = experimentSettings.getMinRealLatticeVectorLength_A() * 0.98;
+                float maxRadius = experimentSettings.getMaxRealLatticeVectorLength_A() * 1.02;
+
+                return samplePointsGenerator.getDenseGrid(unitPitch, minRadius, maxRadius);
+            }
+            else
+            {
+                float minRadius = experimentSettings.getMinRealLatticeVectorLength_A() * 0.98;
+                float maxRadius = 2 * experimentSettings.getMaxRealLatticeVectorLength_A() * 1.02;
+
+                return samplePointsGenerator.getDenseGrid(unitPitch, minRadius, maxRadius);
+            }
+        }
+    }
+
+    void IndexingPlan::precomputeCoarseSamplePoints()
+    {
+        coarseSamplePoints.reset();
+        closestCoarseSamplePointIndices.clear();
+        if (samplingStrategy != SamplingStrategy::coarseToFine)
+        {
+            return;
+        }
+
+        float coarseUnitPitch = samplingUnitPitch * coarsePitchFactor;
+        shared_ptr<const Matrix3Xf> samplePoints = getSamplePoints(coarseUnitPitch, samplingCoversSecondaryMillerIndices);
+        if (samplePoints->cols() < minCoarseSamplePointsCount)
+        {
+            return; // too coarse to select from, all sample points are used
+        }
+        coarseSamplePoints = samplePoints;
+
+        // neighboring coarse sample points are about coarseUnitPitch * maxNorm apart
+        float maxNorm = coarseSamplePoints->colwise().norm().maxCoeff();
+        assignSamplePointsToClosestCoarseSamplePoints(closestCoarseSamplePointIndices, *precomputedSamplePoints, *coarseSamplePoints,
+                                                      coarseUnitPitch * maxNorm);
+    }
+
+    void IndexingPlan::setShellSamplePointsSource(ShellSamplePointsSource shellSamplePointsSource)
+    {
+        samplePointsGenerator.setShellSamplePointsSource(shellSamplePointsSource);
+
+        setSamplingPitch(samplingUnitPitch, samplingCoversSecondaryMillerIndices);
+    }
+
+    void IndexingPlan::setSamplingStrategy(SamplingStrategy samplingStrategy)
+    {
+        SamplingStrategy previousSamplingStrategy = this->samplingStrategy;
+        this->samplingStrategy = samplingStrategy;
+        precomputeCoarseSamplePoints();
+
+        if (samplingStrategy == SamplingStrategy::coarseToFine && !coarseSamplePoints)
+        {
+            this->samplingStrategy = previousSamplingStrategy;
+            precomputeCoarseSamplePoints();
+
+            std::stringstream errStream;
+            errStream << "The coarse pitch factor " << coarsePitchFactor << " leaves fewer than " << minCoarseSamplePointsCount
+                      << " coarse sample points for the current sampling pitch" << endl;
+            throw BadInputException(errStream.str());
+        }
+
+        configurationChanged();
+    }
+
+    void IndexingPlan::setCoarseToFineParameters(float coarsePitchFactor, float keptCoarsePointsFraction)
+    {
+        if (coarsePitchFactor <= 1 || keptCoarsePointsFraction <= 0 || keptCoarsePointsFraction > 1)
+        {
+            std::stringstream errStream;
+            errStream << "The coarse pitch factor must be greater than 1 and the kept coarse points fraction must be in (0, 1]" << endl;
+            throw BadInputException(errStream.str());
+        }
+
+        float previousCoarsePitchFactor = this->coarsePitchFactor;
+        float previousKeptCoarsePointsFraction = this->keptCoarsePointsFraction;
+        this->coarsePitchFactor = coarsePitchFactor;
+        this->keptCoarsePointsFraction = keptCoarsePointsFraction;
+        precomputeCoarseSamplePoints();
+
+        if (samplingStrategy == SamplingStrategy::coarseToFine && !coarseSamplePoints)
+        {
+            this->coarsePitchFactor = previousCoarsePitchFactor;
+            this->keptCoarsePointsFraction = previousKeptCoarsePointsFraction;
+            precomputeCoarseSamplePoints();
+
+            std::stringstream errStream;
+            errStream << "The coarse pitch factor " << coarsePitchFactor << " leaves fewer than " << minCoarseSamplePointsCount
+                      << " coarse sample points for the current sampling pitch" << endl;
+            throw BadInputException(errStream.str());
+        }
+
+        configurationChanged();
+    }
+
+    void IndexingPlan::setRefineWithExactLattice(bool flag)
+    {
+        LatticeAssembler::accuracyConstants_t accuracyConstants = latticeAssembler.getAccuracyConstants();
+
+        accuracyConstants.refineWithExactLattice = flag;
+
+        latticeAssembler.setAccuracyConstants(accuracyConstants);
+
+        configurationChanged();
+    }
+
+    void IndexingPlan::setMaxPeaksToUseForIndexing(int maxPeaksToUseForIndexing)
+    {
+        this->maxPeaksToUseForIndexing = maxPeaksToUseForIndexing;
+
+        configurationChanged();
+    }
+
+    void IndexingPlan::setPeaksRefinementMode(PeaksRefinementMode peaksRefinementMode)
+    {
+        this->peaksRefinementMode = peaksRefinementMode;
+        hillClimbing_accuracyConstants_peaks.localRefinementMode = peaksRefinementMode;
+
+        configurationChanged();
+    }
+
+    const ExperimentSettings& IndexingPlan::getExperimentSettings() const
+    {
+        return experimentSettings;
+    }
+
+    const Eigen::Matrix3Xf& IndexingPlan::getPrecomputedSamplePoints() const
+    {
+        return *precomputedSamplePoints;
+    }
+
+    void IndexingPlan::configurationChanged()
+    {
+        configurationId = nextConfigurationId++;
+    }
+
+    void IndexingPlan::prepareWorkspace(IndexingWorkspace& workspace) const
+    {
+        if (workspace.configurationId == configurationId)
+        {
+            return;
+        }
+
+        workspace.sparsePeakFinder = sparsePeakFinder;
+        workspace.inverseSpaceTransform = inverseSpaceTransform;
+        workspace.coarseSamplingTransform = coarseSamplingTransform;
+        workspace.latticeAssembler = latticeAssembler;
+        workspace.latticeAssembler.setThreadCount(workspace.latticeAssemblyThreadCount);
+
+        workspace.configurationId = configurationId;
+    }
+
+    void IndexingPlan::index(IndexingWorkspace& workspace, std::vector<Lattice>& assembledLattices, const Eigen::Matrix3Xf& reciprocalPeaks_1_per_A,
+                             std::vector<int>& peakCountOnLattices) const
+    {
+        indexingStatistics_t indexingStatistics;
+        index(workspace, assembledLattices, reciprocalPeaks_1_per_A, peakCountOnLattices, indexingStatistics);
+    }
+
+    void IndexingPlan::index(IndexingWorkspace& workspace, std::vector<Lattice>& assembledLattices, const Eigen::Matrix3Xf& reciprocalPeaks_1_per_A,
+                             std::vector<int>& peakCountOnLattices, indexingStatistics_t& indexingStatistics) const
+    {
+        const chrono::steady_clock::time_point indexingStart = chrono::steady_clock::now();
+        chrono::steady_clock::time_point stageStart = indexingStart;
+        indexingStatistics = indexingStatistics_t();
+
+        prepareWorkspace(workspace);
+
+        HillClimbingOptimizer& hillClimbingOptimizer = workspace.hillClimbingOptimizer;
+        SparsePeakFinder& sparsePeakFinder = workspace.sparsePeakFinder;
+        InverseSpaceTransform& inverseSpaceTransform = workspace.inverseSpaceTransform;
+        LatticeAssembler& latticeAssembler = workspace.latticeAssembler;
+
+        Matrix3Xf reciprocalPeaksReduced_1_per_A = reciprocalPeaks_1_per_A;
+        reducePeakCount(reciprocalPeaksReduced_1_per_A);
+        indexingStatistics.reciprocalPeaksCount = reciprocalPeaks_1_per_A.cols();
+        indexingStatistics.usedReciprocalPeaksCount = reciprocalPeaksReduced_1_per_A.cols();
+
+        Matrix3Xf samplePoints;
+        if (samplingStrategy == SamplingStrategy::coarseToFine && coarseSamplePoints)
+        {
+            indexingStatistics.transformCallsCount += selectSamplePoints(workspace, samplePoints, reciprocalPeaksReduced_1_per_A);
+            indexingStatistics.evaluatedSamplePointsCount += coarseSamplePoints->cols();
+            indexingStatistics.coarseSamplingTime_s = getSecondsSince(stageStart);
+        }
+        else
+        {
+            samplePoints = *precomputedSamplePoints;
+        }
+        indexingStatistics.hillClimbingSamplePointsCount = samplePoints.cols();
+
+        // global hill climbing
+        hillClimbingOptimizer.setHillClimbingAccuracyConstants(hillClimbing_accuracyConstants_global);
+        hillClimbingOptimizer.performOptimization(reciprocalPeaksReduced_1_per_A, samplePoints);
+        RowVectorXf globalHillClimbingPointEvaluation = hillClimbingOptimizer.getLastInverseTransformEvaluation();
+        Matrix3Xf globalHillClimbingSamplePoints = samplePoints;
+        indexingStatistics.transformCallsCount += hillClimbingOptimizer.getLastTransformCallsCount();
+        indexingStatistics.evaluatedSamplePointsCount += hillClimbingOptimizer.getLastEvaluatedPositionsCount();
+        indexingStatistics.globalHillClimbingTime_s = getSecondsSince(stageStart);
+
+        // additional global hill climbing
+        hillClimbingOptimizer.setHillClimbingAccuracyConstants(hillClimbing_accuracyConstants_additionalGlobal);
+        hillClimbingOptimizer.performOptimization(reciprocalPeaksReduced_1_per_A, samplePoints);
+        RowVectorXf& additionalGlobalHillClimbingPointEvaluation = hillClimbingOptimizer.getLastInverseTransformEvaluation();
+        Matrix3Xf& additionalGlobalHillClimbingSamplePoints = samplePoints;
+        indexingStatistics.transformCallsCount += hillClimbingOptimizer.getLastTransformCallsCount();
+        indexingStatistics.evaluatedSamplePointsCount += hillClimbingOptimizer.getLastEvaluatedPositionsCount();
+        indexingStatistics.additionalGlobalHillClimbingTime_s = getSecondsSince(stageStart);
+
+        // find peaks
+        uint32_t maxGlobalPeaksToTakeCount = 50;
+        sparsePeakFinder.findPeaks_fast(globalHillClimbingSamplePoints, globalHillClimbingPointEvaluation);
+        indexingStatistics.foundPeaksCount += globalHillClimbingSamplePoints.cols();
+        keepSamplePointsWithHighestEvaluation(globalHillClimbingSamplePoints, globalHillClimbingPointEvaluation, maxGlobalPeaksToTakeCount,
+                                              workspace.sortIndices);
+
+        uint32_t maxAdditionalGlobalPeaksToTakeCount = 50;
+        sparsePeakFinder.findPeaks_fast(additionalGlobalHillClimbingSamplePoints, additionalGlobalHillClimbingPointEvaluation);
+        indexingStatistics.foundPeaksCount += additionalGlobalHillClimbingSamplePoints.cols();
+        keepSamplePointsWithHighestEvaluation(additionalGlobalHillClimbingSamplePoints, additionalGlobalHillClimbingPointEvaluation,
+                                              maxAdditionalGlobalPeaksToTakeCount, workspace.sortIndices);
+
+        Matrix3Xf peakSamplePoints(3, globalHillClimbingSamplePoints.cols() + additionalGlobalHillClimbingSamplePoints.cols());
+        peakSamplePoints << globalHillClimbingSamplePoints, additionalGlobalHillClimbingSamplePoints;
+        indexingStatistics.keptPeaksCount = peakSamplePoints.cols();
+        indexingStatistics.peakFindingTime_s = getSecondsSince(stageStart);
+
+        // peaks hill climbing
+        hillClimbingOptimizer.setHillClimbingAccuracyConstants(hillClimbing_accuracyConstants_peaks);
+        hillClimbingOptimizer.performOptimization(reciprocalPeaksReduced_1_per_A, peakSamplePoints);
+        indexingStatistics.transformCallsCount += hillClimbingOptimizer.getLastTransformCallsCount();
+        indexingStatistics.evaluatedSamplePointsCount += hillClimbingOptimizer.getLastEvaluatedPositionsCount();
+
+        // final peaks extra evaluation
+        inverseSpaceTransform.setPointsToTransform(reciprocalPeaks_1_per_A);
+        inverseSpaceTransform.performEvaluation(peakSamplePoints, true);
+        indexingStatistics.transformCallsCount++;
+        indexingStatistics.evaluatedSamplePointsCount += peakSamplePoints.cols();
+        indexingStatistics.peaksHillClimbingTime_s = getSecondsSince(stageStart);
+
+        // find peaks , TODO: check, whether better performance without peak finding here
+        // sparsePeakFinder.findPeaks_fast(peakSamplePoints, inverseSpaceTransform.getInverseTransformEvaluation());
+
+        // assemble lattices
+        vector<LatticeAssembler::assembledLatticeStatistics_t> assembledLatticesStatistics;
+        Matrix3Xf& candidateVectors = peakSamplePoints;
+        RowVectorXf& candidateVectorWeights = inverseSpaceTransform.getInverseTransformEvaluation();
+        const PointIndicesOnVectors& pointIndicesOnVector = inverseSpaceTransform.getPointsCloseToEvaluationPositions();
+        Matrix3Xf reciprocalPeaksCopy_1_per_A = reciprocalPeaks_1_per_A;
+        latticeAssembler.assembleLattices(assembledLattices, assembledLatticesStatistics, candidateVectors, candidateVectorWeights, pointIndicesOnVector,
+                                          reciprocalPeaksCopy_1_per_A);
+        indexingStatistics.latticeAssemblyStatistics = latticeAssembler.getLastAssemblyStatistics();
+        indexingStatistics.latticeAssemblyTime_s = getSecondsSince(stageStart);
+
+        peakCountOnLattices.clear();
+        peakCountOnLattices.reserve(assembledLatticesStatistics.size());
+        for (auto assembledLatticeStatistics = assembledLatticesStatistics.cbegin(); assembledLatticeStatistics != assembledLatticesStatistics.cend();
+             ++assembledLatticeStatistics)
+        {
+            peakCountOnLattices.push_back(assembledLatticeStatistics->occupiedLatticePointsCount);
+        }
+
+        indexingStatistics.totalTime_s = chrono::duration<double>(chrono::steady_clock::now() - indexingStart).count();
+
+
+        //    cout << assembledLatticesStatistics[0].meanDefect << " " << assembledLatticesStatistics[0].meanRelativeDefect << " "
+        //            << assembledLatticesStatistics[0].occupiedLatticePointsCount << " " << assembledLatticesStatistics.size() << endl <<
+        //            assembledLattices[0].det()
+        //            << endl;
+
+        //    ofstream ofs("workfolder/samplePoints", ofstream::out);
+        //    ofs << samplePoints.transpose().eval();
+    }
+
+    uint32_t IndexingPlan::selectSamplePoints(IndexingWorkspace& workspace, Matrix3Xf& samplePoints, const Matrix3Xf& reciprocalPeaks_1_per_A) const
+    {
+        InverseSpaceTransform& coarseSamplingTransform = workspace.coarseSamplingTransform;
+        vector<uint32_t>& sortIndices = workspace.sortIndices;
+        vector<uint8_t>& coarseSamplePointKept = workspace.coarseSamplePointKept;
+        Matrix3Xf& chunk = workspace.coarseSamplePointsChunk;
+        RowVectorXf& evaluation = workspace.coarseSamplePointsEvaluation;
+
+        // evaluated in chunks like in the hill climbing, so the memory of the transform does not grow with the coarse grid
+        const uint32_t maxPointsPerChunk = 100;
+        uint32_t coarseSamplePointsCount = coarseSamplePoints->cols();
+        uint32_t transformCallsCount = 0;
+        coarseSamplingTransform.setPointsToTransform(reciprocalPeaks_1_per_A);
+        evaluation.resize(coarseSamplePointsCount);
+        for (uint32_t chunkStart = 0; chunkStart < coarseSamplePointsCount; chunkStart += maxPointsPerChunk)
+        {
+            uint32_t chunkPointsCount = min(maxPointsPerChunk, coarseSamplePointsCount - chunkStart);
+            chunk = coarseSamplePoints->middleCols(chunkStart, chunkPointsCount);
+            coarseSamplingTransform.performEvaluation(chunk);
+            evaluation.segment(chunkStart, chunkPointsCount) = coarseSamplingTransform.getInverseTransformEvaluation();
+            transformCallsCount++;
+        }
+
+        uint32_t keptCount = min(coarseSamplePointsCount, (uint32_t)ceil(coarseSamplePointsCount * keptCoarsePointsFraction));
+        if (keptCount == 0)
+        {
+            samplePoints = *precomputedSamplePoints;
+            return transformCallsCount;
+        }
+
+        sortIndices.resize(coarseSamplePointsCount);
+        iota(sortIndices.begin(), sortIndices.end(), 0);
+        nth_element(sortIndices.begin(), sortIndices.begin() + keptCount - 1, sortIndices.end(),
+                    [&](uint32_t i, uint32_t j) { return evaluation[i] > evaluation[j]; });
+
+        coarseSamplePointKept.assign(coarseSamplePointsCount, 0);
+        for (uint32_t i = 0; i < keptCount; ++i)
+        {
+            coarseSamplePointKept[sortIndices[i]] = 1;
+        }
+
+        const Matrix3Xf& allSamplePoints = *precomputedSamplePoints;
+        samplePoints.resize(3, allSamplePoints.cols());
+        uint32_t samplePointsCount = 0;
+        for (uint32_t i = 0; i < allSamplePoints.cols(); ++i)
+        {
+            if (coarseSamplePointKept[closestCoarseSamplePointIndices[i]])
+            {
+                samplePoints.col(samplePointsCount++) = allSamplePoints.col(i);
+            }
+        }
+        samplePoints.conservativeResize(NoChange, samplePointsCount);
+
+        return transformCallsCount;
+    }
+
+    void IndexingPlan::setGradientDescentIterationsCount(GradientDescentIterationsCount gradientDescentIterationsCount)
+    {
+        HillClimbingOptimizer::hillClimbingAccuracyConstants_t& global = hillClimbing_accuracyConstants_global;
+        HillClimbingOptimizer::hillClimbingAccuracyConstants_t& additionalGlobal = hillClimbing_accuracyConstants_additionalGlobal;
+        HillClimbingOptimizer::hillClimbingAccuracyConstants_t& peaks = hillClimbing_accuracyConstants_peaks;
+
+        float meanRealLatticeVectorLength = experimentSettings.getDifferentRealLatticeVectorLengths_A().mean();
+
+        switch (gradientDescentIterationsCount)
+        {
+            case GradientDescentIterationsCount::exremelyFew:
+                global.initialIterationCount = 10;
+                global.calmDownIterationCount = 3;
+                global.calmDownFactor = 0.65;
+                global.localFitIterationCount = 4;
+                global.localCalmDownIterationCount = 3;
+                global.localCalmDownFactor = 0.65;
+
+                global.stepComputationAccuracyConstants.gamma = 0.75;
+                global.stepComputationAccuracyConstants.maxStep = meanRealLatticeVectorLength / 15;
+                global.stepComputationAccuracyConstants.minStep = meanRealLatticeVectorLength / 150;
+                global.stepComputationAccuracyConstants.directionChangeFactor = 2;
+                break;
+            case GradientDescentIterationsCount::few:
+                global.initialIterationCount = 20;
+                global.calmDownIterationCount = 4;
+                global.calmDownFactor = 0.73;
+                global.localFitIterationCount = 6;
+                global.localCalmDownIterationCount = 5;
+                global.localCalmDownFactor = 0.73;
+
+                global.stepComputationAccuracyConstants.gamma = 0.7;
+                global.stepComputationAccuracyConstants.maxStep = meanRealLatticeVectorLength / 18;
+                global.stepComputationAccuracyConstants.minStep = meanRealLatticeVectorLength / 180;
+                global.stepComputationAccuracyConstants.directionChangeFactor = 1.5;
+
+                break;
+            case GradientDescentIterationsCount::standard:
+                global.initialIterationCount = 40;
+                global.calmDownIterationCount = 5;
+                global.calmDownFactor = 0.8;
+                global.localFitIterationCount = 8;
+                global.localCalmDownIterationCount = 6;
+                global.localCalmDownFactor = 0.8;
+
+                global.stepComputationAccuracyConstants.gamma = 0.65;
+                global.stepComputationAccuracyConstants.maxStep = meanRealLatticeVectorLength / 20;
+                global.stepComputationAccuracyConstants.minStep = meanRealLatticeVectorLength / 200;
+                global.stepComputationAccuracyConstants.directionChangeFactor = 1.5;
+
+                break;
+            case GradientDescentIterationsCount::many:
+                global.initialIterationCount = 60;
+                global.calmDownIterationCount = 8;
+                global.calmDownFactor = 0.83;
+                global.localFitIterationCount = 10;
+                global.localCalmDownIterationCount = 9;
+                global.localCalmDownFactor = 0.83;
+
+                global.stepComputationAccuracyConstants.gamma = 0.65;
+                global.stepComputationAccuracyConstants.maxStep = meanRealLatticeVectorLength / 20;
+                global.stepComputationAccuracyConstants.minStep = meanRealLatticeVectorLength / 200;
+                global.stepComputationAccuracyConstants.directionChangeFactor = 1.5;
+
+                break;
+            case GradientDescentIterationsCount::manyMany:
+                global.initialIterationCount = 90;
+                global.calmDownIterationCount = 10;
+                global.calmDownFactor = 0.85;
+                global.localFitIterationCount = 15;
+                global.localCalmDownIterationCount = 15;
+                global.localCalmDownFactor = 0.9;
+
+                global.stepComputationAccuracyConstants.gamma = 0.60;
+                global.stepComputationAccuracyConstants.maxStep = meanRealLatticeVectorLength / 23;
+                global.stepComputationAccuracyConstants.minStep = meanRealLatticeVectorLength / 230;
+                global.stepComputationAccuracyConstants.directionChangeFactor = 1.5;
+
+                break;
+            case GradientDescentIterationsCount::extremelyMany:
+                global.initialIterationCount = 200;
+                global.calmDownIterationCount = 15;
+                global.calmDownFactor = 0.9;
+                global.localFitIterationCount = 15;
+                global.localCalmDownIterationCount = 15;
+                global.localCalmDownFactor = 0.9;
+
+                global.stepComputationAccuracyConstants.gamma = 0.60;
+                global.stepComputationAccuracyConstants.maxStep = meanRealLatticeVectorLength / 23;
+                global.stepComputationAccuracyConstants.minStep = meanRealLatticeVectorLength / 230;
+                global.stepComputationAccuracyConstants.directionChangeFactor = 1.5;
+
+                break;
+            case GradientDescentIterationsCount::custom:
+                global.initialIterationCount = 40;
+                global.calmDownIterationCount = 5;
+                global.calmDownFactor = 0.8;
+                global.localFitIterationCount = 8;
+                global.localCalmDownIterationCount = 6;
+                global.localCalmDownFactor = 0.8;
+
+                global.stepComputationAccuracyConstants.gamma = 0.65;
+                global.stepComputationAccuracyConstants.maxStep = meanRealLatticeVectorLength / 20;
+                global.stepComputationAccuracyConstants.minStep = meanRealLatticeVectorLength / 200;
+                global.stepComputationAccuracyConstants.directionChangeFactor = 1.5;
+                break;
+        }
+
+        global.functionSelection = 1;
+        global.optionalFunctionArgument = 1;
+        global.maxCloseToPointDeviation = maxCloseToPointDeviation;
+        global.convergedIterationCount = 0; // too few local steps to profit from the convergence tracking
+        global.convergedStepLength = 0;
+        global.convergedEvaluationChange = 0;
+        global.localRefinementMode = HillClimbingOptimizer::LocalRefinementMode::hillClimbing;
+        global.leastSquaresSnapIterationCount = 0;
+
+        additionalGlobal.functionSelection = 9;
+        additionalGlobal.optionalFunctionArgument = 4;
+        additionalGlobal.maxCloseToPointDeviation = maxCloseToPointDeviation;
+
+        additionalGlobal.initialIterationCount = 0;
+        additionalGlobal.calmDownIterationCount = 0;
+        additionalGlobal.calmDownFactor = 0;
+        additionalGlobal.localFitIterationCount = 4;
+        additionalGlobal.localCalmDownIterationCount = 3;
+        additionalGlobal.localCalmDownFactor = 0.7;
+        additionalGlobal.convergedIterationCount = 0;
+        additionalGlobal.convergedStepLength = 0;
+        additionalGlobal.convergedEvaluationChange = 0;
+        additionalGlobal.localRefinementMode = HillClimbingOptimizer::LocalRefinementMode::hillClimbing;
+        additionalGlobal.leastSquaresSnapIterationCount = 0;
+
+        additionalGlobal.stepComputationAccuracyConstants.gamma = 0.65;
+        additionalGlobal.stepComputationAccuracyConstants.maxStep = meanRealLatticeVectorLength / 50;
+        additionalGlobal.stepComputationAccuracyConstants.minStep = meanRealLatticeVectorLength / 20000;
+        additionalGlobal.stepComputationAccuracyConstants.directionChangeFactor = 2.5;
+
+        peaks.functionSelection = 9;
+        peaks.optionalFunctionArgument = 4;
+        peaks.maxCloseToPointDeviation = maxCloseToPointDeviation;
+
+        peaks.initialIterationCount = 0;
+        peaks.calmDownIterationCount = 0;
+        peaks.calmDownFactor = 0;
+        peaks.localFitIterationCount = 20;
+        peaks.localCalmDownIterationCount = 300;
+        peaks.localCalmDownFactor = 0.98;
+        peaks.convergedIterationCount = 3;
+        peaks.convergedStepLength = meanRealLatticeVectorLength / 40000;
+        peaks.convergedEvaluationChange = 1e-5;
+        peaks.localRefinementMode = peaksRefinementMode;
+        peaks.leastSquaresSnapIterationCount = 5;
+
+        peaks.stepComputationAccuracyConstants.gamma = 0.1;
+        peaks.stepComputationAccuracyConstants.maxStep = meanRealLatticeVectorLength / 300;
+        peaks.stepComputationAccuracyConstants.minStep = meanRealLatticeVectorLength / 20000;
+        peaks.stepComputationAccuracyConstants.directionChangeFactor = 2.5;
+
+        configurationChanged();
+    }
+
+    void IndexingPlan::reducePeakCount(Matrix3Xf& reciprocalPeaks_1_per_A) const
+    {
+        if (maxPeaksToUseForIndexing >= reciprocalPeaks_1_per_A.cols())
+            return;
+
+        RowVectorXf norms = reciprocalPeaks_1_per_A.colwise().norm();
+        RowVectorXf norms_sorted = norms;
+        sort((float*)norms_sorted.data(), (float*)norms_sorted.data() + norms_sorted.size());
+        float maxNorm = norms_sorted[maxPeaksToUseForIndexing - 1];
+
+        int peaksKept_norms = 0;
+        for (int i = 0; i < norms.cols(); i++)
+        {
+            if (norms[i] <= maxNorm)
+            {
+                reciprocalPeaks_1_per_A.col(peaksKept_norms) = reciprocalPeaks_1_per_A.col(i);
+                peaksKept_norms++;
+            }
+        }
+
+        reciprocalPeaks_1_per_A.conservativeResize(NoChange, maxPeaksToUseForIndexing);
+    }
+} // namespace xgandalf
\ No newline at end of file
@@ -29,6 +29,8 @@
 #include <cmath>
 
 #include <InverseSpaceTransform.h>
+#include <bitOperations.h>
+#include <fusedTransformKernels.h>
 #include <assert.h>
 #include <iostream>
 
@@ -39,7 +41,8 @@ namespace xgandalf
 {
     static inline void function1(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope, float optionalFunctionArgument);
     static inline void function1_periodic(ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope, float optionalFunctionArgument,
-                                          Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic>& closeToPoint, float maxCloseToPointDeviation);
+                                          Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic>& closeToPoint, float maxCloseToPointDeviation,
+                                          InverseSpaceTransform::TrigonometryAccuracy trigonometryAccuracy, bool computeSlope);
     static inline void function2(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope);
     static inline void function3(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope);
     static inline void function4(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope);
@@ -47,36 +50,57 @@ namespace xgandalf
     static inline void function6(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope);
     static inline void function7(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope, float optionalFunctionArgument);
     static inline void function8(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope);
-    static inline void function9(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope, float optionalFunctionArgument);
+    static inline void function9(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope, float optionalFunctionArgument, bool computeSlope);
 
     InverseSpaceTransform::InverseSpaceTransform()
         : inverseTransformEvaluationScalingFactor(0)
         , resultsUpToDate(false)
+        , gradientUpToDate(false)
+        , closeToPointUpToDate(false)
+        , closeToPointFromMasks(false)
+        , closeToPointMasksTileWidth(0)
     {
         accuracyConstants.functionSelection = 0;
         accuracyConstants.optionalFunctionArgument = 1;
         accuracyConstants.localTransform = false;
         accuracyConstants.radialWeighting = false;
+        accuracyConstants.fusedKernel = true;
+        accuracyConstants.trigonometryAccuracy = TrigonometryAccuracy::high;
         accuracyConstants.maxCloseToPointDeviation = 0.15;
     }
 
     InverseSpaceTransform::InverseSpaceTransform(float maxCloseToPointDeviation)
         : inverseTransformEvaluationScalingFactor(0)
         , resultsUpToDate(false)
+        , gradientUpToDate(false)
+        , closeToPointUpToDate(false)
+        , closeToPointFromMasks(false)
+        , closeToPointMasksTileWidth(0)
     {
         accuracyConstants.functionSelection = 0;
         accuracyConstants.optionalFunctionArgument = 1;
         accuracyConstants.localTransform = false;
         accuracyConstants.radialWeighting = false;
+        accuracyConstants.fusedKernel = true;
+        accuracyConstants.trigonometryAccuracy = TrigonometryAccuracy::high;
         accuracyConstants.maxCloseToPointDeviation = maxCloseToPointDeviation;
     }
 
     void InverseSpaceTransform::performTransform(const Matrix3Xf& positionsToEvaluate)
     {
+        gradientUpToDate = true;
+        closeToPointUpToDate = true;
+        if (accuracyConstants.fusedKernel && performFusedTransform(positionsToEvaluate, false, true))
+        {
+            resultsUpToDate = true;
+            return;
+        }
+        closeToPointFromMasks = false;
+
         float pointsToTransformCount_inverse = 1 / (float)pointsToTransform.cols();
 
         ArrayXXf x = pointsToTransform.transpose() * positionsToEvaluate;
-        onePeriodicFunction(x);
+        onePeriodicFunction(x, true);
 
         //    cout << slope << endl << endl << pointsToTransform << endl << endl << pointsToTransformWeights << endl << endl;
         Matrix3Xf fullGradient;
@@ -91,14 +115,7 @@ namespace xgandalf
         gradient = (pointsToTransform.array().rowwise() * pointsToTransformWeights.array()).matrix() * slope.matrix();
         inverseTransformEvaluation = pointsToTransformWeights * functionEvaluation.matrix() * inverseTransformEvaluationScalingFactor;
 
-        if (closeToPoint.rows() <= 255)
-        {
-            closeToPointsCount = closeToPoint.matrix().cast<uint8_t>().colwise().sum().cast<float>();
-        }
-        else
-        {
-            closeToPointsCount = closeToPoint.matrix().cast<uint16_t>().colwise().sum().cast<float>();
-        }
+        computeCloseToPointsCount();
         //    cout << gradient << endl << endl << inverseTransformEvaluation << endl << endl << closeToPoint << endl << endl;
 
         if (accuracyConstants.localTransform)
@@ -119,6 +136,116 @@ namespace xgandalf
         resultsUpToDate = true;
     }
 
+    void InverseSpaceTransform::performEvaluation(const Matrix3Xf& positionsToEvaluate, bool computeCloseToPoints)
+    {
+        gradientUpToDate = false;
+        closeToPointUpToDate = computeCloseToPoints;
+        if (accuracyConstants.fusedKernel && performFusedTransform(positionsToEvaluate, true, computeCloseToPoints))
+        {
+            resultsUpToDate = true;
+            return;
+        }
+        closeToPointFromMasks = false;
+        closeToPointUpToDate = true; // closeToPoint is needed for the evaluation anyway
+
+        ArrayXXf x = pointsToTransform.transpose() * positionsToEvaluate;
+        onePeriodicFunction(x, false);
+
+        if (accuracyConstants.localTransform)
+        {
+            functionEvaluation = functionEvaluation * closeToPoint.matrix().cast<float>().array();
+        }
+        inverseTransformEvaluation = pointsToTransformWeights * functionEvaluation.matrix() * inverseTransformEvaluationScalingFactor;
+
+        computeCloseToPointsCount();
+        closeToPointsCount = closeToPointsCount * (1 / (float)pointsToTransform.cols());
+
+        resultsUpToDate = true;
+    }
+
+    // not normalized
+    void InverseSpaceTransform::computeCloseToPointsCount()
+    {
+        if (closeToPoint.rows() <= 255)
+        {
+            closeToPointsCount = closeToPoint.matrix().cast<uint8_t>().colwise().sum().cast<float>();
+        }
+        else
+        {
+            closeToPointsCount = closeToPoint.matrix().cast<uint16_t>().colwise().sum().cast<float>();
+        }
+    }
+
+    bool InverseSpaceTransform::performFusedTransform(const Matrix3Xf& positionsToEvaluate, bool evaluationOnly, bool computeCloseToPointMasks)
+    {
+        const int functionSelection = accuracyConstants.functionSelection;
+        const float optionalFunctionArgument = accuracyConstants.optionalFunctionArgument;
+        const uint32_t tileWidth = getFusedTransformTileWidth();
+
+        if (tileWidth == 0 || (functionSelection != 1 && functionSelection != 9) || pointsToTransform.cols() == 0)
+        {
+            return false;
+        }
+        if (functionSelection == 1 && accuracyConstants.trigonometryAccuracy == TrigonometryAccuracy::exact)
+        {
+            return false;
+        }
+        if (functionSelection == 9 && (optionalFunctionArgument - round(optionalFunctionArgument) != 0 || optionalFunctionArgument < 2))
+        {
+            return false;
+        }
+
+        fusedTransformArguments_t arguments;
+        arguments.pointsToTransform = pointsToTransform.data();
+        arguments.pointsToTransformWeights = pointsToTransformWeights.data();
+        arguments.pointsCount = pointsToTransform.cols();
+        arguments.positionsToEvaluate = positionsToEvaluate.data();
+        arguments.positionsCount = positionsToEvaluate.cols();
+
+        arguments.functionSelection = functionSelection;
+        arguments.fastTrigonometry = (accuracyConstants.trigonometryAccuracy == TrigonometryAccuracy::fast);
+        arguments.localTransform = accuracyConstants.localTransform;
+        arguments.inverseTransformEvaluationScalingFactor = inverseTransformEvaluationScalingFactor;
+        arguments.evaluationOnly = evaluationOnly;
+        if (functionSelection == 1)
+        {
+            // same constants as in function1_periodic
+            float n = (int)optionalFunctionArgument;
+            arguments.exponent = (int)optionalFunctionArgument;
+            arguments.slopeScaling = (arguments.exponent == 1) ? 1 : pow(n, n / 2) / pow((n - 1), (int)(n - 1) / 2);
+            arguments.closeToPointThreshold = pow(cos(accuracyConstants.maxCloseToPointDeviation * (2 * M_PI)), arguments.exponent);
+        }
+        else
+        {
+            arguments.exponent = (int)optionalFunctionArgument;
+            arguments.slopeScaling = 1;
+            arguments.closeToPointThreshold = accuracyConstants.maxCloseToPointDeviation;
+        }
+
+        inverseTransformEvaluation.resize(positionsToEvaluate.cols());
+        closeToPointsCount.resize(positionsToEvaluate.cols());
+        arguments.inverseTransformEvaluation = inverseTransformEvaluation.data();
+        arguments.closeToPointsCount = closeToPointsCount.data();
+        arguments.gradient = nullptr;
+        arguments.closeToPointMasks = nullptr;
+        if (!evaluationOnly)
+        {
+            gradient.resize(3, positionsToEvaluate.cols());
+            arguments.gradient = gradient.data();
+        }
+        if (computeCloseToPointMasks)
+        {
+            closeToPointMasks.resize(((positionsToEvaluate.cols() + tileWidth - 1) / tileWidth) * pointsToTransform.cols());
+            arguments.closeToPointMasks = closeToPointMasks.data();
+        }
+
+        xgandalf::performFusedTransform(arguments);
+
+        closeToPointFromMasks = true;
+        closeToPointMasksTileWidth = tileWidth;
+        return true;
+    }
+
     // cos(x * 2*pi).^optionalFunctionArgument
     static inline void function1(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope, float optionalFunctionArgument)
     {
@@ -139,29 +266,124 @@ namespace xgandalf
         }
     }
 
+    // base.^exponent for exponent >= 1 by repeated squaring
+    static inline void powInt(const ArrayXXf& base, int exponent, ArrayXXf& result)
+    {
+        assert(exponent >= 1);
+
+        result = base;
+        int remainingExponent = exponent - 1;
+        if (remainingExponent == 0)
+        {
+            return;
+        }
+
+        ArrayXXf basePower = base;
+        while (remainingExponent > 0)
+        {
+            if (remainingExponent & 1)
+            {
+                result *= basePower;
+            }
+            remainingExponent >>= 1;
+            if (remainingExponent > 0)
+            {
+                basePower = basePower.square();
+            }
+        }
+    }
+
+    // round to nearest integer for |x| < 2^22, vectorizes without SSE4.1
+    static inline float roundFast(float x)
+    {
+        const float magic = 12582912.0f; // 1.5 * 2^23
+        return (x + magic) - magic;
+    }
+
+    // sin(x * 2*pi) and cos(x * 2*pi) in one pass. Reduction to one octant and minimax polynomials, see InverseSpaceTransform::TrigonometryAccuracy
+    template <bool fast>
+    static inline void sincos2pi(const ArrayXXf& x, ArrayXXf& sine, ArrayXXf& cosine)
+    {
+        sine.resize(x.rows(), x.cols());
+        cosine.resize(x.rows(), x.cols());
+
+        const float* xData = x.data();
+        float* sineData = sine.data();
+        float* cosineData = cosine.data();
+        const Index size = x.size();
+        for (Index i = 0; i < size; ++i)
+        {
+            const float reducedX = xData[i] - roundFast(xData[i]);  // in [-0.5, 0.5]
+            const float quadrant = roundFast(reducedX * 4);         // in {-2, -1, 0, 1, 2}
+            const float angle = (reducedX - quadrant * 0.25f) * 6.28318530717958647692f; // in [-pi/4, pi/4]
+            const float angle2 = angle * angle;
+
+            float s, c;
+            if (fast)
+            {
+                s = (8.152991817e-3f * angle2 - 1.666283378e-1f) * angle2 * angle + angle;
+                c = (4.048893209e-2f * angle2 - 4.997763056e-1f) * angle2 + 1;
+            }
+            else
+            {
+                s = ((-1.9515295891e-4f * angle2 + 8.3321608736e-3f) * angle2 - 1.6666654611e-1f) * angle2 * angle + angle;
+                c = ((2.443315711809948e-5f * angle2 - 1.388731625493765e-3f) * angle2 + 4.166664568298827e-2f) * angle2 * angle2 - 0.5f * angle2 + 1;
+            }
+
+            const int k = (int)quadrant & 3;
+            const float sineUnsigned = (k & 1) ? c : s;
+            const float cosineUnsigned = (k & 1) ? s : c;
+            sineData[i] = (k & 2) ? -sineUnsigned : sineUnsigned;
+            cosineData[i] = ((k + 1) & 2) ? -cosineUnsigned : cosineUnsigned;
+        }
+    }
+
     // cos(x * 2*pi).^optionalFunctionArgument
     static inline void function1_periodic(ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope, float optionalFunctionArgument,
-                                          Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic>& closeToPoint, float maxCloseToPointDeviation)
+                                          Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic>& closeToPoint, float maxCloseToPointDeviation,
+                                          InverseSpaceTransform::TrigonometryAccuracy trigonometryAccuracy, bool computeSlope)
     {
         assert((optionalFunctionArgument - round(optionalFunctionArgument)) == 0);
         assert((int)optionalFunctionArgument % 2 != 0); // An even optionanFunctionArgument does not make sense with this function.
 
-        if (optionalFunctionArgument == 1)
+        // cosine is stored in functionEvaluation, sine in slope
+        switch (trigonometryAccuracy)
         {
-            functionEvaluation = cos(x * (2 * M_PI));
-            slope = -sin(x * (2 * M_PI));
+            case InverseSpaceTransform::TrigonometryAccuracy::exact:
+                functionEvaluation = cos(x * (2 * M_PI));
+                slope = sin(x * (2 * M_PI));
+                break;
+            case InverseSpaceTransform::TrigonometryAccuracy::high:
+                sincos2pi<false>(x, slope, functionEvaluation);
+                break;
+            case InverseSpaceTransform::TrigonometryAccuracy::fast:
+                sincos2pi<true>(x, slope, functionEvaluation);
+                break;
+        }
+
+        int n = (int)optionalFunctionArgument;
+        if (n == 1)
+        {
+            if (computeSlope)
+            {
+                slope = -slope;
+            }
 
             float threshold = cos(maxCloseToPointDeviation * (2 * M_PI)); // can be precomputed
             closeToPoint = functionEvaluation > threshold;
         }
         else
         {
-            functionEvaluation = pow(cos(x * (2 * M_PI)), (int)optionalFunctionArgument); // can be faster using manual pow for integer exponent!
-            float n = optionalFunctionArgument;
-            float scaling = pow(n, n / 2) / pow((n - 1), (int)(n - 1) / 2);
-            slope = -scaling * sin(x * (2 * M_PI)) * pow(cos(x * (2 * M_PI)), (int)(n - 1));
+            float scaling = pow((float)n, (float)n / 2) / pow((float)(n - 1), (n - 1) / 2);
+            ArrayXXf cosinePower; // cos^(n-1)
+            powInt(functionEvaluation, n - 1, cosinePower);
+            if (computeSlope)
+            {
+                slope = -scaling * slope * cosinePower;
+            }
+            functionEvaluation *= cosinePower;
 
-            float threshold = pow(cos(maxCloseToPointDeviation * (2 * M_PI)), (int)optionalFunctionArgument);
+            float threshold = pow(cos(maxCloseToPointDeviation * (2 * M_PI)), n);
             closeToPoint = functionEvaluation > threshold;
         }
     }
@@ -212,7 +434,98 @@ namespace xgandalf
         slope = 2 * (abs(x) - 0.5) * x.sign();
     }
 
-    static inline void function9(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope, float optionalFunctionArgument)
+    // base = 1 - 2*abs(x). Just for performance, in case the compiler does not recognize the integer exponent
+    static inline void function9_integerExponent_evaluation(const ArrayXXf& base, int exponent, ArrayXXf& functionEvaluation)
+    {
+        switch (exponent)
+        {
+            case 1:
+                functionEvaluation = base * 2 - 1;
+                break;
+            case 2:
+                functionEvaluation = base.square() * 2 - 1;
+                break;
+            case 3:
+                functionEvaluation = base.cube() * 2 - 1;
+                break;
+            case 4:
+                functionEvaluation = base.square().square() * 2 - 1;
+                break;
+            case 5:
+                functionEvaluation = base.cube() * base.square() * 2 - 1;
+                break;
+            case 6:
+                functionEvaluation = base.cube().square() * 2 - 1;
+                break;
+            case 7:
+                functionEvaluation = base.cube() * base.square().square() * 2 - 1;
+                break;
+            case 8:
+                functionEvaluation = base.square().square().square() * 2 - 1;
+                break;
+            case 9:
+                functionEvaluation = base.cube().cube() * 2 - 1;
+                break;
+            case 10:
+                functionEvaluation = base.cube().cube() * base * 2 - 1;
+                break;
+            case 11:
+                functionEvaluation = base.cube().cube() * base.square() * 2 - 1;
+                break;
+            case 12:
+                functionEvaluation = base.cube().square().square() * 2 - 1;
+                break;
+            default:
+                functionEvaluation = pow(base, exponent) * 2 - 1;
+        }
+    }
+
+    static inline void function9_integerExponent_slope(const ArrayXXf& x, const ArrayXXf& base, int exponent, ArrayXXf& slope)
+    {
+        switch (exponent)
+        {
+            case 1:
+                slope = -1 * x.sign();
+                break;
+            case 2:
+                slope = -x * base / (abs(x) + 0.0001);
+                break;
+            case 3:
+                slope = -x * base.square() / (abs(x) + 0.0001);
+                break;
+            case 4:
+                slope = -x * base.cube() / (abs(x) + 0.0001);
+                break;
+            case 5:
+                slope = -x * base.square().square() / (abs(x) + 0.0001);
+                break;
+            case 6:
+                slope = -x * base.cube() * base.square() / (abs(x) + 0.0001);
+                break;
+            case 7:
+                slope = -x * base.cube().square() / (abs(x) + 0.0001);
+                break;
+            case 8:
+                slope = -x * base.cube() * base.square().square() / (abs(x) + 0.0001);
+                break;
+            case 9:
+                slope = -x * base.square().square().square() / (abs(x) + 0.0001);
+                break;
+            case 10:
+                slope = -x * base.cube().cube() / (abs(x) + 0.0001);
+                break;
+            case 11:
+                slope = -x * base.cube().cube() * base / (abs(x) + 0.0001);
+                break;
+            case 12:
+                slope = -x * base.cube().cube() * base.square() / (abs(x) + 0.0001);
+                break;
+            default:
+                slope = -x * pow(base, exponent - 1) / (abs(x) + 0.0001);
+        }
+    }
+
+    static inline void function9(const ArrayXXf& x, ArrayXXf& functionEvaluation, ArrayXXf& slope, float optionalFunctionArgument, bool computeSlope)
     {
         if (optionalFunctionArgument - round(optionalFunctionArgument) == 0)
         {
@@ -221,75 +534,30 @@ namespace xgandalf
             int exponent = (int)optionalFunctionArgument;
 
             ArrayXXf base = 1 - 2 * abs(x); // TODO: auto may be faster or slower... check!
-            switch (exponent)
-            { // just for performance, in case the compiler does not recognize the integer exponent
-                case 1:
-                    functionEvaluation = base * 2 - 1;
-                    slope = -1 * x.sign();
-                    break;
-                case 2:
-                    functionEvaluation = base.square() * 2 - 1;
-                    slope = -x * base / (abs(x) + 0.0001);
-                    break;
-                case 3:
-                    functionEvaluation = base.cube() * 2 - 1;
-                    slope = -x * base.square() / (abs(x) + 0.0001);
-                    break;
-                case 4:
-                    functionEvaluation = base.square().square() * 2 - 1;
-                    slope = -x * base.cube() / (abs(x) + 0.0001);
-                    break;
-                case 5:
-                    functionEvaluation = base.cube() * base.square() * 2 - 1;
-                    slope = -x * base.square().square() / (abs(x) + 0.0001);
-                    break;
-                case 6:
-                    functionEvaluation = base.cube().square() * 2 - 1;
-                    slope = -x * base.cube() * base.square() / (abs(x) + 0.0001);
-                    break;
-                case 7:
-                    functionEvaluation = base.cube() * base.square().square() * 2 - 1;
-                    slope = -x * base.cube().square() / (abs(x) + 0.0001);
-                    break;
-                case 8:
-                    functionEvaluation = base.square().square().square() * 2 - 1;
-                    slope = -x * base.cube() * base.square().square() / (abs(x) + 0.0001);
-                    break;
-                case 9:
-                    functionEvaluation = base.cube().cube() * 2 - 1;
-                    slope = -x * base.square().square().square() / (abs(x) + 0.0001);
-                    break;
-                case 10:
-                    functionEvaluation = base.cube().cube() * base * 2 - 1;
-                    slope = -x * base.cube().cube() / (abs(x) + 0.0001);
-                    break;
-                case 11:
-                    functionEvaluation = base.cube().cube() * base.square() * 2 - 1;
-                    slope = -x * base.cube().cube() * base / (abs(x) + 0.0001);
-                    break;
-                case 12:
-                    functionEvaluation = base.cube().square().square() * 2 - 1;
-                    slope = -x * base.cube().cube() * base.square() / (abs(x) + 0.0001);
-                    break;
-                default:
-                    functionEvaluation = pow(base, exponent) * 2 - 1;
-                    slope = -x * pow(base, exponent - 1) / (abs(x) + 0.0001);
+            function9_integerExponent_evaluation(base, exponent, functionEvaluation);
+            if (computeSlope)
+            {
+                function9_integerExponent_slope(x, base, exponent, slope);
             }
         }
         else
         {
             functionEvaluation = pow(1 - 2 * abs(x), optionalFunctionArgument) * 2 - 1;
-            slope = -x * pow(1 - 2 * abs(x), optionalFunctionArgument - 1) / (abs(x) + 0.0001);
+            if (computeSlope)
+            {
+                slope = -x * pow(1 - 2 * abs(x), optionalFunctionArgument - 1) / (abs(x) + 0.0001);
+            }
         }
     }
 
-    void InverseSpaceTransform::onePeriodicFunction(ArrayXXf& x)
+    // computeSlope is only a hint. Functions other than 1 and 9 always compute the slope
+    void InverseSpaceTransform::onePeriodicFunction(ArrayXXf& x, bool computeSlope)
     {
         switch (accuracyConstants.functionSelection)
         {
             case 1:
                 function1_periodic(x, functionEvaluation, slope, accuracyConstants.optionalFunctionArgument, closeToPoint,
-                                   accuracyConstants.maxCloseToPointDeviation);
+                                   accuracyConstants.maxCloseToPointDeviation, accuracyConstants.trigonometryAccuracy, computeSlope);
                 break;
             case 2:
                 x = x - round(x);
@@ -329,7 +597,7 @@ namespace xgandalf
             case 9:
                 x = x - round(x);
                 closeToPoint = abs(x) < accuracyConstants.maxCloseToPointDeviation;
-                function9(x, functionEvaluation, slope, accuracyConstants.optionalFunctionArgument);
+                function9(x, functionEvaluation, slope, accuracyConstants.optionalFunctionArgument, computeSlope);
                 break;
             default:
                 stringstream errStream;
@@ -357,6 +625,16 @@ namespace xgandalf
         update_pointsToTransformWeights();
     }
 
+    void InverseSpaceTransform::copySettings(const InverseSpaceTransform& other)
+    {
+        resultsUpToDate = false;
+        pointsToTransform = other.pointsToTransform;
+        pointsToTransformWeights_userPreset = other.pointsToTransformWeights_userPreset;
+        pointsToTransformWeights = other.pointsToTransformWeights;
+        accuracyConstants = other.accuracyConstants;
+        inverseTransformEvaluationScalingFactor = other.inverseTransformEvaluationScalingFactor;
+    }
+
     void InverseSpaceTransform::update_pointsToTransformWeights()
     {
         if (accuracyConstants.radialWeighting)
@@ -424,6 +702,33 @@ namespace xgandalf
         update_pointsToTransformWeights();
     }
 
+    void InverseSpaceTransform::setFusedKernelFlag()
+    {
+        if (accuracyConstants.fusedKernel == false)
+        {
+            resultsUpToDate = false;
+            accuracyConstants.fusedKernel = true;
+        }
+    }
+
+    void InverseSpaceTransform::clearFusedKernelFlag()
+    {
+        if (accuracyConstants.fusedKernel == true)
+        {
+            resultsUpToDate = false;
+            accuracyConstants.fusedKernel = false;
+        }
+    }
+
+    void InverseSpaceTransform::setTrigonometryAccuracy(TrigonometryAccuracy trigonometryAccuracy)
+    {
+        if (accuracyConstants.trigonometryAccuracy != trigonometryAccuracy)
+        {
+            resultsUpToDate = false;
+            accuracyConstants.trigonometryAccuracy = trigonometryAccuracy;
+        }
+    }
+
     void InverseSpaceTransform::setMaxCloseToPointDeviation(float maxCloseToPointDeviation)
     {
         assert(maxCloseToPointDeviation < 0.5);
@@ -434,9 +739,24 @@ namespace xgandalf
         }
     }
 
+    const Eigen::Matrix3Xf& InverseSpaceTransform::getPointsToTransform() const
+    {
+        return pointsToTransform;
+    }
+
+    const Eigen::RowVectorXf& InverseSpaceTransform::getPointsToTransformWeights() const
+    {
+        return pointsToTransformWeights;
+    }
+
+    float InverseSpaceTransform::getMaxCloseToPointDeviation() const
+    {
+        return accuracyConstants.maxCloseToPointDeviation;
+    }
+
     Eigen::Matrix3Xf& InverseSpaceTransform::getGradient()
     {
-        if (resultsUpToDate)
+        if (resultsUpToDate && gradientUpToDate)
         {
             return gradient;
         }
@@ -474,37 +794,86 @@ namespace xgandalf
         }
     }
 
-    vector<vector<uint16_t>>& InverseSpaceTransform::getPointsCloseToEvaluationPositions_indices()
+    PointIndicesOnVectors& InverseSpaceTransform::getPointsCloseToEvaluationPositions()
     {
-        const int typicalMaxClosePointsCount = 100;
-        pointsCloseToEvaluationPositions_indices.resize(closeToPoint.cols(), vector<uint16_t>(typicalMaxClosePointsCount));
-
-        const auto end = pointsCloseToEvaluationPositions_indices.end();
-        for (auto it = pointsCloseToEvaluationPositions_indices.begin(); it < end; ++it)
+        if (!resultsUpToDate || !closeToPointUpToDate)
         {
-            it->clear();
+            stringstream errStream;
+            errStream << "closeToPoint not up to date, call performTransform() or performEvaluation() with close to points first.";
+            throw BadInputException(errStream.str());
         }
 
-        if (resultsUpToDate)
+        vector<uint32_t>& offsets = pointsCloseToEvaluationPositions.offsets;
+        vector<uint16_t>& pointIndices = pointsCloseToEvaluationPositions.pointIndices;
+
+        if (closeToPointFromMasks)
         {
-            for (int pointIndex = 0; pointIndex < closeToPoint.rows(); pointIndex++)
+            // two passes over the masks: count, then fill. Within every tile the points are visited ascending, so the indices come out sorted
+            const uint32_t evaluationPositionsCount = inverseTransformEvaluation.size();
+            const uint32_t pointsCount = pointsToTransform.cols();
+            const uint32_t tilesCount = (evaluationPositionsCount + closeToPointMasksTileWidth - 1) / closeToPointMasksTileWidth;
+
+            offsets.assign(evaluationPositionsCount + 1, 0);
+            for (uint32_t tileIndex = 0; tileIndex < tilesCount; tileIndex++)
             {
-                for (int evaluationPositionIndex = 0; evaluationPositionIndex < closeToPoint.cols(); evaluationPositionIndex++)
+                const uint16_t* tileMasks = &closeToPointMasks[tileIndex * pointsCount];
+                uint32_t* tileCounts = &offsets[tileIndex * closeToPointMasksTileWidth + 1];
+                for (uint32_t pointIndex = 0; pointIndex < pointsCount; pointIndex++)
                 {
-                    if (closeToPoint(pointIndex, evaluationPositionIndex))
+                    for (uint32_t mask = tileMasks[pointIndex]; mask != 0; mask &= mask - 1)
                     {
-                        pointsCloseToEvaluationPositions_indices[evaluationPositionIndex].push_back(pointIndex);
+                        tileCounts[countTrailingZeros(mask)]++;
                     }
                 }
             }
+            for (uint32_t i = 0; i < evaluationPositionsCount; i++)
+            {
+                offsets[i + 1] += offsets[i];
+            }
 
-            return pointsCloseToEvaluationPositions_indices;
+            pointIndices.resize(offsets.back());
+            uint32_t fillPositions[fusedTransformMaxTileWidth];
+            for (uint32_t tileIndex = 0; tileIndex < tilesCount; tileIndex++)
+            {
+                const uint16_t* tileMasks = &closeToPointMasks[tileIndex * pointsCount];
+                copy(&offsets[tileIndex * closeToPointMasksTileWidth],
+                     &offsets[min((tileIndex + 1) * closeToPointMasksTileWidth, evaluationPositionsCount)], fillPositions);
+                for (uint32_t pointIndex = 0; pointIndex < pointsCount; pointIndex++)
+                {
+                    for (uint32_t mask = tileMasks[pointIndex]; mask != 0; mask &= mask - 1)
+                    {
+                        pointIndices[fillPositions[countTrailingZeros(mask)]++] = pointIndex;
+                    }
+                }
+            }
         }
         else
         {
-            stringstream errStream;
-            errStream << "closeToPoint not up to date, call performTransform() first.";
-            throw BadInputException(errStream.str());
+            // closeToPoint is column major, so every evaluation position is contiguous
+            const int evaluationPositionsCount = closeToPoint.cols();
+            offsets.resize(evaluationPositionsCount + 1);
+            offsets[0] = 0;
+            pointIndices.clear();
+            for (int evaluationPositionIndex = 0; evaluationPositionIndex < evaluationPositionsCount; evaluationPositionIndex++)
+            {
+                const bool* closeToPointColumn = &closeToPoint(0, evaluationPositionIndex);
+                for (int pointIndex = 0; pointIndex < closeToPoint.rows(); pointIndex++)
+                {
+                    if (closeToPointColumn[pointIndex])
+                    {
+                        pointIndices.push_back(pointIndex);
+                    }
+                }
+                offsets[evaluationPositionIndex + 1] = pointIndices.size();
+            }
         }
+
+        return pointsCloseToEvaluationPositions;
+    }
+
+    vector<vector<uint16_t>>& InverseSpaceTransform::getPointsCloseToEvaluationPositions_indices()
+    {
+        getPointsCloseToEvaluationPositions().toVectors(pointsCloseToEvaluationPositions_indices);
+        return pointsCloseToEvaluationPositions_indices;
     }
 } // namespace xgandalf
\ No newline at end of file
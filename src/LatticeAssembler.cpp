@@ -28,6 +28,7 @@
 #include "refinement.h"
 #include <LatticeAssembler.h>
 #include <algorithm>
+#include <bitOperations.h>
 #include <ctype.h>
 #include <functional>
 #include <iterator>
@@ -84,6 +85,8 @@ namespace xgandalf
         accuracyConstants.minPointsOnLattice = 5;
 
         accuracyConstants.maxCloseToPointDeviation = 0.15;
+
+        lastAssemblyStatistics = assemblyStatistics_t();
     }
 
     void LatticeAssembler::setKnownLatticeParameters(const Lattice& sampleRealLattice_A, float tolerance)
@@ -100,6 +103,16 @@ namespace xgandalf
         return accuracyConstants;
     }
 
+    void LatticeAssembler::setThreadCount(uint32_t threadCount)
+    {
+        workerPool.setThreadCount(threadCount);
+    }
+
+    const LatticeAssembler::assemblyStatistics_t& LatticeAssembler::getLastAssemblyStatistics() const
+    {
+        return lastAssemblyStatistics;
+    }
+
     void LatticeAssembler::assembleLattices(vector<Lattice>& assembledLattices, Matrix3Xf& candidateVectors, RowVectorXf& candidateVectorWeights,
                                             vector<vector<uint16_t>>& pointIndicesOnVector, Matrix3Xf& pointsToFitInReciprocalSpace)
     {
@@ -111,31 +124,47 @@ namespace xgandalf
     void LatticeAssembler::assembleLattices(vector<Lattice>& assembledLattices, vector<assembledLatticeStatistics_t>& assembledLatticesStatistics,
                                             Matrix3Xf& candidateVectors, RowVectorXf& candidateVectorWeights, vector<vector<uint16_t>>& pointIndicesOnVector,
                                             Matrix3Xf& pointsToFitInReciprocalSpace)
+    {
+        pointIndicesOnVector_converted.assign(pointIndicesOnVector);
+        assembleLattices(assembledLattices, assembledLatticesStatistics, candidateVectors, candidateVectorWeights, pointIndicesOnVector_converted,
+                         pointsToFitInReciprocalSpace);
+    }
+
+    void LatticeAssembler::assembleLattices(vector<Lattice>& assembledLattices, vector<assembledLatticeStatistics_t>& assembledLatticesStatistics,
+                                            Matrix3Xf& candidateVectors, RowVectorXf& candidateVectorWeights, const PointIndicesOnVectors& pointIndicesOnVector,
+                                            Matrix3Xf& pointsToFitInReciprocalSpace)
     {
         reset();
 
         computeCandidateLattices(candidateVectors, candidateVectorWeights, pointIndicesOnVector);
+        lastAssemblyStatistics.passingLatticeParametersFilterCount = candidateLattices.size();
 
-        list<candidateLattice_t> finalCandidateLattices;
+        vector<candidateLattice_t>& finalCandidateLattices = selectionCandidateLattices;
+        finalCandidateLattices.clear();
 
         filterCandidateLatticesByWeight(accuracyConstants.maxCountGlobalPassingWeightFilter);
-
-        for (auto candidateLattice = candidateLattices.begin(); candidateLattice != candidateLattices.end(); ++candidateLattice)
-        {
-            candidateLattice->realSpaceLattice.minimize();
-            candidateLattice->det = abs(candidateLattice->realSpaceLattice.det());
-            computeAssembledLatticeStatistics(*candidateLattice, pointsToFitInReciprocalSpace);
-        };
+        lastAssemblyStatistics.passingGlobalWeightFilterCount = candidateLattices.size();
+
+        // candidates are independent of each other
+        workerPool.run(candidateLattices.size(), [&](uint32_t candidateIndex, uint32_t) {
+            candidateLattice_t& candidateLattice = candidateLattices[candidateIndex];
+            candidateLattice.realSpaceLattice.minimize();
+            candidateLattice.det = abs(candidateLattice.realSpaceLattice.det());
+            computeAssembledLatticeStatistics(candidateLattice, pointsToFitInReciprocalSpace);
+        });
 
         // assume that candidateVectors is sorted descending for weight!
         finalCandidateLattices.insert(finalCandidateLattices.end(), candidateLattices.begin(),
                                       candidateLattices.begin() + min((uint32_t)candidateLattices.size(), accuracyConstants.maxCountLocalPassingWeightFilter));
+        lastAssemblyStatistics.passingLocalWeightFilterCount = finalCandidateLattices.size();
 
         filterCandidateBasesByMeanRelativeDefect(accuracyConstants.maxCountPassingRelativeDefectFilter);
+        lastAssemblyStatistics.passingRelativeDefectFilterCount = candidateLattices.size();
 
-        finalCandidateLattices.insert(finalCandidateLattices.end(), candidateLattices.begin(), candidateLattices.end());
+        finalCandidateLattices.insert(finalCandidateLattices.end(), make_move_iterator(candidateLattices.begin()), make_move_iterator(candidateLattices.end()));
 
         selectBestLattices(assembledLattices, assembledLatticesStatistics, finalCandidateLattices);
+        lastAssemblyStatistics.selectedLatticesCount = assembledLattices.size();
 
         for (auto lattice = assembledLattices.begin(); lattice != assembledLattices.end(); ++lattice)
         {
@@ -163,43 +192,63 @@ namespace xgandalf
 
     // clang-format off
 void LatticeAssembler::selectBestLattices(vector< Lattice >& assembledLattices, vector< assembledLatticeStatistics_t >& assembledLatticesStatistics,
-        list< candidateLattice_t >& finalCandidateLattices)
+        vector< candidateLattice_t >& finalCandidateLattices)
 {
     assembledLattices.clear();
     if (finalCandidateLattices.size() == 0) {
         return;
     }
 
-    finalCandidateLattices.sort([&](candidateLattice_t i, candidateLattice_t j) {return i.pointOnLatticeIndices.size() > j.pointOnLatticeIndices.size();}); //descending
+    // selectedCandidates is the sorted candidate list, the candidates themselves are never moved
+    vector< uint32_t >& selectedCandidates = selectionOrder;
+    selectedCandidates.resize(finalCandidateLattices.size());
+    iota(selectedCandidates.begin(), selectedCandidates.end(), 0);
+    stable_sort(selectedCandidates.begin(), selectedCandidates.end(), [&](uint32_t i, uint32_t j) {
+        return finalCandidateLattices[i].pointOnLatticeIndices.size() > finalCandidateLattices[j].pointOnLatticeIndices.size();}); //descending
 
     float significantDetReductionFactor = 0.75f;
     float significantPointCountReductionFactor = 0.85f;
     float significantMeanDefectReductionFactor = 0.7f;
     float significantMeanRelativeDefectReductionFactor = 0.8f;
 
-    vector< uint16_t > combinedPointIndicesOnSelectedLattices;
-    vector< uint16_t > tmp_indices;
-    tmp_indices.reserve(4000); //just for speed
-    combinedPointIndicesOnSelectedLattices.reserve(1000); //just for speed
-
-    auto bestCandidateLattice = finalCandidateLattices.begin();
-    auto nextCandidateLattice = finalCandidateLattices.begin();
-    while (bestCandidateLattice != prev(finalCandidateLattices.end()) && bestCandidateLattice != finalCandidateLattices.end()) {
-        tmp_indices.clear();
-        set_union(combinedPointIndicesOnSelectedLattices.begin(), combinedPointIndicesOnSelectedLattices.end(),
-                bestCandidateLattice->pointOnLatticeIndices.begin(), bestCandidateLattice->pointOnLatticeIndices.end(),
-                back_inserter(tmp_indices));   // first resizing to take all elements and then rezizing to right size may be slightly faster than back-inserter
-        combinedPointIndicesOnSelectedLattices.swap(tmp_indices);
-
-        nextCandidateLattice = next(bestCandidateLattice);
-        while (nextCandidateLattice != finalCandidateLattices.end()) {
-            tmp_indices.clear();
-            set_difference(nextCandidateLattice->pointOnLatticeIndices.begin(), nextCandidateLattice->pointOnLatticeIndices.end(),
-                    combinedPointIndicesOnSelectedLattices.begin(), combinedPointIndicesOnSelectedLattices.end(),
-                    back_inserter(tmp_indices));
-            uint16_t uniquelyReachedNodesCount = tmp_indices.size();
+    // point sets as bitsets, so that counting the uniquely reached points does not depend on the number of points on the lattices
+    uint32_t maxPointIndex = 0;
+    for (const candidateLattice_t& candidateLattice : finalCandidateLattices) {
+        if (!candidateLattice.pointOnLatticeIndices.empty()) {
+            maxPointIndex = max(maxPointIndex, (uint32_t)candidateLattice.pointOnLatticeIndices.back()); // sorted
+        }
+    }
+    const uint32_t wordsCount = maxPointIndex / 64 + 1;
+    selectionPointBitsets.assign((uint64_t)finalCandidateLattices.size() * wordsCount, 0);
+    for (uint32_t i = 0; i < finalCandidateLattices.size(); ++i) {
+        uint64_t* pointsOnLattice = selectionPointBitsets.data() + (uint64_t)i * wordsCount;
+        for (uint16_t pointIndex : finalCandidateLattices[i].pointOnLatticeIndices) {
+            pointsOnLattice[pointIndex / 64] |= (uint64_t)1 << (pointIndex % 64);
+        }
+    }
+    vector< uint64_t >& combinedPointsOnSelectedLattices = selectionCombinedPointBitset;
+    combinedPointsOnSelectedLattices.assign(wordsCount, 0);
+
+    // the list is compacted in place: candidates after the best one are either kept in their order, dropped, or replace the best one
+    for (uint32_t bestPosition = 0; bestPosition + 1 < selectedCandidates.size(); ++bestPosition) {
+        const candidateLattice_t* bestCandidateLattice = &finalCandidateLattices[selectedCandidates[bestPosition]];
+        const uint64_t* pointsOnBestLattice = selectionPointBitsets.data() + (uint64_t)selectedCandidates[bestPosition] * wordsCount;
+        for (uint32_t word = 0; word < wordsCount; ++word) {
+            combinedPointsOnSelectedLattices[word] |= pointsOnBestLattice[word];
+        }
+
+        uint32_t keptCount = bestPosition + 1;
+        for (uint32_t nextPosition = bestPosition + 1; nextPosition < selectedCandidates.size(); ++nextPosition) {
+            const uint32_t nextCandidateIndex = selectedCandidates[nextPosition];
+            const candidateLattice_t* nextCandidateLattice = &finalCandidateLattices[nextCandidateIndex];
+            const uint64_t* pointsOnNextLattice = selectionPointBitsets.data() + (uint64_t)nextCandidateIndex * wordsCount;
+
+            uint32_t uniquelyReachedNodesCount = 0;
+            for (uint32_t word = 0; word < wordsCount; ++word) {
+                uniquelyReachedNodesCount += popCount(pointsOnNextLattice[word] & ~combinedPointsOnSelectedLattices[word]);
+            }
             if (uniquelyReachedNodesCount >= accuracyConstants.minPointsOnLattice) { //enough new points on lattice => lattice cannot be rejected
-                ++nextCandidateLattice;
+                selectedCandidates[keptCount++] = nextCandidateIndex;
             } else if (nextCandidateLattice->pointOnLatticeIndices.size()
                     > bestCandidateLattice->pointOnLatticeIndices.size() * significantPointCountReductionFactor) { //subset of previous lattice + zero to few points; Not significantly fewer points than current lattice
                 if (
@@ -219,26 +268,19 @@ void LatticeAssembler::selectBestLattices(vector< Lattice >& assembledLattices,
                                 && nextCandidateLattice->assembledLatticeStatistics.meanRelativeDefect
                                         < bestCandidateLattice->assembledLatticeStatistics.meanRelativeDefect * significantMeanRelativeDefectReductionFactor)
                         ) {
-
-                    auto temp = next(nextCandidateLattice);
-                    finalCandidateLattices.splice(next(bestCandidateLattice), finalCandidateLattices, nextCandidateLattice);
-                    bestCandidateLattice = finalCandidateLattices.erase(bestCandidateLattice);
-                    nextCandidateLattice = temp;
-                } else {
-                    nextCandidateLattice = finalCandidateLattices.erase(nextCandidateLattice);
+                    // next lattice takes the place of the best lattice. Its points are not added to the combined points
+                    selectedCandidates[bestPosition] = nextCandidateIndex;
+                    bestCandidateLattice = nextCandidateLattice;
                 }
-            } else {
-                nextCandidateLattice = finalCandidateLattices.erase(nextCandidateLattice);
             }
         }
-        ++bestCandidateLattice;
+        selectedCandidates.resize(keptCount);
     }
 
-    assembledLattices.reserve(finalCandidateLattices.size());
-    for (auto selectedCandidateLattice = finalCandidateLattices.begin(); selectedCandidateLattice != finalCandidateLattices.end(); 
-		++selectedCandidateLattice) {
-        assembledLattices.push_back(selectedCandidateLattice->realSpaceLattice);
-        assembledLatticesStatistics.push_back(selectedCandidateLattice->assembledLatticeStatistics);
+    assembledLattices.reserve(selectedCandidates.size());
+    for (uint32_t selectedCandidateIndex : selectedCandidates) {
+        assembledLattices.push_back(finalCandidateLattices[selectedCandidateIndex].realSpaceLattice);
+        assembledLatticesStatistics.push_back(finalCandidateLattices[selectedCandidateIndex].assembledLatticeStatistics);
     }
 
 }
@@ -248,7 +290,7 @@ void LatticeAssembler::selectBestLattices(vector< Lattice >& assembledLattices,
     {
         uint16_t count = 0;
 
-        sortIndices.resize(millerIndices.cols());
+        vector<uint32_t> sortIndices(millerIndices.cols());
         iota(sortIndices.begin(), sortIndices.end(), 0);
         sort(sortIndices.begin(), sortIndices.end(), [&millerIndices](uint16_t i, uint16_t j) { return millerIndices(0, i) < millerIndices(0, j); });
 
@@ -280,15 +322,17 @@ void LatticeAssembler::selectBestLattices(vector< Lattice >& assembledLattices,
     }
 
     void LatticeAssembler::computeCandidateLattices(Matrix3Xf& candidateVectors, RowVectorXf& candidateVectorWeights,
-                                                    vector<vector<uint16_t>>& pointIndicesOnVector)
+                                                    const PointIndicesOnVectors& pointIndicesOnVector)
     {
-        // hand-crafted remove-if for three variables.
+        // hand-crafted remove-if for three variables. candidateVectorIndices maps the remaining candidate vectors to their point indices
+        candidateVectorIndices.resize(candidateVectors.cols());
+        iota(candidateVectorIndices.begin(), candidateVectorIndices.end(), 0);
         for (int i = candidateVectors.cols() - 1; i >= 0; i--)
         {
-            if (pointIndicesOnVector[i].size() < accuracyConstants.minPointsOnLattice)
+            if (pointIndicesOnVector.getPointsCount(candidateVectorIndices[i]) < accuracyConstants.minPointsOnLattice)
             {
-                pointIndicesOnVector[i] = pointIndicesOnVector.back();
-                pointIndicesOnVector.pop_back();
+                candidateVectorIndices[i] = candidateVectorIndices.back();
+                candidateVectorIndices.pop_back();
 
                 candidateVectors.col(i) = candidateVectors.col(candidateVectors.cols() - 1);
                 candidateVectors.conservativeResize(NoChange,
@@ -299,70 +343,241 @@ void LatticeAssembler::selectBestLattices(vector< Lattice >& assembledLattices,
             }
         }
 
-        // needed for easier intersection computation later
-        const auto end = pointIndicesOnVector.end();
-        for (auto it = pointIndicesOnVector.begin(); it < end; ++it)
+        int candidateVectorsCount = candidateVectors.cols();
+
+        uint32_t maxPointIndex = 0;
+        for (uint32_t vectorIndex : candidateVectorIndices)
         {
-            sort(it->begin(), it->end());
+            for (const uint16_t* pointIndex = pointIndicesOnVector.begin(vectorIndex); pointIndex != pointIndicesOnVector.end(vectorIndex); ++pointIndex)
+            {
+                maxPointIndex = max(maxPointIndex, (uint32_t)*pointIndex);
+            }
         }
+        const uint32_t wordsCount = maxPointIndex / 64 + 1;
 
-        candidateLattices.reserve(10000);
-        int candidateVectorsCount = candidateVectors.cols();
-        for (uint16_t i = 0; i < candidateVectorsCount - 2; ++i)
+        pointBitsetsOnVectors.assign((uint64_t)candidateVectorsCount * wordsCount, 0);
+        for (int i = 0; i < candidateVectorsCount; ++i)
         {
-            for (uint16_t j = (i + 1); j < candidateVectorsCount - 1; ++j)
+            const uint32_t vectorIndex = candidateVectorIndices[i];
+            uint64_t* bitset = pointBitsetsOnVectors.data() + (uint64_t)i * wordsCount;
+            for (const uint16_t* pointIndex = pointIndicesOnVector.begin(vectorIndex); pointIndex != pointIndicesOnVector.end(vectorIndex); ++pointIndex)
             {
-                for (uint16_t k = (j + 1); k < candidateVectorsCount; ++k)
+                bitset[*pointIndex / 64] |= (uint64_t)1 << (*pointIndex % 64);
+            }
+        }
+        pointBitsetsWordsCount = wordsCount;
+
+        computeCompatibleVectorPairs(candidateVectors, wordsCount);
+
+        // the triangles are enumerated in parallel, split by the first vector. Every first vector has its own candidate buffer, the buffers are
+        // concatenated in order, so the result is the same as for a serial enumeration
+        const uint32_t workersCount = workerPool.getThreadCount();
+        pointBitsetOnTwoVectors.resize((uint64_t)workersCount * wordsCount);
+        if (candidateLatticesOfFirstVector.size() < (uint32_t)candidateVectorsCount)
+        {
+            candidateLatticesOfFirstVector.resize(candidateVectorsCount);
+        }
+        candidateLatticesCountersOfFirstVector.assign(candidateVectorsCount, candidateLatticesCounters_t());
+
+        workerPool.run(candidateVectorsCount, [&](uint32_t i, uint32_t workerIndex) {
+            uint64_t* pointsOnBothVectors = pointBitsetOnTwoVectors.data() + (uint64_t)workerIndex * wordsCount;
+            computeCandidateLatticesOfFirstVector(i, candidateVectors, candidateVectorWeights, pointsOnBothVectors, candidateLatticesOfFirstVector[i],
+                                                  candidateLatticesCountersOfFirstVector[i]);
+        });
+
+        uint64_t testedTripletsCount = 0;
+        uint64_t passingDeterminantFilterCount = 0;
+        uint64_t passingPointsOnLatticeFilterCount = 0;
+        uint32_t candidateLatticesCount = 0;
+        for (int i = 0; i < candidateVectorsCount; ++i)
+        {
+            testedTripletsCount += candidateLatticesCountersOfFirstVector[i].testedTripletsCount;
+            passingDeterminantFilterCount += candidateLatticesCountersOfFirstVector[i].passingDeterminantFilterCount;
+            passingPointsOnLatticeFilterCount += candidateLatticesCountersOfFirstVector[i].passingPointsOnLatticeFilterCount;
+            candidateLatticesCount += candidateLatticesOfFirstVector[i].size();
+        }
+
+        candidateLattices.reserve(candidateLatticesCount);
+        for (int i = 0; i < candidateVectorsCount; ++i)
+        {
+            move(candidateLatticesOfFirstVector[i].begin(), candidateLatticesOfFirstVector[i].end(), back_inserter(candidateLattices));
+            candidateLatticesOfFirstVector[i].clear();
+        }
+
+        lastAssemblyStatistics.candidateVectorsCount = candidateVectorsCount;
+        lastAssemblyStatistics.testedTripletsCount = testedTripletsCount;
+        lastAssemblyStatistics.passingDeterminantFilterCount = passingDeterminantFilterCount;
+        lastAssemblyStatistics.passingPointsOnLatticeFilterCount = passingPointsOnLatticeFilterCount;
+    }
+
+    // all candidate lattices i < j < k for a fixed first vector i, in the order of j and k. Only uses data that is not modified during the enumeration, so
+    // it can be called for different i concurrently
+    void LatticeAssembler::computeCandidateLatticesOfFirstVector(uint16_t i, const Matrix3Xf& candidateVectors, const RowVectorXf& candidateVectorWeights,
+                                                                 uint64_t* pointsOnBothVectors, vector<candidateLattice_t>& newCandidateLattices,
+                                                                 candidateLatticesCounters_t& counters) const
+    {
+        const uint32_t wordsCount = pointBitsetsWordsCount;
+        const uint32_t adjacencyWordsCount = compatibleVectorsWordsCount;
+        const uint32_t minPointsOnLattice = accuracyConstants.minPointsOnLattice;
+
+        // only the triangles of the compatibility graph can pass the filters. The neighbours of every vector are the compatible vectors with a higher
+        // index, so the triangles are enumerated in the same order as all i < j < k triplets
+        const uint64_t* pointsOnVector_i = pointBitsetsOnVectors.data() + (uint64_t)i * wordsCount;
+        const uint64_t* compatibleVectors_i = compatibleVectors.data() + (uint64_t)i * adjacencyWordsCount;
+        for (uint32_t jWord = 0; jWord < adjacencyWordsCount; ++jWord)
+        {
+            for (uint64_t jBits = compatibleVectors_i[jWord]; jBits != 0; jBits &= jBits - 1)
+            {
+                const uint16_t j = jWord * 64 + countTrailingZeros(jBits);
+                const uint64_t* pointsOnVector_j = pointBitsetsOnVectors.data() + (uint64_t)j * wordsCount;
+                const uint64_t* compatibleVectors_j = compatibleVectors.data() + (uint64_t)j * adjacencyWordsCount;
+
+                // computed once per pair, the edge guarantees enough points
+                for (uint32_t word = 0; word < wordsCount; ++word)
                 {
-                    Lattice latticeToCheck(candidateVectors.col(i), candidateVectors.col(j), candidateVectors.col(k));
+                    pointsOnBothVectors[word] = pointsOnVector_i[word] & pointsOnVector_j[word];
+                }
 
-                    float absDet = abs(latticeToCheck.det());
-                    if ((absDet < determinantRange[0]) | (absDet > determinantRange[1]))
+                for (uint32_t kWord = jWord; kWord < adjacencyWordsCount; ++kWord)
+                {
+                    for (uint64_t kBits = compatibleVectors_i[kWord] & compatibleVectors_j[kWord]; kBits != 0; kBits &= kBits - 1)
                     {
-                        continue;
-                    }
+                        const uint16_t k = kWord * 64 + countTrailingZeros(kBits);
 
-                    vector<uint16_t> pointIndicesOnTwoVectors(max(pointIndicesOnVector[i].size(), pointIndicesOnVector[j].size()));
-                    auto it = set_intersection(pointIndicesOnVector[i].begin(), pointIndicesOnVector[i].end(), pointIndicesOnVector[j].begin(),
-                                               pointIndicesOnVector[j].end(), pointIndicesOnTwoVectors.begin());
-                    uint16_t pointsOnBothVectorsCount = it - pointIndicesOnTwoVectors.begin();
-                    if (pointsOnBothVectorsCount < accuracyConstants.minPointsOnLattice)
-                    {
-                        continue;
+                        Lattice latticeToCheck(candidateVectors.col(i), candidateVectors.col(j), candidateVectors.col(k));
+                        counters.testedTripletsCount++;
+
+                        float absDet = abs(latticeToCheck.det());
+                        if ((absDet < determinantRange[0]) | (absDet > determinantRange[1]))
+                        {
+                            continue;
+                        }
+                        counters.passingDeterminantFilterCount++;
+
+                        const uint64_t* pointsOnVector_k = pointBitsetsOnVectors.data() + (uint64_t)k * wordsCount;
+                        uint32_t pointsOnLatticeToCheckCount = 0;
+                        for (uint32_t word = 0; word < wordsCount; ++word)
+                        {
+                            pointsOnLatticeToCheckCount += popCount(pointsOnBothVectors[word] & pointsOnVector_k[word]);
+                        }
+                        if (pointsOnLatticeToCheckCount < minPointsOnLattice)
+                        {
+                            continue;
+                        }
+                        counters.passingPointsOnLatticeFilterCount++;
+
+                        if (latticeParametersKnown)
+                        {
+                            if (!checkLatticeParameters(latticeToCheck))
+                            {
+                                continue;
+                            }
+                        }
+
+                        newCandidateLattices.resize(newCandidateLattices.size() + 1);
+                        auto& newCandidateBasis = newCandidateLattices.back();
+                        newCandidateBasis.realSpaceLattice = latticeToCheck;
+                        newCandidateBasis.weight = candidateVectorWeights[i] + candidateVectorWeights[j] + candidateVectorWeights[k];
+                        newCandidateBasis.vectorIndices = {i, j, k};
+
+                        // back to sorted indices only for the surviving candidates
+                        auto& pointOnLatticeIndices = newCandidateBasis.pointOnLatticeIndices;
+                        pointOnLatticeIndices.clear();
+                        pointOnLatticeIndices.reserve(pointsOnLatticeToCheckCount);
+                        for (uint32_t word = 0; word < wordsCount; ++word)
+                        {
+                            for (uint64_t bits = pointsOnBothVectors[word] & pointsOnVector_k[word]; bits != 0; bits &= bits - 1)
+                            {
+                                pointOnLatticeIndices.push_back(word * 64 + countTrailingZeros(bits));
+                            }
+                        }
                     }
-                    pointIndicesOnTwoVectors.resize(pointsOnBothVectorsCount);
+                }
+            }
+        }
+    }
 
-                    vector<uint16_t> pointIndicesOnLatticeToCheck(max(pointIndicesOnTwoVectors.size(), pointIndicesOnVector[k].size()));
-                    it = set_intersection(pointIndicesOnTwoVectors.begin(), pointIndicesOnTwoVectors.end(), pointIndicesOnVector[k].begin(),
-                                          pointIndicesOnVector[k].end(), pointIndicesOnLatticeToCheck.begin());
-                    uint16_t pointsOnLatticeToCheckCount = it - pointIndicesOnLatticeToCheck.begin();
-                    if (pointsOnLatticeToCheckCount < accuracyConstants.minPointsOnLattice)
+    // Two candidate vectors are compatible, if they share at least minPointsOnLattice points and can be part of a basis with a determinant in the
+    // determinant range (|det| <= |a x b| * |c|). For known lattice parameters the bounds follow from checkLatticeParameters(): a lattice passing it has
+    // minimized basis vector norms within the tolerance of the known ones. The first minimized vector is a shortest lattice vector, so no vector of the 2D
+    // sublattice is shorter than the shortest known norm * (1 - tolerance). And one of the basis vectors lies outside the plane of the pair, so the
+    // distance of the lattice planes is at most the longest known norm * (1 + tolerance) and the area of the pair at least det divided by it
+    void LatticeAssembler::computeCompatibleVectorPairs(const Matrix3Xf& candidateVectors, uint32_t pointBitsetWordsCount)
+    {
+        const uint32_t candidateVectorsCount = candidateVectors.cols();
+        const uint32_t minPointsOnLattice = accuracyConstants.minPointsOnLattice;
+
+        compatibleVectorsWordsCount = candidateVectorsCount / 64 + 1;
+        compatibleVectors.assign((uint64_t)candidateVectorsCount * compatibleVectorsWordsCount, 0);
+
+        const float maxCandidateVectorNorm = candidateVectors.colwise().norm().maxCoeff();
+        float minPairArea = determinantRange[0] / maxCandidateVectorNorm * 0.999f;
+        float minVectorNorm = 0;
+        if (latticeParametersKnown)
+        {
+            // 0.999 absorbs float rounding
+            const float maxLatticeVectorNorm = knownLatticeParameters.head<3>().maxCoeff() * (1 + knownLatticeParametersTolerance);
+            minPairArea = max(minPairArea, determinantRange[0] / maxLatticeVectorNorm * 0.999f);
+            minVectorNorm = knownLatticeParameters.head<3>().minCoeff() * (1 - knownLatticeParametersTolerance) * 0.999f;
+        }
+
+        uint32_t compatiblePairsCount = 0;
+        for (uint32_t i = 0; i < candidateVectorsCount; ++i)
+        {
+            const uint64_t* pointsOnVector_i = pointBitsetsOnVectors.data() + (uint64_t)i * pointBitsetWordsCount;
+            uint64_t* compatibleVectors_i = compatibleVectors.data() + (uint64_t)i * compatibleVectorsWordsCount;
+            for (uint32_t j = i + 1; j < candidateVectorsCount; ++j)
+            {
+                const float pairArea = candidateVectors.col(i).cross(candidateVectors.col(j)).norm();
+                if (pairArea < minPairArea)
+                {
+                    continue;
+                }
+
+                if (latticeParametersKnown)
+                {
+                    // Gauss reduction of the 2D sublattice
+                    Vector3f u = candidateVectors.col(i), v = candidateVectors.col(j);
+                    if (u.squaredNorm() > v.squaredNorm())
                     {
-                        continue;
+                        swap(u, v);
                     }
-                    pointIndicesOnLatticeToCheck.resize(pointsOnLatticeToCheckCount);
-
-                    if (latticeParametersKnown)
+                    for (int iteration = 0; iteration < 20; ++iteration)
                     {
-                        if (!checkLatticeParameters(latticeToCheck))
+                        v -= round(u.dot(v) / u.squaredNorm()) * u;
+                        if (v.squaredNorm() >= u.squaredNorm())
                         {
-                            continue;
+                            break;
                         }
+                        swap(u, v);
+                    }
+                    if (u.norm() < minVectorNorm)
+                    {
+                        continue;
                     }
+                }
 
-                    candidateLattices.resize(candidateLattices.size() + 1);
-                    auto& newCandidateBasis = candidateLattices.back();
-                    newCandidateBasis.realSpaceLattice = latticeToCheck;
-                    newCandidateBasis.weight = candidateVectorWeights[i] + candidateVectorWeights[j] + candidateVectorWeights[k];
-                    newCandidateBasis.pointOnLatticeIndices.swap(pointIndicesOnLatticeToCheck);
-                    newCandidateBasis.vectorIndices = {i, j, k};
+                const uint64_t* pointsOnVector_j = pointBitsetsOnVectors.data() + (uint64_t)j * pointBitsetWordsCount;
+                uint32_t pointsOnBothVectorsCount = 0;
+                for (uint32_t word = 0; word < pointBitsetWordsCount; ++word)
+                {
+                    pointsOnBothVectorsCount += popCount(pointsOnVector_i[word] & pointsOnVector_j[word]);
+                }
+                if (pointsOnBothVectorsCount < minPointsOnLattice)
+                {
+                    continue;
                 }
+
+                compatibleVectors_i[j / 64] |= (uint64_t)1 << (j % 64);
+                compatiblePairsCount++;
             }
         }
+
+        lastAssemblyStatistics.compatiblePairsCount = compatiblePairsCount;
     }
 
     // clang-format off
-void LatticeAssembler::computeAssembledLatticeStatistics(candidateLattice_t& candidateLattice, const Matrix3Xf& pointsToFitInReciprocalSpace)
+void LatticeAssembler::computeAssembledLatticeStatistics(candidateLattice_t& candidateLattice, const Matrix3Xf& pointsToFitInReciprocalSpace) const
 {
     auto& pointOnLatticeIndices = candidateLattice.pointOnLatticeIndices;
     Matrix3Xf currentPointsToFitInReciprocalSpace(3, pointOnLatticeIndices.size());
@@ -413,7 +628,7 @@ void LatticeAssembler::computeAssembledLatticeStatistics(candidateLattice_t& can
     }
 
 
-    bool LatticeAssembler::checkLatticeParameters(Lattice& lattice)
+    bool LatticeAssembler::checkLatticeParameters(Lattice& lattice) const
     {
         lattice.minimize();
 
@@ -488,6 +703,8 @@ void LatticeAssembler::computeAssembledLatticeStatistics(candidateLattice_t& can
     {
         candidateLattices.clear();
         validLattices.clear();
+
+        lastAssemblyStatistics = assemblyStatistics_t();
     }
 
 //#define MEAN_SQUARED_DIST_REFINE
@@ -526,6 +743,7 @@ void LatticeAssembler::computeAssembledLatticeStatistics(candidateLattice_t& can
             millerIndicesUsedForFitting.resize(3, goodReciprocalPeaksCount);
             keepGoodReciprocalPeaks(reciprocalPeaksUsedForFitting_1_per_A, millerIndicesUsedForFitting, pointOnLatticeIndices, goodReciprocalPeaksFlags,
                                     pointsToFitInReciprocalSpace, millerIndices);
+            lastAssemblyStatistics.refinementCallsCount++;
 
 #ifdef MEAN_DIST_REFINE
             // gradient descent
@@ -606,9 +824,11 @@ void LatticeAssembler::computeAssembledLatticeStatistics(candidateLattice_t& can
             millerIndicesUsedForFitting.resize(3, goodReciprocalPeaksCount);
             keepGoodReciprocalPeaks(reciprocalPeaksUsedForFitting_1_per_A, millerIndicesUsedForFitting, pointOnLatticeIndices_junk, goodReciprocalPeaksFlags,
                                     pointsToFitInReciprocalSpace, millerIndices);
+            lastAssemblyStatistics.refinementCallsCount++;
 
             Matrix3f refinedReciprocalBasis = bestLattice.getReciprocalLattice().getBasis();
-            refineReciprocalBasis_meanDist_peaksAndAngle(refinedReciprocalBasis, millerIndicesUsedForFitting, reciprocalPeaksUsedForFitting_1_per_A);
+            lastAssemblyStatistics.levenbergMarquardtIterationsCount += refineReciprocalBasis_meanDist_peaksAndAngle_levenbergMarquardt(
+                refinedReciprocalBasis, millerIndicesUsedForFitting, reciprocalPeaksUsedForFitting_1_per_A);
 
             Lattice refinedLattice = Lattice(refinedReciprocalBasis).getReciprocalLattice();
             refinedLattice.minimize();
@@ -665,6 +885,7 @@ void LatticeAssembler::computeAssembledLatticeStatistics(candidateLattice_t& can
             millerIndicesUsedForFitting.resize(3, goodReciprocalPeaksCount);
             keepGoodReciprocalPeaks(reciprocalPeaksUsedForFitting_1_per_A, millerIndicesUsedForFitting, pointOnLatticeIndices_junk, goodReciprocalPeaksFlags,
                                     pointsToFitInReciprocalSpace, millerIndices);
+            lastAssemblyStatistics.refinementCallsCount++;
 
             Matrix3f refinedReciprocalBasis = bestLattice.getReciprocalLattice().getBasis();
             refineReciprocalBasis_meanSquaredDist_fixedBasisParameters(refinedReciprocalBasis, millerIndicesUsedForFitting,
@@ -0,0 +1,59 @@
+/*
+ * PointIndicesOnVectors.cpp
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <PointIndicesOnVectors.h>
+#include <algorithm>
+
+using namespace std;
+
+namespace xgandalf
+{
+    void PointIndicesOnVectors::assign(const vector<vector<uint16_t>>& pointIndicesOnVector)
+    {
+        offsets.resize(pointIndicesOnVector.size() + 1);
+        offsets[0] = 0;
+        for (uint32_t i = 0; i < pointIndicesOnVector.size(); ++i)
+        {
+            offsets[i + 1] = offsets[i] + pointIndicesOnVector[i].size();
+        }
+
+        pointIndices.resize(offsets.back());
+        for (uint32_t i = 0; i < pointIndicesOnVector.size(); ++i)
+        {
+            auto vectorBegin = pointIndices.begin() + offsets[i];
+            copy(pointIndicesOnVector[i].begin(), pointIndicesOnVector[i].end(), vectorBegin);
+            sort(vectorBegin, pointIndices.begin() + offsets[i + 1]);
+        }
+    }
+
+    void PointIndicesOnVectors::toVectors(vector<vector<uint16_t>>& pointIndicesOnVector) const
+    {
+        pointIndicesOnVector.resize(getVectorsCount());
+        for (uint32_t i = 0; i < getVectorsCount(); ++i)
+        {
+            pointIndicesOnVector[i].assign(begin(i), end(i));
+        }
+    }
+} // namespace xgandalf
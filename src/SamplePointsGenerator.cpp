@@ -30,8 +30,13 @@
 #include "eigenSTLContainers.h"
 #include <SamplePointsGenerator.h>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iterator>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <vector>
 
 #include <fstream>
@@ -47,11 +52,77 @@ namespace xgandalf
 
 #ifndef PRECOMPUTED_DATA_DIR
 #define PRECOMPUTED_DATA_DIR "define the path to the precomputed sample points in the cmake script"
+#endif
+#ifndef PRECOMPUTED_BINARY_DATA_DIR
+#define PRECOMPUTED_BINARY_DATA_DIR PRECOMPUTED_DATA_DIR
 #endif
 
     SamplePointsGenerator::SamplePointsGenerator()
+        : shellSamplePointsSource(ShellSamplePointsSource::precomputed)
+        , samplePointsFileChecked(false)
     {
         precomputedSamplePointsPath = STRINGIFY(PRECOMPUTED_DATA_DIR);
+        precomputedSamplePointsBinaryPath = STRINGIFY(PRECOMPUTED_BINARY_DATA_DIR);
+    }
+
+    void SamplePointsGenerator::setShellSamplePointsSource(ShellSamplePointsSource shellSamplePointsSource)
+    {
+        this->shellSamplePointsSource = shellSamplePointsSource;
+    }
+
+    SamplePointsGenerator::ShellSamplePointsSource SamplePointsGenerator::getShellSamplePointsSource() const
+    {
+        return shellSamplePointsSource;
+    }
+
+    // process wide cache of grids and mapped files. Holds only weak references, so unused entries are freed
+    typedef struct
+    {
+        mutex cacheMutex;
+        map<string, weak_ptr<const Matrix3Xf>> grids;
+        map<string, weak_ptr<const MappedFile>> samplePointsFiles;
+    } processWideCache_t;
+
+    static processWideCache_t& getProcessWideCache()
+    {
+        static processWideCache_t processWideCache;
+        return processWideCache;
+    }
+
+    // computeGrid is called without holding the lock. If two threads compute the same grid concurrently, the first inserted one is used by both
+    template <typename ComputeGrid>
+    static shared_ptr<const Matrix3Xf> getCachedGrid(const string& key, ComputeGrid computeGrid)
+    {
+        processWideCache_t& cache = getProcessWideCache();
+        {
+            lock_guard<mutex> lock(cache.cacheMutex);
+            auto it = cache.grids.find(key);
+            if (it != cache.grids.end())
+            {
+                shared_ptr<const Matrix3Xf> grid = it->second.lock();
+                if (grid)
+                {
+                    return grid;
+                }
+            }
+        }
+
+        shared_ptr<Matrix3Xf> newGrid = make_shared<Matrix3Xf>();
+        computeGrid(*newGrid);
+
+        lock_guard<mutex> lock(cache.cacheMutex);
+        for (auto it = cache.grids.begin(); it != cache.grids.end();)
+        {
+            it = it->second.expired() ? cache.grids.erase(it) : next(it);
+        }
+        weak_ptr<const Matrix3Xf>& entry = cache.grids[key];
+        shared_ptr<const Matrix3Xf> grid = entry.lock();
+        if (!grid)
+        {
+            grid = newGrid;
+            entry = grid;
+        }
+        return grid;
     }
 
     inline static float getClosestArrayElement(ArrayXf arr, float value)
@@ -61,18 +132,134 @@ namespace xgandalf
         return arr[minIndex];
     }
 
+    void SamplePointsGenerator::loadPrecomputedSamplePoints(Matrix3Xf& samplePoints, float unitPitch, float tolerance)
+    {
+        if (!samplePointsFileChecked)
+        {
+            mapSamplePointsFile();
+        }
+
+        if (samplePointsFile)
+        {
+            loadPrecomputedSamplePointsFromBinaryFile(samplePoints, unitPitch, tolerance);
+        }
+        else
+        {
+            loadPrecomputedSamplePointsFromTextFiles(samplePoints, unitPitch, tolerance);
+        }
+    }
+
+    void SamplePointsGenerator::mapSamplePointsFile()
+    {
+        samplePointsFileChecked = true;
+
+        string path = precomputedSamplePointsBinaryPath + "/" + samplePointsFileName;
+
+        processWideCache_t& cache = getProcessWideCache();
+        lock_guard<mutex> lock(cache.cacheMutex);
+        weak_ptr<const MappedFile>& cachedFile = cache.samplePointsFiles[path];
+        samplePointsFile = cachedFile.lock();
+        if (samplePointsFile)
+        {
+            return;
+        }
+
+        shared_ptr<MappedFile> file = make_shared<MappedFile>();
+        if (!file->open(path))
+        {
+            return; // fall back to the text files
+        }
+
+        const char* data = file->getData();
+        const size_t size = file->getSize();
+
+        bool valid = size >= sizeof(samplePointsFileHeader_t);
+        samplePointsFileHeader_t header;
+        if (valid)
+        {
+            memcpy(&header, data, sizeof(header));
+            valid = memcmp(header.magic, samplePointsFileMagic, sizeof(header.magic)) == 0 && header.version == samplePointsFileVersion &&
+                    header.byteOrderMark == samplePointsFileByteOrderMark && header.fileSize == size &&
+                    header.pitchesOffset + header.pitchesCount * sizeof(float) <= size &&
+                    header.tolerancesOffset + header.tolerancesCount * sizeof(float) <= size &&
+                    header.gridsOffset + header.gridsCount * sizeof(samplePointsFileGrid_t) <= size && header.pitchesOffset % sizeof(float) == 0 &&
+                    header.tolerancesOffset % sizeof(float) == 0 && header.gridsOffset % sizeof(uint64_t) == 0;
+        }
+        if (valid)
+        {
+            const samplePointsFileGrid_t* grids = reinterpret_cast<const samplePointsFileGrid_t*>(data + header.gridsOffset);
+            for (uint32_t i = 0; i < header.gridsCount; ++i)
+            {
+                valid = valid && grids[i].dataOffset % samplePointsFileAlignment == 0 && grids[i].dataOffset + 3 * sizeof(float) * grids[i].pointsCount <= size;
+            }
+        }
+
+        if (!valid)
+        {
+            stringstream errStream;
+            errStream << "File " << path << " is not a valid sample points file of version " << samplePointsFileVersion
+                      << ". Recreate it with xgandalf_convert_sample_points.";
+            throw BadInputException(errStream.str());
+        }
+
+        samplePointsFile = file;
+        cachedFile = samplePointsFile;
+    }
+
+    bool SamplePointsGenerator::isPrecomputedDataAvailable()
+    {
+        if (!samplePointsFileChecked)
+        {
+            mapSamplePointsFile();
+        }
+
+        if (samplePointsFile || pitches.size() != 0)
+        {
+            return true;
+        }
+
+        ifstream pitchesFile(precomputedSamplePointsPath + "/pitches");
+        return pitchesFile.is_open();
+    }
+
+    void SamplePointsGenerator::loadPrecomputedSamplePointsFromBinaryFile(Matrix3Xf& samplePoints, float unitPitch, float tolerance)
+    {
+        const char* data = samplePointsFile->getData();
+        const samplePointsFileHeader_t* header = reinterpret_cast<const samplePointsFileHeader_t*>(data);
+
+        Map<const Array<float, 1, Dynamic>> pitches(reinterpret_cast<const float*>(data + header->pitchesOffset), header->pitchesCount);
+        Map<const Array<float, 1, Dynamic>> tolerances(reinterpret_cast<const float*>(data + header->tolerancesOffset), header->tolerancesCount);
+        const float closestPitch = getClosestArrayElement(pitches, unitPitch);
+        const float closestTolerance = getClosestArrayElement(tolerances, tolerance);
+
+        const samplePointsFileGrid_t* grids = reinterpret_cast<const samplePointsFileGrid_t*>(data + header->gridsOffset);
+        for (uint32_t i = 0; i < header->gridsCount; ++i)
+        {
+            if (grids[i].pitch == closestPitch && grids[i].tolerance == closestTolerance)
+            {
+                samplePoints = Map<const Matrix3Xf, Aligned>(reinterpret_cast<const float*>(data + grids[i].dataOffset), 3, grids[i].pointsCount);
+                return;
+            }
+        }
+
+        stringstream errStream;
+        errStream << "No sample points for pitch " << closestPitch << " and tolerance " << closestTolerance << " in " << precomputedSamplePointsBinaryPath
+                  << "/" << samplePointsFileName;
+        throw BadInputException(errStream.str());
+    }
+
     // clang-format off
-void SamplePointsGenerator::loadPrecomputedSamplePoints(Matrix3Xf& samplePoints, float unitPitch, float tolerance)
+void SamplePointsGenerator::loadPrecomputedSamplePointsFromTextFiles(Matrix3Xf& samplePoints, float unitPitch, float tolerance)
 {
-    Array< float, 1, Eigen::Dynamic > pitches, tolerances;
-
     stringstream fullPath;
-    fullPath << precomputedSamplePointsPath << "/pitches";
-    loadEigenMatrixFromDisk(pitches, fullPath.str());
+    if (pitches.size() == 0) {
+        fullPath << precomputedSamplePointsPath << "/pitches";
+        loadEigenMatrixFromDisk(pitches, fullPath.str());
 
-    fullPath.str(string());
-    fullPath << precomputedSamplePointsPath << "/tolerances";
-    loadEigenMatrixFromDisk(tolerances, fullPath.str());
+        fullPath.str(string());
+        fullPath << precomputedSamplePointsPath << "/tolerances";
+        loadEigenMatrixFromDisk(tolerances, fullPath.str());
+    }
 
     fullPath.str(string());
     fullPath << precomputedSamplePointsPath <<
@@ -85,6 +272,54 @@ void SamplePointsGenerator::loadPrecomputedSamplePoints(Matrix3Xf& samplePoints,
     // clang-format on
 
     void SamplePointsGenerator::getDenseGrid(Matrix3Xf& samplePoints, float unitPitch, float minRadius, float maxRadius)
+    {
+        samplePoints = *getDenseGrid(unitPitch, minRadius, maxRadius);
+    }
+
+    void SamplePointsGenerator::getTightGrid(Matrix3Xf& samplePoints, float unitPitch, float tolerance, const VectorXf radii)
+    {
+        samplePoints = *getTightGrid(unitPitch, tolerance, radii);
+    }
+
+    shared_ptr<const Matrix3Xf> SamplePointsGenerator::getDenseGrid(float unitPitch, float minRadius, float maxRadius)
+    {
+        stringstream key;
+        key << "dense " << hexfloat << unitPitch << " " << minRadius << " " << maxRadius;
+
+        return getCachedGrid(key.str(), [&](Matrix3Xf& samplePoints) { computeDenseGrid(samplePoints, unitPitch, minRadius, maxRadius); });
+    }
+
+    shared_ptr<const Matrix3Xf> SamplePointsGenerator::getTightGrid(float unitPitch, float tolerance, const VectorXf& radii)
+    {
+        bool generateShells = shellSamplePointsSource == ShellSamplePointsSource::generated;
+        if (!generateShells && !isPrecomputedDataAvailable())
+        {
+            static once_flag warningFlag;
+            call_once(warningFlag, [this] {
+                cerr << "No precomputed sample points found in " << precomputedSamplePointsBinaryPath << " or " << precomputedSamplePointsPath
+                     << ". Generating them instead.\n";
+            });
+            generateShells = true;
+        }
+
+        stringstream key;
+        if (generateShells)
+        {
+            key << "tight generated " << hexfloat << unitPitch << " " << tolerance;
+        }
+        else
+        {
+            key << "tight " << precomputedSamplePointsBinaryPath << " " << precomputedSamplePointsPath << " " << hexfloat << unitPitch << " " << tolerance;
+        }
+        for (int i = 0; i < radii.size(); i++)
+        {
+            key << " " << radii[i];
+        }
+
+        return getCachedGrid(key.str(), [&](Matrix3Xf& samplePoints) { computeTightGrid(samplePoints, unitPitch, tolerance, radii, generateShells); });
+    }
+
+    void SamplePointsGenerator::computeDenseGrid(Matrix3Xf& samplePoints, float unitPitch, float minRadius, float maxRadius)
     {
         EigenSTL::vector_Vector3f tmpSamplePoints;
 
@@ -117,22 +352,81 @@ void SamplePointsGenerator::loadPrecomputedSamplePoints(Matrix3Xf& samplePoints,
         samplePoints = Map<Matrix3Xf>(tmpSamplePoints[0].data(), 3, tmpSamplePoints.size()); // copy
     }
 
-    void SamplePointsGenerator::getTightGrid(Matrix3Xf& samplePoints, float unitPitch, float tolerance, const VectorXf radii)
+    void SamplePointsGenerator::computeTightGrid(Matrix3Xf& samplePoints, float unitPitch, float tolerance, const VectorXf& radii, bool generateShells)
     {
-        samplePoints.resize(3, 0);
-
+        vector<Matrix3Xf> samplePointsPerRadius(radii.size());
+        Index samplePointsCount = 0;
         for (int i = 0; i < radii.size(); i++)
         {
             float radius = radii[i];
             float adaptedPitch = unitPitch / radii[i] * radii.maxCoeff();
 
-            Matrix3Xf newSamplingPoints;
-            loadPrecomputedSamplePoints(newSamplingPoints, adaptedPitch, tolerance);
-            newSamplingPoints *= radius;
+            if (generateShells)
+            {
+                generateSamplePointsOnShell(samplePointsPerRadius[i], adaptedPitch, tolerance);
+            }
+            else
+            {
+                loadPrecomputedSamplePoints(samplePointsPerRadius[i], adaptedPitch, tolerance);
+            }
+            samplePointsPerRadius[i] *= radius;
+            samplePointsCount += samplePointsPerRadius[i].cols();
+        }
+
+        samplePoints.resize(3, samplePointsCount);
+        Index filledCount = 0;
+        for (int i = 0; i < radii.size(); i++)
+        {
+            samplePoints.middleCols(filledCount, samplePointsPerRadius[i].cols()) = samplePointsPerRadius[i];
+            filledCount += samplePointsPerRadius[i].cols();
+        }
+    }
+
+    // Same layout as the precomputed grids (see precomputedSamplePoints/pointsOnSphericalShell_generationScript.m): a unit sphere with round(4*pi/pitch^2)
+    // points and symmetric auxiliary spheres covering the tolerance with fewer points. Instead of sampling the full sphere and discarding the lower half,
+    // the upper hemisphere is sampled directly with a Fibonacci lattice (equal area in z, golden angle in azimuth)
+    void SamplePointsGenerator::generateSamplePointsOnShell(Matrix3Xf& samplePoints, float unitPitch, float tolerance)
+    {
+        if (!(unitPitch > 0) || !(tolerance >= 0))
+        {
+            stringstream errStream;
+            errStream << "Invalid sample points pitch " << unitPitch << " or tolerance " << tolerance << ".";
+            throw BadInputException(errStream.str());
+        }
+
+        const double pi = 3.14159265358979323846;
+        const double goldenAngle = pi * (3 - sqrt(5.0));
 
-            Matrix3Xf tmp(3, samplePoints.cols() + newSamplingPoints.cols());
-            tmp << samplePoints, newSamplingPoints;
-            samplePoints = tmp;
+        const double pointsCountOnHemisphere = 2 * pi / ((double)unitPitch * unitPitch);
+        const int auxiliarySpheresCount = (int)ceil(tolerance / unitPitch);
+        const float radialPitch = auxiliarySpheresCount > 0 ? tolerance / auxiliarySpheresCount : 0;
+
+        Index samplePointsCount = (Index)round(pointsCountOnHemisphere);
+        for (int i = 1; i <= auxiliarySpheresCount; i++)
+        {
+            samplePointsCount += 2 * (Index)round(pointsCountOnHemisphere * (1 - 0.5 * i / auxiliarySpheresCount));
+        }
+        samplePoints.resize(3, samplePointsCount);
+
+        Index filledCount = 0;
+        auto addHemisphere = [&](Index pointsCount, float radius, double azimuthOffset) {
+            for (Index j = 0; j < pointsCount; j++)
+            {
+                const double z = 1 - (j + 0.5) / pointsCount;
+                const double rho = sqrt(1 - z * z);
+                const double azimuth = fmod(j * goldenAngle + azimuthOffset, 2 * pi);
+                samplePoints.col(filledCount + j) << radius * rho * cos(azimuth), radius * rho * sin(azimuth), radius * z;
+            }
+            filledCount += pointsCount;
+        };
+
+        addHemisphere((Index)round(pointsCountOnHemisphere), 1, 0);
+        // the auxiliary spheres are rotated against each other, so that their points do not lie on the same radial lines
+        for (int i = 1; i <= auxiliarySpheresCount; i++)
+        {
+            const Index adaptedPointsCount = (Index)round(pointsCountOnHemisphere * (1 - 0.5 * i / auxiliarySpheresCount));
+            addHemisphere(adaptedPointsCount, 1 - i * radialPitch, i * pi / 8);
+            addHemisphere(adaptedPointsCount, 1 + i * radialPitch, i * pi / 12);
         }
     }
-} // namespace xgandalf
\ No newline at end of file
+} // namespace xgandalf
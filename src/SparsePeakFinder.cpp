@@ -41,7 +41,6 @@ namespace xgandalf
         , binWidth(0)
         , binWidth_reciprocal(0)
         , binsPerDimension(0)
-        , binCountMinus1(0)
     {
         precomputed = false;
     }
@@ -53,6 +52,15 @@ namespace xgandalf
 
     void SparsePeakFinder::precompute(float minDistanceBetweenRealPeaks, float maxPossiblePointNorm)
     {
+        if (!(minDistanceBetweenRealPeaks > 0) || !(maxPossiblePointNorm > 0))
+        {
+            stringstream errStream;
+            errStream << "minDistanceBetweenRealPeaks and maxPossiblePointNorm must be positive." << endl;
+            errStream << "minDistanceBetweenRealPeaks = " << minDistanceBetweenRealPeaks << endl;
+            errStream << "maxPossiblePointNorm = " << maxPossiblePointNorm << endl;
+            throw BadInputException(errStream.str());
+        }
+
         this->minDistanceBetweenRealPeaks = minDistanceBetweenRealPeaks;
 
         this->minDistanceBetweenRealPeaks_squared = minDistanceBetweenRealPeaks * minDistanceBetweenRealPeaks;
@@ -60,12 +68,13 @@ namespace xgandalf
         binWidth = sqrt(minDistanceBetweenRealPeaks * minDistanceBetweenRealPeaks / 3); // minDistanceBetweenRealPeaks is diagonal of the cube
         binWidth_reciprocal = 1 / binWidth;
 
-        binsPerDimension = 2 * ceil(maxPossiblePointNorm / binWidth) + 2 + 1; //+2 for one extra border bin, where nothing should be inside.
-        binCountMinus1 = binsPerDimension * binsPerDimension * binsPerDimension - 1;
+        // only defines the bin borders, nothing is allocated per bin
+        binsPerDimension = 2 * ceil(maxPossiblePointNorm / binWidth) + 2 + 1;
         bin1Position.setConstant(-1.0f * binsPerDimension / 2 * binWidth);
-        strides << 1, binsPerDimension, binsPerDimension * binsPerDimension;
 
-        discretizationVolume.resize(binCountMinus1 + 1);
+        occupiedBins.clear(); // allocated on first use, so that copies of a precomputed peak finder stay small
+        hashTable.clear();
+        sortedBinIndices.clear();
 
         int neighboursIndex = 0;
         for (int x = -1; x <= 1; x++)
@@ -76,24 +85,29 @@ namespace xgandalf
                 {
                     if (!(x == 0 && y == 0 && z == 0))
                     {
-                        neighbourBinIndexOffsets[neighboursIndex] = x + y * strides.y() + z * strides.z();
+                        neighbourKeyOffsets[neighboursIndex] = (uint64_t)((int64_t)x + ((int64_t)z << 21) + ((int64_t)y << 42));
                         neighboursIndex++;
                     }
                 }
             }
         }
 
-        if (binsPerDimension > 200)
-        { // pow(2^23,1/3) == 200  (float 23 bit matissa)
-            stringstream errStream;
-            errStream
-                << "Created discretizationVolume is too big. Function getIndex() will not work (because of the late casting of float to uint32 in getIndex).";
-            throw BadInputException(errStream.str());
-        }
-
         precomputed = true;
     }
 
+    // returns the index in occupiedBins or -1
+    inline int32_t SparsePeakFinder::findBin(uint64_t key) const
+    {
+        for (uint32_t slot = getHashSlot(key);; slot = (slot + 1) & hashTableMask)
+        {
+            const int32_t binIndex = hashTable[slot];
+            if (binIndex < 0 || occupiedBins[binIndex].key == key)
+            {
+                return binIndex;
+            }
+        }
+    }
+
     void SparsePeakFinder::findPeaks_fast(Matrix3Xf& pointPositions, RowVectorXf& pointValues)
     {
         if (!precomputed)
@@ -103,59 +117,93 @@ namespace xgandalf
             throw WrongUsageException(errStream.str());
         }
 
-        fill(discretizationVolume.begin(), discretizationVolume.end(), bin_t({-1, numeric_limits<float>::lowest()})); // possibly with 0 faster
+        // Only occupied bins are stored, in an open addressing hash table with at most 50% load. The cost scales with the number of points
+        const uint32_t pointsCount = pointPositions.cols();
+        uint32_t hashTableSize = 16;
+        while (hashTableSize < 2 * pointsCount)
+        {
+            hashTableSize *= 2;
+        }
+        hashTableMask = hashTableSize - 1;
+        hashTableShift = 64;
+        for (uint32_t size = hashTableSize; size > 1; size /= 2)
+        {
+            hashTableShift--;
+        }
+        hashTable.assign(hashTableSize, -1);
+        occupiedBins.clear();
 
-        for (int pointIndex = 0; pointIndex < pointPositions.cols(); pointIndex++)
+        for (uint32_t pointIndex = 0; pointIndex < pointsCount; pointIndex++)
         {
-            uint32_t index = getIndex(pointPositions.col(pointIndex));
-            bin_t& currentBin = discretizationVolume[index];
-            if (pointValues[pointIndex] > currentBin.value)
+            const uint64_t key = getKey(pointPositions.col(pointIndex));
+
+            uint32_t slot = getHashSlot(key);
+            while (hashTable[slot] >= 0 && occupiedBins[hashTable[slot]].key != key)
             {
-                currentBin.value = pointValues[pointIndex];
-                currentBin.pointIndex = pointIndex;
+                slot = (slot + 1) & hashTableMask;
+            }
+
+            if (hashTable[slot] < 0)
+            {
+                hashTable[slot] = occupiedBins.size();
+                occupiedBins.push_back(bin_t({key, (int)pointIndex, pointValues[pointIndex]}));
+            }
+            else
+            {
+                bin_t& currentBin = occupiedBins[hashTable[slot]];
+                if (pointValues[pointIndex] > currentBin.value)
+                {
+                    currentBin.value = pointValues[pointIndex];
+                    currentBin.pointIndex = pointIndex;
+                }
             }
         }
 
+        // peaks are reported in the order of the bins of a dense volume (y, z, x), which is the key order
+        sortedBinIndices.resize(occupiedBins.size());
+        for (uint32_t i = 0; i < sortedBinIndices.size(); i++)
+        {
+            sortedBinIndices[i] = i;
+        }
+        sort(sortedBinIndices.begin(), sortedBinIndices.end(), [&](uint32_t i, uint32_t j) { return occupiedBins[i].key < occupiedBins[j].key; });
+
         int peakCount = 0;
-        Matrix3Xf peakPositions(3, pointPositions.cols());
-        RowVectorXf peakValues(pointValues.size());
+        Matrix3Xf peakPositions(3, occupiedBins.size());
+        RowVectorXf peakValues(occupiedBins.size());
 
-        // For not checking whether index is out of borders, an extra border bin is added. Only inner borders are checked for peaks
-        uint32_t binsPerDimensionMinus1 = binsPerDimension - 1;
-        for (uint32_t y = 1; y < binsPerDimensionMinus1; y++)
+        for (uint32_t binIndex : sortedBinIndices)
         {
-            for (uint32_t z = 1; z < binsPerDimensionMinus1; z++)
+            const bin_t& currentBin = occupiedBins[binIndex];
+            if (!isInScope(currentBin.key))
             {
-                int lineStartIndex = y * strides.y() + z * strides.z();
-                for (uint32_t x = 1; x < binsPerDimensionMinus1; x++)
+                continue;
+            }
+
+            bool isPeak = true;
+            for (int i = 0; i < 26; ++i)
+            {
+                const int32_t neighbourBinIndex = findBin(currentBin.key + neighbourKeyOffsets[i]);
+                if (neighbourBinIndex < 0)
                 {
-                    int binIndex = lineStartIndex + x;
-                    if (discretizationVolume[binIndex].value > numeric_limits<float>::lowest()) // something inside bin
-                    {
-                        bin_t* currentBin_p = &discretizationVolume[binIndex];
-                        bin_t& currentBin = *currentBin_p;
-                        bool isPeak = true;
-                        for (int i = 0; i < 26; ++i)
-                        {
-                            bin_t& neighbourBin = *(currentBin_p + neighbourBinIndexOffsets[i]);
-                            if (neighbourBin.value > currentBin.value &&
-                                (pointPositions.col(neighbourBin.pointIndex) - pointPositions.col(currentBin.pointIndex)).squaredNorm() <
-                                    minDistanceBetweenRealPeaks_squared)
-                            {
-                                isPeak = false;
-                                break;
-                            }
-                        }
-
-                        if (isPeak)
-                        {
-                            peakPositions.col(peakCount) = pointPositions.col(currentBin.pointIndex); // auf berschriebenes wird zugegriffen!!!
-                            peakValues[peakCount] = pointValues[currentBin.pointIndex];
-                            peakCount++;
-                        }
-                    }
+                    continue;
+                }
+
+                const bin_t& neighbourBin = occupiedBins[neighbourBinIndex];
+                if (neighbourBin.value > currentBin.value &&
+                    (pointPositions.col(neighbourBin.pointIndex) - pointPositions.col(currentBin.pointIndex)).squaredNorm() <
+                        minDistanceBetweenRealPeaks_squared)
+                {
+                    isPeak = false;
+                    break;
                 }
             }
+
+            if (isPeak)
+            {
+                peakPositions.col(peakCount) = pointPositions.col(currentBin.pointIndex); // auf berschriebenes wird zugegriffen!!!
+                peakValues[peakCount] = pointValues[currentBin.pointIndex];
+                peakCount++;
+            }
         }
 
         peakPositions.conservativeResize(NoChange, peakCount);
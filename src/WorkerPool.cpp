@@ -0,0 +1,268 @@
+/*
+ * WorkerPool.cpp
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <WorkerPool.h>
+#include <algorithm>
+
+using namespace std;
+
+namespace xgandalf
+{
+    // pools executing tasks on this thread, innermost first. Used to detect nested calls, also through other pools
+    struct activeRun_t
+    {
+        const WorkerPool* pool;
+        uint32_t workerIndex;
+        const activeRun_t* previous;
+    };
+    static thread_local const activeRun_t* activeRun = nullptr;
+
+    // registers a run for the lifetime of the guard and restores the previous state on every exit, including exceptions
+    class ActiveRunGuard
+    {
+      public:
+        ActiveRunGuard(const WorkerPool* pool, uint32_t workerIndex)
+        {
+            run.pool = pool;
+            run.workerIndex = workerIndex;
+            run.previous = activeRun;
+            activeRun = &run;
+        }
+        ~ActiveRunGuard()
+        {
+            activeRun = run.previous;
+        }
+
+      private:
+        ActiveRunGuard(const ActiveRunGuard&);
+        ActiveRunGuard& operator=(const ActiveRunGuard&);
+
+        activeRun_t run;
+    };
+
+    static const activeRun_t* findActiveRun(const WorkerPool* pool)
+    {
+        for (const activeRun_t* run = activeRun; run != nullptr; run = run->previous)
+        {
+            if (run->pool == pool)
+            {
+                return run;
+            }
+        }
+        return nullptr;
+    }
+
+    WorkerPool::WorkerPool()
+        : WorkerPool(1)
+    {
+    }
+
+    WorkerPool::WorkerPool(uint32_t threadCount)
+        : threadCount(1)
+        , stopRequested(false)
+        , generation(0)
+        , busyWorkersCount(0)
+        , currentTask(nullptr)
+        , currentTaskCount(0)
+        , nextTaskIndex(0)
+    {
+        setThreadCount(threadCount);
+    }
+
+    WorkerPool::WorkerPool(const WorkerPool& other)
+        : WorkerPool(other.threadCount)
+    {
+    }
+
+    WorkerPool& WorkerPool::operator=(const WorkerPool& other)
+    {
+        if (this != &other)
+        {
+            setThreadCount(other.threadCount);
+        }
+        return *this;
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        stopThreads();
+    }
+
+    void WorkerPool::setThreadCount(uint32_t threadCount)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = max(1u, thread::hardware_concurrency());
+        }
+
+        if (threadCount != this->threadCount)
+        {
+            stopThreads();
+            this->threadCount = threadCount;
+        }
+    }
+
+    uint32_t WorkerPool::getThreadCount() const
+    {
+        return threadCount;
+    }
+
+    void WorkerPool::run(uint32_t taskCount, const function<void(uint32_t taskIndex, uint32_t workerIndex)>& task)
+    {
+        const activeRun_t* nestedRun = findActiveRun(this);
+        if (nestedRun != nullptr)
+        {
+            for (uint32_t taskIndex = 0; taskIndex < taskCount; ++taskIndex)
+            {
+                task(taskIndex, nestedRun->workerIndex);
+            }
+            return;
+        }
+
+        if (threadCount == 1 || taskCount <= 1)
+        {
+            ActiveRunGuard guard(this, 0);
+            for (uint32_t taskIndex = 0; taskIndex < taskCount; ++taskIndex)
+            {
+                task(taskIndex, 0);
+            }
+            return;
+        }
+
+        if (threads.empty())
+        {
+            startThreads();
+        }
+
+        {
+            lock_guard<std::mutex> lock(mutex);
+            currentTask = &task;
+            currentTaskCount = taskCount;
+            nextTaskIndex = 0;
+            firstException = nullptr;
+            busyWorkersCount = threads.size();
+            generation++;
+        }
+        workAvailable.notify_all();
+
+        work(0);
+
+        exception_ptr exception;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            workDone.wait(lock, [this] { return busyWorkersCount == 0; });
+            currentTask = nullptr;
+            exception = firstException;
+            firstException = nullptr;
+        }
+
+        if (exception)
+        {
+            rethrow_exception(exception);
+        }
+    }
+
+    void WorkerPool::startThreads()
+    {
+        threads.reserve(threadCount - 1);
+        for (uint32_t workerIndex = 1; workerIndex < threadCount; ++workerIndex)
+        {
+            threads.emplace_back(&WorkerPool::workerLoop, this, workerIndex, generation);
+        }
+    }
+
+    void WorkerPool::stopThreads()
+    {
+        if (threads.empty())
+        {
+            return;
+        }
+
+        {
+            lock_guard<std::mutex> lock(mutex);
+            stopRequested = true;
+        }
+        workAvailable.notify_all();
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        threads.clear();
+        stopRequested = false;
+    }
+
+    void WorkerPool::workerLoop(uint32_t workerIndex, uint64_t startGeneration)
+    {
+        uint64_t seenGeneration = startGeneration;
+        while (true)
+        {
+            {
+                unique_lock<std::mutex> lock(mutex);
+                workAvailable.wait(lock, [&] { return stopRequested || generation != seenGeneration; });
+                if (stopRequested)
+                {
+                    return;
+                }
+                seenGeneration = generation;
+            }
+
+            work(workerIndex);
+
+            bool lastWorker;
+            {
+                lock_guard<std::mutex> lock(mutex);
+                lastWorker = (--busyWorkersCount == 0);
+            }
+            if (lastWorker)
+            {
+                workDone.notify_one();
+            }
+        }
+    }
+
+    void WorkerPool::work(uint32_t workerIndex)
+    {
+        ActiveRunGuard guard(this, workerIndex);
+
+        uint32_t taskIndex;
+        while ((taskIndex = nextTaskIndex.fetch_add(1)) < currentTaskCount)
+        {
+            try
+            {
+                (*currentTask)(taskIndex, workerIndex);
+            }
+            catch (...)
+            {
+                lock_guard<std::mutex> lock(mutex);
+                if (!firstException)
+                {
+                    firstException = current_exception();
+                }
+                nextTaskIndex = currentTaskCount; // hand out no further tasks
+            }
+        }
+    }
+} // namespace xgandalf
@@ -112,6 +112,22 @@ namespace xgandalf
         indexerPlain->setGradientDescentIterationsCount(iterationsCount);
     }
 
+    extern "C" void IndexerPlain_setSamplingStrategy(IndexerPlain* indexerPlain, samplingStrategy_t samplingStrategy)
+    {
+        IndexerPlain::SamplingStrategy strategy;
+        switch (samplingStrategy)
+        {
+            case SAMPLING_STRATEGY_coarseToFine:
+                strategy = IndexerPlain::SamplingStrategy::coarseToFine;
+                break;
+            default:
+                strategy = IndexerPlain::SamplingStrategy::uniform;
+                break;
+        }
+
+        indexerPlain->setSamplingStrategy(strategy);
+    }
+
     extern "C" void IndexerPlain_setRefineWithExactLattice(IndexerPlain* indexerPlain, int flag)
     {
         indexerPlain->setRefineWithExactLattice((bool)flag);
@@ -124,6 +140,14 @@ namespace xgandalf
 
     extern "C" void IndexerPlain_index(IndexerPlain* indexerPlain, Lattice_t* assembledLattices, int* assembledLatticesCount, int maxAssambledLatticesCount,
                                        reciprocalPeaks_1_per_A_t reciprocalPeaks_1_per_A, int* peakCountOnLattices)
+    {
+        IndexerPlain_indexWithStatistics(indexerPlain, assembledLattices, assembledLatticesCount, maxAssambledLatticesCount, reciprocalPeaks_1_per_A,
+                                         peakCountOnLattices, NULL);
+    }
+
+    extern "C" void IndexerPlain_indexWithStatistics(IndexerPlain* indexerPlain, Lattice_t* assembledLattices, int* assembledLatticesCount,
+                                                     int maxAssambledLatticesCount, reciprocalPeaks_1_per_A_t reciprocalPeaks_1_per_A, int* peakCountOnLattices,
+                                                     indexingStatistics_t* indexingStatistics)
     {
         Eigen::Matrix3Xf reciprocalPeaks_1_per_A_matrix(3, reciprocalPeaks_1_per_A.peakCount);
         for (int i = 0; i < reciprocalPeaks_1_per_A.peakCount; i++)
@@ -134,7 +158,41 @@ namespace xgandalf
 
         std::vector<Lattice> assembledLatticesVector;
         std::vector<int> peakCountOnLatticesVector;
-        indexerPlain->index(assembledLatticesVector, reciprocalPeaks_1_per_A_matrix, peakCountOnLatticesVector);
+        IndexerPlain::IndexingStatistics statistics;
+        indexerPlain->index(assembledLatticesVector, reciprocalPeaks_1_per_A_matrix, peakCountOnLatticesVector, statistics);
+
+        if (indexingStatistics != NULL)
+        {
+            indexingStatistics->coarseSamplingTime_s = statistics.coarseSamplingTime_s;
+            indexingStatistics->globalHillClimbingTime_s = statistics.globalHillClimbingTime_s;
+            indexingStatistics->additionalGlobalHillClimbingTime_s = statistics.additionalGlobalHillClimbingTime_s;
+            indexingStatistics->peakFindingTime_s = statistics.peakFindingTime_s;
+            indexingStatistics->peaksHillClimbingTime_s = statistics.peaksHillClimbingTime_s;
+            indexingStatistics->latticeAssemblyTime_s = statistics.latticeAssemblyTime_s;
+            indexingStatistics->totalTime_s = statistics.totalTime_s;
+
+            indexingStatistics->reciprocalPeaksCount = statistics.reciprocalPeaksCount;
+            indexingStatistics->usedReciprocalPeaksCount = statistics.usedReciprocalPeaksCount;
+            indexingStatistics->hillClimbingSamplePointsCount = statistics.hillClimbingSamplePointsCount;
+            indexingStatistics->transformCallsCount = statistics.transformCallsCount;
+            indexingStatistics->evaluatedSamplePointsCount = statistics.evaluatedSamplePointsCount;
+            indexingStatistics->foundPeaksCount = statistics.foundPeaksCount;
+            indexingStatistics->keptPeaksCount = statistics.keptPeaksCount;
+
+            const LatticeAssembler::assemblyStatistics_t& assemblyStatistics = statistics.latticeAssemblyStatistics;
+            indexingStatistics->candidateVectorsCount = assemblyStatistics.candidateVectorsCount;
+            indexingStatistics->compatiblePairsCount = assemblyStatistics.compatiblePairsCount;
+            indexingStatistics->testedTripletsCount = assemblyStatistics.testedTripletsCount;
+            indexingStatistics->passingDeterminantFilterCount = assemblyStatistics.passingDeterminantFilterCount;
+            indexingStatistics->passingPointsOnLatticeFilterCount = assemblyStatistics.passingPointsOnLatticeFilterCount;
+            indexingStatistics->passingLatticeParametersFilterCount = assemblyStatistics.passingLatticeParametersFilterCount;
+            indexingStatistics->passingGlobalWeightFilterCount = assemblyStatistics.passingGlobalWeightFilterCount;
+            indexingStatistics->passingLocalWeightFilterCount = assemblyStatistics.passingLocalWeightFilterCount;
+            indexingStatistics->passingRelativeDefectFilterCount = assemblyStatistics.passingRelativeDefectFilterCount;
+            indexingStatistics->selectedLatticesCount = assemblyStatistics.selectedLatticesCount;
+            indexingStatistics->refinementCallsCount = assemblyStatistics.refinementCallsCount;
+            indexingStatistics->levenbergMarquardtIterationsCount = assemblyStatistics.levenbergMarquardtIterationsCount;
+        }
 
         for (*assembledLatticesCount = 0;
              (size_t)*assembledLatticesCount < assembledLatticesVector.size() && *assembledLatticesCount < maxAssambledLatticesCount;
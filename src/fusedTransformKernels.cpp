@@ -0,0 +1,138 @@
+/*
+ * fusedTransformKernels.cpp
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fusedTransformKernels.h>
+
+#if defined(XGANDALF_SIMD_KERNELS) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace xgandalf
+{
+    typedef enum
+    {
+        kernel_none,
+        kernel_avx2,
+        kernel_avx512
+    } fusedTransformKernel_t;
+
+    static fusedTransformKernel_t detectFusedTransformKernel()
+    {
+#if defined(XGANDALF_SIMD_KERNELS) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            return kernel_avx512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return kernel_avx2;
+        }
+#elif defined(XGANDALF_SIMD_KERNELS) && defined(_MSC_VER)
+        int cpuInfo[4];
+        __cpuid(cpuInfo, 1);
+        const bool osxsave = (cpuInfo[2] & (1 << 27)) != 0;
+        const bool fma = (cpuInfo[2] & (1 << 12)) != 0;
+        if (!osxsave)
+        {
+            return kernel_none;
+        }
+        const unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(cpuInfo, 7, 0);
+        const bool avx2 = (cpuInfo[1] & (1 << 5)) != 0;
+        const bool avx512f = (cpuInfo[1] & (1 << 16)) != 0;
+
+        if (avx512f && (xcr0 & 0xe6) == 0xe6)
+        {
+            return kernel_avx512;
+        }
+        if (avx2 && fma && (xcr0 & 0x6) == 0x6)
+        {
+            return kernel_avx2;
+        }
+#endif
+        return kernel_none;
+    }
+
+    // the environment variable XGANDALF_FUSED_TRANSFORM_KERNEL (none, avx2) can restrict the selected kernel, e.g. for comparisons
+    static fusedTransformKernel_t selectFusedTransformKernel()
+    {
+        fusedTransformKernel_t kernel = detectFusedTransformKernel();
+
+        const char* restriction = getenv("XGANDALF_FUSED_TRANSFORM_KERNEL");
+        if (restriction != NULL)
+        {
+            if (strcmp(restriction, "none") == 0)
+            {
+                kernel = kernel_none;
+            }
+            else if (strcmp(restriction, "avx2") == 0 && kernel == kernel_avx512)
+            {
+                kernel = kernel_avx2;
+            }
+        }
+
+        return kernel;
+    }
+
+    static fusedTransformKernel_t getFusedTransformKernel()
+    {
+        static const fusedTransformKernel_t kernel = selectFusedTransformKernel();
+        return kernel;
+    }
+
+    uint32_t getFusedTransformTileWidth()
+    {
+        switch (getFusedTransformKernel())
+        {
+            case kernel_avx512:
+                return 16;
+            case kernel_avx2:
+                return 8;
+            default:
+                return 0;
+        }
+    }
+
+    void performFusedTransform(const fusedTransformArguments_t& arguments)
+    {
+        switch (getFusedTransformKernel())
+        {
+#ifdef XGANDALF_SIMD_KERNELS
+            case kernel_avx512:
+                performFusedTransform_avx512(arguments);
+                break;
+            case kernel_avx2:
+                performFusedTransform_avx2(arguments);
+                break;
+#endif
+            default:
+                break;
+        }
+    }
+} // namespace xgandalf
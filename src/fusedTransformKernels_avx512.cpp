@@ -0,0 +1,134 @@
+/*
+ * fusedTransformKernels_avx512.cpp
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// compiled with AVX-512F enabled, only called after a runtime check of the CPU features
+
+#include "fusedTransformKernels_impl.h"
+#include <immintrin.h>
+
+namespace xgandalf
+{
+    namespace fusedTransformKernels
+    {
+        struct avx512
+        {
+            typedef __m512 vfloat;
+            typedef __mmask16 vmask;
+            static const uint32_t width = 16;
+
+            static inline vfloat set1(float a)
+            {
+                return _mm512_set1_ps(a);
+            }
+            static inline vfloat zero()
+            {
+                return _mm512_setzero_ps();
+            }
+            static inline vfloat load(const float* a)
+            {
+                return _mm512_loadu_ps(a);
+            }
+            static inline void store(float* a, vfloat b)
+            {
+                _mm512_storeu_ps(a, b);
+            }
+            static inline vfloat add(vfloat a, vfloat b)
+            {
+                return _mm512_add_ps(a, b);
+            }
+            static inline vfloat sub(vfloat a, vfloat b)
+            {
+                return _mm512_sub_ps(a, b);
+            }
+            static inline vfloat mul(vfloat a, vfloat b)
+            {
+                return _mm512_mul_ps(a, b);
+            }
+            static inline vfloat div(vfloat a, vfloat b)
+            {
+                return _mm512_div_ps(a, b);
+            }
+            static inline vfloat fmadd(vfloat a, vfloat b, vfloat c) // a * b + c
+            {
+                return _mm512_fmadd_ps(a, b, c);
+            }
+            static inline vfloat negate(vfloat a)
+            {
+                return _mm512_sub_ps(_mm512_setzero_ps(), a);
+            }
+            static inline vfloat abs(vfloat a)
+            {
+                return _mm512_abs_ps(a);
+            }
+            static inline vfloat round(vfloat a)
+            {
+                return _mm512_maskz_roundscale_ps(0xFFFF, a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            }
+            static inline vfloat floor(vfloat a)
+            {
+                return _mm512_maskz_roundscale_ps(0xFFFF, a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+            }
+
+            static inline vmask lt(vfloat a, vfloat b)
+            {
+                return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+            }
+            static inline vmask gt(vfloat a, vfloat b)
+            {
+                return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ);
+            }
+            static inline vmask eq(vfloat a, vfloat b)
+            {
+                return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ);
+            }
+            static inline vmask maskOr(vmask a, vmask b)
+            {
+                return _mm512_kor(a, b);
+            }
+            static inline uint32_t movemask(vmask a)
+            {
+                return (uint32_t)a;
+            }
+
+            static inline vfloat select(vmask m, vfloat a) // m ? a : 0
+            {
+                return _mm512_maskz_mov_ps(m, a);
+            }
+            static inline vfloat blend(vmask m, vfloat a, vfloat b) // m ? a : b
+            {
+                return _mm512_mask_blend_ps(m, b, a);
+            }
+            static inline vfloat negateWhere(vmask m, vfloat a) // m ? -a : a
+            {
+                return _mm512_mask_sub_ps(a, m, _mm512_setzero_ps(), a);
+            }
+        };
+    } // namespace fusedTransformKernels
+
+    void performFusedTransform_avx512(const fusedTransformArguments_t& arguments)
+    {
+        fusedTransformKernels::performFusedTransform<fusedTransformKernels::avx512>(arguments);
+    }
+} // namespace xgandalf
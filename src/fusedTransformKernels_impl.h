@@ -0,0 +1,276 @@
+/*
+ * fusedTransformKernels_impl.h
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FUSEDTRANSFORMKERNELS_IMPL_H_
+#define FUSEDTRANSFORMKERNELS_IMPL_H_
+
+// Instruction set independent part of the fused transform. Included by the kernel translation units, which provide a SIMD type V with static inline
+// functions. Only to be included from there (see the note in fusedTransformKernels.h).
+
+#include <fusedTransformKernels.h>
+
+namespace xgandalf
+{
+    namespace fusedTransformKernels
+    {
+        template <typename V>
+        static inline typename V::vfloat powInt(typename V::vfloat base, int exponent)
+        {
+            typename V::vfloat result = V::set1(1);
+            for (int i = 0; i < exponent; ++i)
+            {
+                result = V::mul(result, base);
+            }
+            return result;
+        }
+
+        // sin(2*pi*x) and cos(2*pi*x) for x in [-0.5, 0.5]. Reduction to one octant and minimax polynomials. The accurate version (cephes) has a max error
+        // of about 1 ulp, the fast version a max error of about 1e-6 for the sine and 1.2e-5 for the cosine
+        template <typename V, bool fastTrigonometry>
+        static inline void sincos2pi(typename V::vfloat x, typename V::vfloat& sine, typename V::vfloat& cosine)
+        {
+            typedef typename V::vfloat vfloat;
+            typedef typename V::vmask vmask;
+
+            const vfloat quadrant = V::round(V::mul(x, V::set1(4))); // in {-2, -1, 0, 1, 2}
+            const vfloat t = V::fmadd(quadrant, V::set1(-0.25f), x);  // in [-1/8, 1/8]
+            const vfloat angle = V::mul(t, V::set1(6.28318530717958647692f));
+            const vfloat angle2 = V::mul(angle, angle);
+
+            vfloat s, c;
+            if (fastTrigonometry)
+            {
+                s = V::fmadd(angle2, V::set1(8.152991817e-3f), V::set1(-1.666283378e-1f));
+                s = V::fmadd(V::mul(s, angle2), angle, angle);
+
+                c = V::fmadd(angle2, V::set1(4.048893209e-2f), V::set1(-4.997763056e-1f));
+                c = V::fmadd(c, angle2, V::set1(1));
+            }
+            else
+            {
+                s = V::fmadd(angle2, V::set1(-1.9515295891e-4f), V::set1(8.3321608736e-3f));
+                s = V::fmadd(s, angle2, V::set1(-1.6666654611e-1f));
+                s = V::fmadd(V::mul(s, angle2), angle, angle);
+
+                c = V::fmadd(angle2, V::set1(2.443315711809948e-5f), V::set1(-1.388731625493765e-3f));
+                c = V::fmadd(c, angle2, V::set1(4.166664568298827e-2f));
+                c = V::fmadd(V::mul(c, angle2), angle2, V::fmadd(angle2, V::set1(-0.5f), V::set1(1)));
+            }
+
+            // quadrant modulo 4 in {0, 1, 2, 3}
+            const vfloat k = V::sub(quadrant, V::mul(V::set1(4), V::floor(V::mul(quadrant, V::set1(0.25f)))));
+            const vmask isK1 = V::eq(k, V::set1(1));
+            const vmask isK2 = V::eq(k, V::set1(2));
+            const vmask isK3 = V::eq(k, V::set1(3));
+            const vmask swap = V::maskOr(isK1, isK3);
+
+            sine = V::negateWhere(V::maskOr(isK2, isK3), V::blend(swap, c, s));
+            cosine = V::negateWhere(V::maskOr(isK1, isK2), V::blend(swap, s, c));
+        }
+
+        // with evaluationOnly, the slope and the gradients are not computed at all
+        template <typename V, bool fastTrigonometry, bool evaluationOnly>
+        static inline void performFusedTransform_trigonometry(const fusedTransformArguments_t& a)
+        {
+            typedef typename V::vfloat vfloat;
+            typedef typename V::vmask vmask;
+            const uint32_t tileWidth = V::width;
+
+            const float pointsCount_inverse = 1 / (float)a.pointsCount;
+            const vfloat threshold = V::set1(a.closeToPointThreshold);
+            const vfloat slopeScaling = V::set1(-a.slopeScaling);
+            const vfloat one = V::set1(1);
+
+            float tileBuffer[8][fusedTransformMaxTileWidth];
+
+            const uint32_t tilesCount = (a.positionsCount + tileWidth - 1) / tileWidth;
+            for (uint32_t tileIndex = 0; tileIndex < tilesCount; ++tileIndex)
+            {
+                const uint32_t firstPosition = tileIndex * tileWidth;
+                const uint32_t tilePositionsCount = (a.positionsCount - firstPosition < tileWidth) ? a.positionsCount - firstPosition : tileWidth;
+                const uint32_t validLanes = (1u << tilePositionsCount) - 1;
+
+                for (uint32_t i = 0; i < tileWidth; ++i)
+                {
+                    const float* position = a.positionsToEvaluate + 3 * (firstPosition + (i < tilePositionsCount ? i : 0));
+                    tileBuffer[0][i] = position[0];
+                    tileBuffer[1][i] = position[1];
+                    tileBuffer[2][i] = position[2];
+                }
+                const vfloat positionX = V::load(tileBuffer[0]);
+                const vfloat positionY = V::load(tileBuffer[1]);
+                const vfloat positionZ = V::load(tileBuffer[2]);
+
+                vfloat gradientX = V::zero(), gradientY = V::zero(), gradientZ = V::zero();
+                vfloat fullGradientX = V::zero(), fullGradientY = V::zero(), fullGradientZ = V::zero();
+                vfloat evaluation = V::zero();
+                vfloat count = V::zero();
+
+                uint16_t* closeToPointMasks = (a.closeToPointMasks != nullptr) ? a.closeToPointMasks + (uint64_t)tileIndex * a.pointsCount : nullptr;
+
+                for (uint32_t pointIndex = 0; pointIndex < a.pointsCount; ++pointIndex)
+                {
+                    const float* point = a.pointsToTransform + 3 * pointIndex;
+                    const vfloat pointX = V::set1(point[0]);
+                    const vfloat pointY = V::set1(point[1]);
+                    const vfloat pointZ = V::set1(point[2]);
+                    const vfloat weight = V::set1(a.pointsToTransformWeights[pointIndex]);
+
+                    const vfloat x = V::fmadd(pointX, positionX, V::fmadd(pointY, positionY, V::mul(pointZ, positionZ)));
+                    const vfloat reducedX = V::sub(x, V::round(x));
+
+                    vfloat functionEvaluation, slope;
+                    vmask closeToPoint;
+                    if (a.functionSelection == 1)
+                    {
+                        vfloat sine, cosine;
+                        sincos2pi<V, fastTrigonometry>(reducedX, sine, cosine);
+                        const vfloat cosinePower = powInt<V>(cosine, a.exponent - 1);
+                        functionEvaluation = V::mul(cosinePower, cosine);
+                        if (!evaluationOnly)
+                        {
+                            slope = V::mul(V::mul(slopeScaling, sine), cosinePower);
+                        }
+                        closeToPoint = V::gt(functionEvaluation, threshold);
+                    }
+                    else
+                    {
+                        const vfloat absX = V::abs(reducedX);
+                        const vfloat base = V::fmadd(absX, V::set1(-2), one);
+                        const vfloat basePower = powInt<V>(base, a.exponent - 1);
+                        functionEvaluation = V::fmadd(V::mul(basePower, base), V::set1(2), V::set1(-1));
+                        if (!evaluationOnly)
+                        {
+                            slope = V::div(V::mul(V::negate(reducedX), basePower), V::add(absX, V::set1(0.0001f)));
+                        }
+                        closeToPoint = V::lt(absX, threshold);
+                    }
+
+                    if (evaluationOnly)
+                    {
+                        evaluation = V::fmadd(weight, a.localTransform ? V::select(closeToPoint, functionEvaluation) : functionEvaluation, evaluation);
+                    }
+                    else if (a.localTransform)
+                    {
+                        const vfloat weightedSlope = V::mul(weight, slope);
+                        fullGradientX = V::fmadd(pointX, weightedSlope, fullGradientX);
+                        fullGradientY = V::fmadd(pointY, weightedSlope, fullGradientY);
+                        fullGradientZ = V::fmadd(pointZ, weightedSlope, fullGradientZ);
+
+                        const vfloat weightedSlope_close = V::select(closeToPoint, weightedSlope);
+                        gradientX = V::fmadd(pointX, weightedSlope_close, gradientX);
+                        gradientY = V::fmadd(pointY, weightedSlope_close, gradientY);
+                        gradientZ = V::fmadd(pointZ, weightedSlope_close, gradientZ);
+                        evaluation = V::fmadd(weight, V::select(closeToPoint, functionEvaluation), evaluation);
+                    }
+                    else
+                    {
+                        const vfloat weightedSlope = V::mul(weight, slope);
+                        gradientX = V::fmadd(pointX, weightedSlope, gradientX);
+                        gradientY = V::fmadd(pointY, weightedSlope, gradientY);
+                        gradientZ = V::fmadd(pointZ, weightedSlope, gradientZ);
+                        evaluation = V::fmadd(weight, functionEvaluation, evaluation);
+                    }
+                    count = V::add(count, V::select(closeToPoint, one));
+
+                    if (closeToPointMasks != nullptr)
+                    {
+                        closeToPointMasks[pointIndex] = (uint16_t)(V::movemask(closeToPoint) & validLanes);
+                    }
+                }
+
+                // normalization, as in the unfused transform
+                const vfloat pointsCount_inverse_v = V::set1(pointsCount_inverse);
+                V::store(tileBuffer[3], V::mul(evaluation, V::set1(a.inverseTransformEvaluationScalingFactor)));
+                V::store(tileBuffer[4], V::mul(count, pointsCount_inverse_v));
+                for (uint32_t i = 0; i < tilePositionsCount; ++i)
+                {
+                    a.inverseTransformEvaluation[firstPosition + i] = tileBuffer[3][i];
+                    a.closeToPointsCount[firstPosition + i] = tileBuffer[4][i];
+                }
+
+                if (evaluationOnly)
+                {
+                    continue;
+                }
+
+                if (a.localTransform)
+                {
+                    const vmask hasCloseToPoints = V::gt(count, V::zero());
+                    const vfloat factor = V::blend(hasCloseToPoints, V::div(one, V::blend(hasCloseToPoints, count, one)), pointsCount_inverse_v);
+                    gradientX = V::mul(V::blend(hasCloseToPoints, gradientX, fullGradientX), factor);
+                    gradientY = V::mul(V::blend(hasCloseToPoints, gradientY, fullGradientY), factor);
+                    gradientZ = V::mul(V::blend(hasCloseToPoints, gradientZ, fullGradientZ), factor);
+                }
+                else
+                {
+                    gradientX = V::mul(gradientX, pointsCount_inverse_v);
+                    gradientY = V::mul(gradientY, pointsCount_inverse_v);
+                    gradientZ = V::mul(gradientZ, pointsCount_inverse_v);
+                }
+
+                V::store(tileBuffer[0], gradientX);
+                V::store(tileBuffer[1], gradientY);
+                V::store(tileBuffer[2], gradientZ);
+                for (uint32_t i = 0; i < tilePositionsCount; ++i)
+                {
+                    float* gradient = a.gradient + 3 * (firstPosition + i);
+                    gradient[0] = tileBuffer[0][i];
+                    gradient[1] = tileBuffer[1][i];
+                    gradient[2] = tileBuffer[2][i];
+                }
+            }
+        }
+
+        template <typename V>
+        static inline void performFusedTransform(const fusedTransformArguments_t& a)
+        {
+            if (a.evaluationOnly)
+            {
+                if (a.fastTrigonometry)
+                {
+                    performFusedTransform_trigonometry<V, true, true>(a);
+                }
+                else
+                {
+                    performFusedTransform_trigonometry<V, false, true>(a);
+                }
+            }
+            else
+            {
+                if (a.fastTrigonometry)
+                {
+                    performFusedTransform_trigonometry<V, true, false>(a);
+                }
+                else
+                {
+                    performFusedTransform_trigonometry<V, false, false>(a);
+                }
+            }
+        }
+    } // namespace fusedTransformKernels
+} // namespace xgandalf
+
+#endif /* FUSEDTRANSFORMKERNELS_IMPL_H_ */
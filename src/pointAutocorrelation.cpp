@@ -25,111 +25,215 @@
  * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <ctype.h>
 #include <pointAutocorrelation.h>
+#include <vector>
 
 namespace xgandalf
 {
     using namespace std;
     using namespace Eigen;
 
-    void getPointAutocorrelation(Matrix3Xf& autocorrelationPoints, const Matrix3Xf& points, float minNormInAutocorrelation, float maxNormInAutocorrelation)
+    namespace
     {
-        uint32_t N = points.cols();
-        uint32_t n = N - 1;
-        uint32_t maxAutocorrPointsCount = n * (n + 1) / 2;
-
-        float maxNormInAutocorrelation_squared = maxNormInAutocorrelation * maxNormInAutocorrelation;
-        float minNormInAutocorrelation_squared = minNormInAutocorrelation * minNormInAutocorrelation;
-
-        autocorrelationPoints.resize(3, maxAutocorrPointsCount);
+        typedef struct
+        {
+            vector<float> differences; // x, y, z of every retained pair
+            vector<uint32_t> centerPointIndices;
+            vector<uint32_t> shiftedPointIndices;
+        } autocorrelationBlock_t;
 
-        uint32_t autocorrelationPointsCount = 0;
+        const uint32_t centerPointsPerBlock = 64;
+        const uint64_t cellCoordinateMask = (1 << 21) - 1;
 
-        for (uint32_t i = 0; i < N; ++i)
+        // 21 bits per dimension. Coordinates start at 1, so that the neighbouring cells of all cells have non-negative coordinates
+        inline uint64_t getCellKey(uint64_t x, uint64_t y, uint64_t z)
         {
-            uint32_t addedNodesInIteration = n - i;
-
-            autocorrelationPoints.block(0, autocorrelationPointsCount, 3, addedNodesInIteration) =
-                points.block(0, i + 1, 3, N - i - 1).colwise() - points.col(i);
+            return x | (y << 21) | (z << 42);
+        }
 
-            for (uint32_t j = autocorrelationPointsCount, k = i + 1; j < autocorrelationPointsCount + addedNodesInIteration; ++j, ++k)
+        class AutocorrelationGrid
+        {
+          public:
+            AutocorrelationGrid(const Matrix3Xf& points, float cellWidth)
             {
-                if (autocorrelationPoints(2, j) < 0)
+                const uint32_t pointsCount = points.cols();
+                gridOrigin = pointsCount > 0 ? Vector3f(points.rowwise().minCoeff()) : Vector3f::Zero();
+                cellWidth_reciprocal = 1 / cellWidth;
+
+                cellCoordinates.resize(3 * pointsCount);
+                sortedPoints.resize(pointsCount);
+                for (uint32_t i = 0; i < pointsCount; ++i)
                 {
-                    autocorrelationPoints.col(j) *= -1;
+                    const float maxCoordinate = cellCoordinateMask - 1;
+                    Array3f coordinates = ((points.col(i) - gridOrigin) * cellWidth_reciprocal).array().floor() + 1;
+                    coordinates = coordinates.max(1.0f).min(maxCoordinate); // also catches huge coordinates for tiny cell widths
+                    cellCoordinates[3 * i] = coordinates.x();
+                    cellCoordinates[3 * i + 1] = coordinates.y();
+                    cellCoordinates[3 * i + 2] = coordinates.z();
+                    sortedPoints[i] = make_pair(getCellKey(cellCoordinates[3 * i], cellCoordinates[3 * i + 1], cellCoordinates[3 * i + 2]), i);
                 }
+                sort(sortedPoints.begin(), sortedPoints.end());
             }
 
-            uint32_t endInThisIteration = autocorrelationPointsCount + addedNodesInIteration;
-            for (uint32_t j = autocorrelationPointsCount, k = 0; j < endInThisIteration; ++j, ++k)
+            // calls visit(j) for all points j that might be closer than cellWidth to point i, in no particular order
+            template <typename Visitor>
+            inline void visitNeighbourCandidates(uint32_t i, Visitor visit) const
             {
-                float squaredNorm = autocorrelationPoints.col(j).squaredNorm();
-                if (squaredNorm < maxNormInAutocorrelation_squared && squaredNorm > minNormInAutocorrelation_squared)
+                const uint64_t x = cellCoordinates[3 * i];
+                const uint64_t y = cellCoordinates[3 * i + 1];
+                const uint64_t z = cellCoordinates[3 * i + 2];
+                for (uint64_t neighbourZ = z - 1; neighbourZ <= z + 1; ++neighbourZ)
                 {
-                    autocorrelationPoints.col(autocorrelationPointsCount) = autocorrelationPoints.col(j);
-                    autocorrelationPointsCount++;
+                    for (uint64_t neighbourY = y - 1; neighbourY <= y + 1; ++neighbourY)
+                    {
+                        // the three cells neighbouring in x are consecutive in the sorted keys
+                        const uint64_t rowStartKey = getCellKey(x - 1, neighbourY, neighbourZ);
+                        const uint64_t rowEndKey = getCellKey(x + 1, neighbourY, neighbourZ);
+                        auto entry = lower_bound(sortedPoints.begin(), sortedPoints.end(), make_pair(rowStartKey, 0u));
+                        for (; entry != sortedPoints.end() && entry->first <= rowEndKey; ++entry)
+                        {
+                            visit(entry->second);
+                        }
+                    }
                 }
             }
-        }
 
-        autocorrelationPoints.conservativeResize(3, autocorrelationPointsCount);
-    }
+          private:
+            Vector3f gridOrigin;
+            float cellWidth_reciprocal;
+            vector<uint32_t> cellCoordinates;
+            vector<pair<uint64_t, uint32_t>> sortedPoints; // (cell key, point index)
+        };
 
-    void getPointAutocorrelation(Matrix3Xf& autocorrelationPoints, VectorXi& centerPointIndices, VectorXi& shiftedPointIndices, const Matrix3Xf& points,
-                                 float minNormInAutocorrelation, float maxNormInAutocorrelation)
-    {
-        uint32_t N = points.cols();
-        uint32_t n = N - 1;
-        uint32_t maxAutocorrPointsCount = n * (n + 1) / 2;
-
-        float maxNormInAutocorrelation_squared = maxNormInAutocorrelation * maxNormInAutocorrelation;
-        float minNormInAutocorrelation_squared = minNormInAutocorrelation * minNormInAutocorrelation;
-
-        autocorrelationPoints.resize(3, maxAutocorrPointsCount);
-        centerPointIndices.resize(maxAutocorrPointsCount);
-        shiftedPointIndices.resize(maxAutocorrPointsCount);
-
-        uint32_t autocorrelationPointsCount = 0;
-
-        for (uint32_t i = 0; i < N; ++i)
+        void computeAutocorrelationBlock(autocorrelationBlock_t& block, vector<uint32_t>& shiftedCandidates, uint32_t blockIndex,
+                                         const AutocorrelationGrid& grid, const Matrix3Xf& points, float minNormInAutocorrelation_squared,
+                                         float maxNormInAutocorrelation_squared)
         {
-            uint32_t addedNodesInIteration = n - i;
-
-            autocorrelationPoints.block(0, autocorrelationPointsCount, 3, addedNodesInIteration) =
-                points.block(0, i + 1, 3, N - i - 1).colwise() - points.col(i);
+            const uint32_t N = points.cols();
+            const uint32_t firstCenterPoint = blockIndex * centerPointsPerBlock;
+            const uint32_t endCenterPoint = min(firstCenterPoint + centerPointsPerBlock, N);
 
-            for (uint32_t j = autocorrelationPointsCount, k = i + 1; j < autocorrelationPointsCount + addedNodesInIteration; ++j, ++k)
+            for (uint32_t i = firstCenterPoint; i < endCenterPoint; ++i)
             {
-                if (autocorrelationPoints(2, j) >= 0)
+                shiftedCandidates.clear();
+                grid.visitNeighbourCandidates(i, [&](uint32_t k) {
+                    if (k > i)
+                    {
+                        shiftedCandidates.push_back(k);
+                    }
+                });
+                sort(shiftedCandidates.begin(), shiftedCandidates.end());
+
+                for (uint32_t k : shiftedCandidates)
                 {
-                    centerPointIndices[j] = i;
-                    shiftedPointIndices[j] = k;
+                    Vector3f difference = points.col(k) - points.col(i);
+                    float squaredNorm = difference.squaredNorm();
+                    if (squaredNorm < maxNormInAutocorrelation_squared && squaredNorm > minNormInAutocorrelation_squared)
+                    {
+                        if (difference.z() >= 0)
+                        {
+                            block.centerPointIndices.push_back(i);
+                            block.shiftedPointIndices.push_back(k);
+                        }
+                        else
+                        {
+                            difference *= -1;
+                            block.centerPointIndices.push_back(k);
+                            block.shiftedPointIndices.push_back(i);
+                        }
+                        block.differences.insert(block.differences.end(), difference.data(), difference.data() + 3);
+                    }
                 }
-                else
+            }
+        }
+
+        void computePointAutocorrelation(Matrix3Xf& autocorrelationPoints, VectorXi* centerPointIndices, VectorXi* shiftedPointIndices,
+                                         const Matrix3Xf& points, float minNormInAutocorrelation, float maxNormInAutocorrelation, WorkerPool* workerPool)
+        {
+            const uint32_t N = points.cols();
+            const float maxNormInAutocorrelation_squared = maxNormInAutocorrelation * maxNormInAutocorrelation;
+            const float minNormInAutocorrelation_squared = minNormInAutocorrelation * minNormInAutocorrelation;
+
+            const AutocorrelationGrid grid(points, maxNormInAutocorrelation);
+
+            const uint32_t blocksCount = (N + centerPointsPerBlock - 1) / centerPointsPerBlock;
+            vector<autocorrelationBlock_t> blocks(blocksCount);
+            const uint32_t workersCount = workerPool != nullptr ? workerPool->getThreadCount() : 1;
+            vector<vector<uint32_t>> shiftedCandidates(workersCount);
+
+            auto computeBlock = [&](uint32_t blockIndex, uint32_t workerIndex) {
+                computeAutocorrelationBlock(blocks[blockIndex], shiftedCandidates[workerIndex], blockIndex, grid, points, minNormInAutocorrelation_squared,
+                                            maxNormInAutocorrelation_squared);
+            };
+            if (workerPool != nullptr)
+            {
+                workerPool->run(blocksCount, computeBlock);
+            }
+            else
+            {
+                for (uint32_t blockIndex = 0; blockIndex < blocksCount; ++blockIndex)
                 {
-                    autocorrelationPoints.col(j) *= -1;
-                    centerPointIndices[j] = k;
-                    shiftedPointIndices[j] = i;
+                    computeBlock(blockIndex, 0);
                 }
             }
 
-            uint32_t endInThisIteration = autocorrelationPointsCount + addedNodesInIteration;
-            for (uint32_t j = autocorrelationPointsCount, k = 0; j < endInThisIteration; ++j, ++k)
+            uint32_t autocorrelationPointsCount = 0;
+            for (const autocorrelationBlock_t& block : blocks)
+            {
+                autocorrelationPointsCount += block.centerPointIndices.size();
+            }
+
+            autocorrelationPoints.resize(3, autocorrelationPointsCount);
+            if (centerPointIndices != nullptr)
+            {
+                centerPointIndices->resize(autocorrelationPointsCount);
+                shiftedPointIndices->resize(autocorrelationPointsCount);
+            }
+
+            uint32_t firstColumn = 0;
+            for (autocorrelationBlock_t& block : blocks)
             {
-                float squaredNorm = autocorrelationPoints.col(j).squaredNorm();
-                if (squaredNorm < maxNormInAutocorrelation_squared && squaredNorm > minNormInAutocorrelation_squared)
+                const uint32_t blockPointsCount = block.centerPointIndices.size();
+                autocorrelationPoints.middleCols(firstColumn, blockPointsCount) = Map<Matrix3Xf>(block.differences.data(), 3, blockPointsCount);
+                if (centerPointIndices != nullptr)
                 {
-                    autocorrelationPoints.col(autocorrelationPointsCount) = autocorrelationPoints.col(j);
-                    centerPointIndices[autocorrelationPointsCount] = centerPointIndices[j];
-                    shiftedPointIndices[autocorrelationPointsCount] = shiftedPointIndices[j];
-                    autocorrelationPointsCount++;
+                    for (uint32_t j = 0; j < blockPointsCount; ++j)
+                    {
+                        (*centerPointIndices)[firstColumn + j] = block.centerPointIndices[j];
+                        (*shiftedPointIndices)[firstColumn + j] = block.shiftedPointIndices[j];
+                    }
                 }
+                firstColumn += blockPointsCount;
+
+                block = autocorrelationBlock_t(); // free early, to keep the peak memory close to the size of the result
             }
         }
+    } // namespace
 
-        autocorrelationPoints.conservativeResize(3, autocorrelationPointsCount);
-        centerPointIndices.conservativeResize(autocorrelationPointsCount);
-        shiftedPointIndices.conservativeResize(autocorrelationPointsCount);
+    void getPointAutocorrelation(Matrix3Xf& autocorrelationPoints, const Matrix3Xf& points, float minNormInAutocorrelation, float maxNormInAutocorrelation)
+    {
+        computePointAutocorrelation(autocorrelationPoints, nullptr, nullptr, points, minNormInAutocorrelation, maxNormInAutocorrelation, nullptr);
+    }
+
+    void getPointAutocorrelation(Matrix3Xf& autocorrelationPoints, const Matrix3Xf& points, float minNormInAutocorrelation, float maxNormInAutocorrelation,
+                                 WorkerPool& workerPool)
+    {
+        computePointAutocorrelation(autocorrelationPoints, nullptr, nullptr, points, minNormInAutocorrelation, maxNormInAutocorrelation, &workerPool);
+    }
+
+    void getPointAutocorrelation(Matrix3Xf& autocorrelationPoints, VectorXi& centerPointIndices, VectorXi& shiftedPointIndices, const Matrix3Xf& points,
+                                 float minNormInAutocorrelation, float maxNormInAutocorrelation)
+    {
+        computePointAutocorrelation(autocorrelationPoints, &centerPointIndices, &shiftedPointIndices, points, minNormInAutocorrelation,
+                                    maxNormInAutocorrelation, nullptr);
+    }
+
+    void getPointAutocorrelation(Matrix3Xf& autocorrelationPoints, VectorXi& centerPointIndices, VectorXi& shiftedPointIndices, const Matrix3Xf& points,
+                                 float minNormInAutocorrelation, float maxNormInAutocorrelation, WorkerPool& workerPool)
+    {
+        computePointAutocorrelation(autocorrelationPoints, &centerPointIndices, &shiftedPointIndices, points, minNormInAutocorrelation,
+                                    maxNormInAutocorrelation, &workerPool);
     }
-} // namespace xgandalf
\ No newline at end of file
+} // namespace xgandalf
@@ -26,6 +26,7 @@
  */
 
 #include "refinement.h"
+#include <algorithm>
 #include <iostream>
 
 using namespace Eigen;
@@ -64,11 +65,61 @@ namespace xgandalf
     }
 
 
+    // Per peak the defect is the distance of the predicted point p from the line through the origin and the peak, both projected on the detector
+    // plane (y, z). With the unit direction u of the projected peak it is |c| with c = a . p and the normal a = (0, -u_z, u_y).
+    // Peaks on the beam axis have no direction and get a = 0
+    static void getAngleDefectNormals(Matrix3Xf& angleDefectNormals, const Matrix3Xf& N)
+    {
+        angleDefectNormals.resize(3, N.cols());
+        for (int i = 0; i < N.cols(); ++i)
+        {
+            Vector2f detectorPeakDirection = N.col(i).tail<2>();
+            float detectorPeakDirectionNorm = detectorPeakDirection.norm();
+            if (detectorPeakDirectionNorm > 0)
+            {
+                detectorPeakDirection /= detectorPeakDirectionNorm;
+                angleDefectNormals.col(i) << 0, -detectorPeakDirection.y(), detectorPeakDirection.x();
+            }
+            else
+            {
+                angleDefectNormals.col(i).setZero();
+            }
+        }
+    }
+
+    // d|c|/dp = sign(c) * a. Points exactly on the line have no unique derivative and contribute 0
+    static void getDetectorAngleDefectDerivatives(Matrix3Xf& defectDerivatives, const Matrix3Xf& predictedPoints, const Matrix3Xf& N)
+    {
+        getAngleDefectNormals(defectDerivatives, N);
+        for (int i = 0; i < N.cols(); ++i)
+        {
+            float c = defectDerivatives.col(i).dot(predictedPoints.col(i));
+            defectDerivatives.col(i) *= (c > 0) - (c < 0);
+        }
+    }
+
     // B: reciprocal basis
     // M: miller indices (reciprocal)
     // N: reciprocal peaks
-    // TODO: Function can be made faster easily... nevertheless double is really necessary...
     void getGradient_detectorAngleMatch(Matrix3f& gradient, const Matrix3f& B, const Matrix3Xf& M, const Matrix3Xf& N)
+    {
+        if (M.cols() == 0)
+        {
+            gradient.setZero();
+            return;
+        }
+
+        Matrix3Xf defectDerivatives;
+        getDetectorAngleDefectDerivatives(defectDerivatives, B * M, N);
+
+        // shifts in x direction do not change the angle, so the first row is 0
+        gradient = defectDerivatives * M.transpose() / M.cols();
+    }
+
+    // B: reciprocal basis
+    // M: miller indices (reciprocal)
+    // N: reciprocal peaks
+    void getGradient_detectorAngleMatch_numeric(Matrix3f& gradient, const Matrix3f& B, const Matrix3Xf& M, const Matrix3Xf& N)
     {
         Matrix2Xd detectorPeakDirections = N.bottomRows(2).colwise().normalized().cast<double>();
 
@@ -165,6 +216,159 @@ namespace xgandalf
         }
     }
 
+    // in double, because the defects are small differences of large predicted points. In float they would be too noisy to compare close steps
+    static double getDefect_meanDist_peaksAndAngle(const Matrix3f& B, const Matrix3Xf& M, const Matrix3Xf& N, const Matrix3Xf& angleDefectNormals,
+                                                   float reciprocalPeakDistWeight, float reciprocalPeakAngleWeight)
+    {
+        Matrix3Xd predictedPoints = B.cast<double>() * M.cast<double>();
+        return reciprocalPeakDistWeight * (predictedPoints - N.cast<double>()).colwise().norm().mean() +
+               reciprocalPeakAngleWeight * predictedPoints.cwiseProduct(angleDefectNormals.cast<double>()).colwise().sum().cwiseAbs().mean();
+    }
+
+    // B: reciprocal basis
+    // M: miller indices (reciprocal)
+    // N: reciprocal peaks
+    int refineReciprocalBasis_meanDist_peaksAndAngle_levenbergMarquardt(Matrix3f& B, const Matrix3Xf& M, const Matrix3Xf& N)
+    {
+        const float reciprocalPeakDistWeight = 1;
+        const float reciprocalPeakAngleWeight = 0.5;
+        const int maxIterationsCount = 30;
+        const double convergedRelativeDefectChange = 1e-7;
+
+        const int peaksCount = M.cols();
+        if (peaksCount == 0)
+        {
+            return 0;
+        }
+
+        Matrix3Xf angleDefectNormals;
+        getAngleDefectNormals(angleDefectNormals, N);
+
+        // if the miller indices do not span the space, some directions of B are not defined by the objective and B could collapse
+        const float initialDeterminant = B.determinant();
+        auto isPlausibleBasis = [&](const Matrix3f& B_candidate) {
+            float determinantRatio = B_candidate.determinant() / initialDeterminant;
+            return determinantRatio > 0.5f && determinantRatio < 2.0f;
+        };
+
+        double defect = getDefect_meanDist_peaksAndAngle(B, M, N, angleDefectNormals, reciprocalPeakDistWeight, reciprocalPeakAngleWeight);
+
+        Matrix3f B_leastSquares;
+        refineReciprocalBasis_meanSquaredDist(B_leastSquares, M, N);
+        double defect_leastSquares =
+            getDefect_meanDist_peaksAndAngle(B_leastSquares, M, N, angleDefectNormals, reciprocalPeakDistWeight, reciprocalPeakAngleWeight);
+        if (defect_leastSquares < defect && isPlausibleBasis(B_leastSquares))
+        {
+            B = B_leastSquares;
+            defect = defect_leastSquares;
+        }
+
+        // Both defects are linear in B, but enter the objective with their norm. The quadratic model uses the exact Hessian of the distance norms. The
+        // absolute value of the angle defect has no curvature, so it is majorized by c^2 / (2 * |c_current|) as in iteratively reweighted least squares
+        const float minDefect = 1e-6f * N.colwise().norm().mean(); // guards the weights of peaks that are fitted exactly
+        double damping = 1e-3;
+        int iterationsCount = 0;
+        Matrix<double, 9, 9> normalMatrix;
+        Matrix<double, 9, 1> gradient;
+        Matrix<double, 9, 1> jacobian;
+        Matrix3d millerIndicesScatter;
+        while (iterationsCount < maxIterationsCount)
+        {
+            iterationsCount++;
+
+            // parameters are the entries of B in row major order. Only the lower triangle of normalMatrix is accumulated
+            Matrix3Xf predictedPoints = B * M;
+            normalMatrix.setZero();
+            gradient.setZero();
+            millerIndicesScatter.setZero();
+            for (int i = 0; i < peaksCount; ++i)
+            {
+                Vector3d millerIndices = M.col(i).cast<double>();
+                Vector3d predictedPoint = predictedPoints.col(i).cast<double>();
+
+                // the Hessian of the distance norm is (I - n * n^T) / |e| with the unit defect direction n
+                Vector3d distDefect = predictedPoint - N.col(i).cast<double>();
+                double distDefectNorm = max(distDefect.norm(), (double)minDefect);
+                double distWeight = reciprocalPeakDistWeight / distDefectNorm;
+                Vector3d distDefectDirection = distDefect / distDefectNorm;
+                millerIndicesScatter.selfadjointView<Lower>().rankUpdate(millerIndices, distWeight);
+                for (int row = 0; row < 3; ++row)
+                {
+                    jacobian.segment<3>(3 * row) = distDefectDirection[row] * millerIndices;
+                }
+                normalMatrix.selfadjointView<Lower>().rankUpdate(jacobian, -distWeight);
+                gradient += reciprocalPeakDistWeight * jacobian;
+
+                Vector3d angleDefectNormal = angleDefectNormals.col(i).cast<double>();
+                double angleDefect = angleDefectNormal.dot(predictedPoint);
+                double angleWeight = reciprocalPeakAngleWeight / max(abs(angleDefect), (double)minDefect);
+                for (int row = 0; row < 3; ++row)
+                {
+                    jacobian.segment<3>(3 * row) = angleDefectNormal[row] * millerIndices;
+                }
+                normalMatrix.selfadjointView<Lower>().rankUpdate(jacobian, angleWeight);
+                gradient += (angleWeight * angleDefect) * jacobian;
+            }
+            for (int row = 0; row < 3; ++row)
+            {
+                normalMatrix.block<3, 3>(3 * row, 3 * row).triangularView<Lower>() += millerIndicesScatter;
+            }
+            normalMatrix.triangularView<StrictlyUpper>() = normalMatrix.transpose().triangularView<StrictlyUpper>();
+
+            bool improved = false;
+            while (!improved && damping < 1e6)
+            {
+                // the small ridge keeps the system solvable for undefined directions
+                Matrix<double, 9, 9> dampedNormalMatrix = normalMatrix;
+                dampedNormalMatrix.diagonal() *= 1 + damping;
+                dampedNormalMatrix.diagonal().array() += 1e-9 * normalMatrix.diagonal().maxCoeff();
+                Matrix<double, 9, 1> step = -dampedNormalMatrix.ldlt().solve(gradient);
+
+                Matrix3f stepMatrix = Map<Matrix<double, 3, 3, RowMajor>>(step.data()).cast<float>();
+                Matrix3f B_new = B + stepMatrix;
+                double defect_new = getDefect_meanDist_peaksAndAngle(B_new, M, N, angleDefectNormals, reciprocalPeakDistWeight, reciprocalPeakAngleWeight);
+                if (defect_new < defect && isPlausibleBasis(B_new))
+                {
+                    // The majorized angle defects of peaks that end up exactly on their lines only shrink geometrically from step to step. Going further
+                    // along the step as long as the objective keeps decreasing skips most of these iterations
+                    for (float stepFactor = 2; stepFactor <= 64; stepFactor *= 2)
+                    {
+                        Matrix3f B_extrapolated = B + stepFactor * stepMatrix;
+                        double defect_extrapolated =
+                            getDefect_meanDist_peaksAndAngle(B_extrapolated, M, N, angleDefectNormals, reciprocalPeakDistWeight, reciprocalPeakAngleWeight);
+                        if (defect_extrapolated >= defect_new || !isPlausibleBasis(B_extrapolated))
+                        {
+                            break;
+                        }
+                        B_new = B_extrapolated;
+                        defect_new = defect_extrapolated;
+                    }
+
+                    improved = true;
+                    B = B_new;
+                    bool converged = defect - defect_new < convergedRelativeDefectChange * defect;
+                    defect = defect_new;
+                    damping = max(damping * 0.1, 1e-7);
+                    if (converged)
+                    {
+                        return iterationsCount;
+                    }
+                }
+                else
+                {
+                    damping *= 10;
+                }
+            }
+
+            if (!improved)
+            {
+                break;
+            }
+        }
+
+        return iterationsCount;
+    }
+
     // B: reciprocal basis
     // B_sample: sample reciprocal basis (with correct lattice parameters)
     // M: miller indices (reciprocal)
@@ -228,9 +432,43 @@ namespace xgandalf
     // B: reciprocal basis
     // M: miller indices (reciprocal)
     // N: reciprocal peaks
-    // TODO: Function can be made faster easily... nevertheless double is really necessary...
     void getGradient_detectorAngleMatchFixedLattice(Vector3f& rotationAnglesGradient_detectorAngle, Vector3f& rotationAnglesGradient_distFromPoints,
                                                     const Matrix3f& B, const Matrix3Xf& M, const Matrix3Xf& N)
+    {
+        rotationAnglesGradient_detectorAngle.setZero();
+        rotationAnglesGradient_distFromPoints.setZero();
+        if (M.cols() == 0)
+        {
+            return;
+        }
+
+        Matrix3Xf predictedPoints = B * M;
+
+        Matrix3Xf defectDerivatives;
+        getDetectorAngleDefectDerivatives(defectDerivatives, predictedPoints, N);
+
+        // a rotation by a small angle around axis i moves p by e_i x p, so the derivative of a defect with derivative g is e_i . (p x g)
+        for (int i = 0; i < predictedPoints.cols(); ++i)
+        {
+            Vector3f predictedPoint = predictedPoints.col(i);
+            rotationAnglesGradient_detectorAngle += predictedPoint.cross(defectDerivatives.col(i));
+
+            Vector3f distFromPoint = predictedPoint - N.col(i);
+            float distFromPointNorm = distFromPoint.norm();
+            if (distFromPointNorm > 0)
+            {
+                rotationAnglesGradient_distFromPoints += predictedPoint.cross(distFromPoint) / distFromPointNorm;
+            }
+        }
+        rotationAnglesGradient_detectorAngle /= predictedPoints.cols();
+        rotationAnglesGradient_distFromPoints /= predictedPoints.cols();
+    }
+
+    // B: reciprocal basis
+    // M: miller indices (reciprocal)
+    // N: reciprocal peaks
+    void getGradient_detectorAngleMatchFixedLattice_numeric(Vector3f& rotationAnglesGradient_detectorAngle, Vector3f& rotationAnglesGradient_distFromPoints,
+                                                            const Matrix3f& B, const Matrix3Xf& M, const Matrix3Xf& N)
     {
         Matrix3Xd Md = M.cast<double>();
         Matrix3Xd Nd = N.cast<double>();
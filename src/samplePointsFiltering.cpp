@@ -26,6 +26,9 @@
  */
 
 #include "samplePointsFiltering.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
 
 using namespace Eigen;
 using namespace std;
@@ -93,4 +96,96 @@ namespace xgandalf
 
         samplePoints.conservativeResize(3, keptSamplePontsCount);
     }
+
+    void keepSamplePointsWithHighestEvaluation(Matrix3Xf& samplePoints, RowVectorXf& samplePointsEvaluation, uint32_t maxToTakeCount, vector<uint32_t>& sortIndices)
+    {
+        uint32_t toTakeCount = min(maxToTakeCount, (uint32_t)samplePointsEvaluation.size());
+
+        sortIndices.resize(samplePointsEvaluation.size());
+        iota(sortIndices.begin(), sortIndices.end(), 0);
+        nth_element(sortIndices.begin(), sortIndices.begin() + toTakeCount, sortIndices.end(),
+                    [&](uint32_t i, uint32_t j) { return samplePointsEvaluation[i] > samplePointsEvaluation[j]; });
+
+        sortIndices.resize(toTakeCount);
+        sort(sortIndices.begin(), sortIndices.end(), [&](uint32_t i, uint32_t j) { return samplePointsEvaluation[i] > samplePointsEvaluation[j]; });
+
+        Matrix3Xf samplePoints_filtered(3, toTakeCount);
+        RowVectorXf samplePointsEvaluation_filtered(toTakeCount);
+        for (uint32_t i = 0; i < toTakeCount; ++i)
+        {
+            samplePoints_filtered.col(i) = samplePoints.col(sortIndices[i]);
+            samplePointsEvaluation_filtered[i] = samplePointsEvaluation[sortIndices[i]];
+        }
+
+        samplePoints.swap(samplePoints_filtered);
+        samplePointsEvaluation.swap(samplePointsEvaluation_filtered);
+    }
+
+    static inline uint64_t getCellKey(const Vector3i& cell)
+    {
+        const int64_t offset = 1 << 20;
+        return ((uint64_t)(cell.x() + offset) << 42) | ((uint64_t)(cell.y() + offset) << 21) | (uint64_t)(cell.z() + offset);
+    }
+
+    void assignSamplePointsToClosestCoarseSamplePoints(vector<uint32_t>& closestCoarseSamplePointIndices, const Matrix3Xf& samplePoints,
+                                                       const Matrix3Xf& coarseSamplePoints, float maxDistance)
+    {
+        if (coarseSamplePoints.cols() == 0)
+        {
+            std::stringstream errStream;
+            errStream << "No coarse sample points to assign the sample points to" << endl;
+            throw BadInputException(errStream.str());
+        }
+
+        const float inverseCellSize = 1 / maxDistance;
+
+        // coarse sample points sorted by their cell
+        vector<pair<uint64_t, uint32_t>> cellKeys(coarseSamplePoints.cols());
+        for (uint32_t i = 0; i < coarseSamplePoints.cols(); ++i)
+        {
+            Vector3i cell = (coarseSamplePoints.col(i) * inverseCellSize).array().floor().cast<int>();
+            cellKeys[i] = make_pair(getCellKey(cell), i);
+        }
+        sort(cellKeys.begin(), cellKeys.end());
+
+        closestCoarseSamplePointIndices.resize(samplePoints.cols());
+        for (uint32_t i = 0; i < samplePoints.cols(); ++i)
+        {
+            const Vector3f samplePoint = samplePoints.col(i);
+            Vector3i cell = (samplePoint * inverseCellSize).array().floor().cast<int>();
+
+            float minSquaredDistance = numeric_limits<float>::max();
+            uint32_t closestIndex = 0;
+            for (int x = -1; x <= 1; ++x)
+            {
+                for (int y = -1; y <= 1; ++y)
+                {
+                    for (int z = -1; z <= 1; ++z)
+                    {
+                        uint64_t key = getCellKey(cell + Vector3i(x, y, z));
+                        auto it = lower_bound(cellKeys.begin(), cellKeys.end(), make_pair(key, (uint32_t)0));
+                        for (; it != cellKeys.end() && it->first == key; ++it)
+                        {
+                            float squaredDistance = (coarseSamplePoints.col(it->second) - samplePoint).squaredNorm();
+                            if (squaredDistance < minSquaredDistance)
+                            {
+                                minSquaredDistance = squaredDistance;
+                                closestIndex = it->second;
+                            }
+                        }
+                    }
+                }
+            }
+
+            // no coarse sample point in the neighboring cells
+            if (minSquaredDistance == numeric_limits<float>::max())
+            {
+                Index minIndex;
+                (coarseSamplePoints.colwise() - samplePoint).colwise().squaredNorm().minCoeff(&minIndex);
+                closestIndex = minIndex;
+            }
+
+            closestCoarseSamplePointIndices[i] = closestIndex;
+        }
+    }
 } // namespace xgandalf
\ No newline at end of file
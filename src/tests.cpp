@@ -39,11 +39,15 @@
 #include "SimpleMonochromaticDiffractionPatternPrediction.h"
 #include "SimpleMonochromaticProjection.h"
 #include "SparsePeakFinder.h"
+#include "WorkerPool.h"
+#include "WrongUsageException.h"
 #include "eigenDiskImport.h"
 #include "pointAutocorrelation.h"
 #include "refinement.h"
 #include "samplePointsFiltering.h"
 #include <Eigen/Dense>
+#include <atomic>
+#include <cassert>
 #include <chrono>
 #include <fstream>
 #include <iostream>
@@ -58,6 +62,48 @@ using namespace Eigen;
 
 namespace xgandalf
 {
+    void test_workerPoolNesting()
+    {
+        WorkerPool a(4);
+        vector<WorkerPool> innerPools(a.getThreadCount(), WorkerPool(2)); // one per worker, a pool must not be run from several threads concurrently
+
+        atomic<uint32_t> innerTasksCount(0);
+        atomic<uint32_t> wrongWorkerIndicesCount(0);
+        a.run(8, [&](uint32_t, uint32_t workerIndex) {
+            WorkerPool& b = innerPools[workerIndex];
+
+            // a -> b -> a on the same thread
+            b.run(1, [&](uint32_t, uint32_t) {
+                a.run(3, [&](uint32_t, uint32_t nestedWorkerIndex) {
+                    innerTasksCount++;
+                    wrongWorkerIndicesCount += nestedWorkerIndex != workerIndex;
+                });
+            });
+
+            // a parallel run of b must not hide the outer run of a afterwards
+            b.run(4, [&](uint32_t, uint32_t) {});
+            a.run(2, [&](uint32_t, uint32_t nestedWorkerIndex) {
+                innerTasksCount++;
+                wrongWorkerIndicesCount += nestedWorkerIndex != workerIndex;
+            });
+
+            // neither must an exception thrown inside b
+            try
+            {
+                b.run(1, [](uint32_t, uint32_t) { throw WrongUsageException("expected"); });
+            }
+            catch (const WrongUsageException&)
+            {
+            }
+            a.run(1, [&](uint32_t, uint32_t nestedWorkerIndex) {
+                innerTasksCount++;
+                wrongWorkerIndicesCount += nestedWorkerIndex != workerIndex;
+            });
+        });
+
+        cout << "nested tasks " << innerTasksCount << " (expected " << 8 * 6 << "), wrong worker indices " << wrongWorkerIndicesCount << endl;
+    }
+
     static ExperimentSettings getExperimentSettingLys();
     static ExperimentSettings getExperimentSettingCrystfelTutorial();
 
@@ -235,6 +281,45 @@ namespace xgandalf
         cout << endl << "B that minimizes the function: " << B << std::endl;
     }
 
+    // compares the Levenberg-Marquardt refinement with the gradient descent refinement of the same objective
+    void test_levenbergMarquardtRefinement()
+    {
+        srand(1);
+        Matrix3f B;
+        B << 0.0945252, -0.0298714, 0.1601091, -0.0433391, -0.1177522, 0.0156280, 0.0644485, -0.0374347, -0.2065220;
+        B /= 10;
+        Matrix3Xf M = (Matrix3Xf::Random(3, 100) * 10).array().round();
+        Matrix3Xf N = B * M + Matrix3Xf::Random(3, 100) * 0.0005;
+        Matrix3f B_init = B + Matrix3f::Random() * 0.0002;
+
+        auto getDefect = [&](const Matrix3f& B_refined) {
+            Matrix3Xf predictedPoints = B_refined * M;
+            Matrix2Xf detectorPeakDirections = N.bottomRows(2).colwise().normalized();
+            RowVectorXf angleDefects = (detectorPeakDirections.row(0).cwiseProduct(predictedPoints.row(2)) -
+                                        detectorPeakDirections.row(1).cwiseProduct(predictedPoints.row(1)))
+                                           .cwiseAbs();
+            return (predictedPoints - N).colwise().norm().mean() + 0.5f * angleDefects.mean();
+        };
+
+        Matrix3f B_gradientDescent = B_init;
+        chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+        refineReciprocalBasis_meanDist_peaksAndAngle(B_gradientDescent, M, N);
+        chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+        Matrix3f B_levenbergMarquardt = B_init;
+        int iterationsCount = refineReciprocalBasis_meanDist_peaksAndAngle_levenbergMarquardt(B_levenbergMarquardt, M, N);
+        chrono::high_resolution_clock::time_point t3 = chrono::high_resolution_clock::now();
+
+        cout << "start defect " << getDefect(B_init) << endl;
+        cout << "gradient descent: defect " << getDefect(B_gradientDescent) << ", " << chrono::duration_cast<chrono::microseconds>(t2 - t1).count()
+             << " us" << endl;
+        cout << "Levenberg-Marquardt: defect " << getDefect(B_levenbergMarquardt) << ", " << chrono::duration_cast<chrono::microseconds>(t3 - t2).count()
+             << " us, " << iterationsCount << " iterations" << endl;
+
+        // must replace the gradient descent without loss of accuracy
+        assert(getDefect(B_levenbergMarquardt) <= getDefect(B_gradientDescent));
+        assert(iterationsCount < 10);
+    }
+
     void test_gradientDescentRefinement()
     {
         Matrix3f B, B_init;
@@ -333,6 +418,56 @@ namespace xgandalf
         cout << gradient;
     }
 
+    // compares the analytic detector angle gradients with numeric differentiation
+    void test_detectorAngleMatchGradients()
+    {
+        srand(1);
+        Matrix3f B;
+        B << 0.0945252, -0.0298714, 0.1601091, -0.0433391, -0.1177522, 0.0156280, 0.0644485, -0.0374347, -0.2065220;
+        B /= 10;
+        Matrix3Xf M = (Matrix3Xf::Random(3, 100) * 10).array().round();
+        Matrix3Xf N = B * M + Matrix3Xf::Random(3, 100) * 0.0005;
+        Matrix3f B_disturbed = B + Matrix3f::Random() * 0.0002;
+
+        const int repetitions = 150;
+        Matrix3f gradient, gradient_numeric;
+        chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+        for (int i = 0; i < repetitions; i++)
+        {
+            getGradient_detectorAngleMatch(gradient, B_disturbed, M, N);
+        }
+        chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+        for (int i = 0; i < repetitions; i++)
+        {
+            getGradient_detectorAngleMatch_numeric(gradient_numeric, B_disturbed, M, N);
+        }
+        chrono::high_resolution_clock::time_point t3 = chrono::high_resolution_clock::now();
+
+        cout << "detector angle gradient, max relative difference "
+             << (gradient - gradient_numeric).cwiseAbs().maxCoeff() / gradient_numeric.cwiseAbs().maxCoeff() << ", analytic " << chrono::duration_cast<chrono::microseconds>(t2 - t1).count() << " us, numeric "
+             << chrono::duration_cast<chrono::microseconds>(t3 - t2).count() << " us for " << repetitions << " gradients" << endl;
+
+        Vector3f gradient_detectorAngle, gradient_distFromPoints, gradient_detectorAngle_numeric, gradient_distFromPoints_numeric;
+        t1 = chrono::high_resolution_clock::now();
+        for (int i = 0; i < repetitions; i++)
+        {
+            getGradient_detectorAngleMatchFixedLattice(gradient_detectorAngle, gradient_distFromPoints, B_disturbed, M, N);
+        }
+        t2 = chrono::high_resolution_clock::now();
+        for (int i = 0; i < repetitions; i++)
+        {
+            getGradient_detectorAngleMatchFixedLattice_numeric(gradient_detectorAngle_numeric, gradient_distFromPoints_numeric, B_disturbed, M, N);
+        }
+        t3 = chrono::high_resolution_clock::now();
+
+        cout << "fixed lattice gradients, max relative difference detector angle "
+             << (gradient_detectorAngle - gradient_detectorAngle_numeric).cwiseAbs().maxCoeff() / gradient_detectorAngle_numeric.cwiseAbs().maxCoeff()
+             << ", dist from points "
+             << (gradient_distFromPoints - gradient_distFromPoints_numeric).cwiseAbs().maxCoeff() / gradient_distFromPoints_numeric.cwiseAbs().maxCoeff()
+             << ", analytic " << chrono::duration_cast<chrono::microseconds>(t2 - t1).count() << " us, numeric "
+             << chrono::duration_cast<chrono::microseconds>(t3 - t2).count() << " us for " << repetitions << " gradients" << endl;
+    }
+
     void test_latticeReorder()
     {
         // Matrix3f testBasis = Matrix3f::Random(3, 3);
@@ -749,6 +884,182 @@ namespace xgandalf
         }
     }
 
+    // The known cell bounds of the pair compatibility graph must not lose candidate lattices. Compares the candidate lattices of the assembler for an
+    // oblique known cell with the ones of an enumeration of all triplets without the pair graph
+    void test_latticeAssemblerKnownObliqueCell()
+    {
+        srand(2);
+
+        // a, b, c = 40, 55, 70 A, alpha, beta, gamma = 70, 105, 80 deg, arbitrarily rotated and reduced
+        const float a = 40, b = 55, c = 70;
+        const float alpha = 70 * M_PI / 180, beta = 105 * M_PI / 180, gamma = 80 * M_PI / 180;
+        Matrix3f basis;
+        basis.col(0) << a, 0, 0;
+        basis.col(1) << b * cos(gamma), b * sin(gamma), 0;
+        float cx = c * cos(beta);
+        float cy = c * (cos(alpha) - cos(beta) * cos(gamma)) / sin(gamma);
+        basis.col(2) << cx, cy, sqrt(c * c - cx * cx - cy * cy);
+        Lattice sampleRealLattice_A(AngleAxisf(0.7f, Vector3f(1, 2, 3).normalized()).toRotationMatrix() * basis);
+        sampleRealLattice_A.minimize();
+        basis = sampleRealLattice_A.getBasis();
+        const float tolerance = 0.02;
+
+        // peaks on the lattice and some noise peaks
+        const int latticePeaksCount = 120;
+        const int noisePeaksCount = 30;
+        Matrix3Xf millerIndices = (Matrix3Xf::Random(3, latticePeaksCount) * 5).array().round();
+        Matrix3Xf pointsToFitInReciprocalSpace(3, latticePeaksCount + noisePeaksCount);
+        pointsToFitInReciprocalSpace << basis.transpose().inverse() * millerIndices + Matrix3Xf::Random(3, latticePeaksCount) * 0.0001,
+            Matrix3Xf::Random(3, noisePeaksCount) * 0.12;
+
+        // lattice vectors and wrong vectors (half of lattice vectors and random vectors)
+        vector<Vector3f> vectors;
+        for (int u = -2; u <= 2; ++u)
+        {
+            for (int v = -2; v <= 2; ++v)
+            {
+                for (int w = -2; w <= 2; ++w)
+                {
+                    Vector3f coefficients(u, v, w);
+                    if (coefficients.isZero() || (u < 0 || (u == 0 && (v < 0 || (v == 0 && w < 0)))))
+                    {
+                        continue;
+                    }
+                    vectors.push_back(basis * coefficients);
+                    if ((u + v + w) % 3 == 0)
+                    {
+                        vectors.push_back(basis * coefficients / 2);
+                    }
+                }
+            }
+        }
+        for (int i = 0; i < 20; ++i)
+        {
+            vectors.push_back(Vector3f::Random().normalized() * (40 + 100 * (i / 20.0f)));
+        }
+
+        Matrix3Xf candidateVectors(3, vectors.size());
+        RowVectorXf candidateVectorWeights(vectors.size());
+        vector<vector<uint16_t>> pointIndicesOnVectors(vectors.size());
+        for (uint32_t i = 0; i < vectors.size(); ++i)
+        {
+            candidateVectors.col(i) = vectors[i];
+            for (uint16_t pointIndex = 0; pointIndex < pointsToFitInReciprocalSpace.cols(); ++pointIndex)
+            {
+                float projection = vectors[i].dot(pointsToFitInReciprocalSpace.col(pointIndex));
+                if (abs(projection - round(projection)) < 0.15f)
+                {
+                    pointIndicesOnVectors[i].push_back(pointIndex);
+                }
+            }
+            candidateVectorWeights[i] = pointIndicesOnVectors[i].size();
+        }
+
+        LatticeAssembler::accuracyConstants_t accuracyConstants;
+        accuracyConstants.maxCountGlobalPassingWeightFilter = 500;
+        accuracyConstants.maxCountLocalPassingWeightFilter = 15;
+        accuracyConstants.maxCountPassingRelativeDefectFilter = 50;
+        accuracyConstants.minPointsOnLattice = 5;
+        accuracyConstants.maxCloseToPointDeviation = 0.15;
+        accuracyConstants.refineWithExactLattice = false;
+
+        float det = abs(basis.determinant());
+        Vector2f determinantRange(det * 0.8, det * 1.2);
+
+        LatticeAssembler latticeAssembler(determinantRange, sampleRealLattice_A, tolerance, accuracyConstants);
+        vector<Lattice> assembledLattices;
+        vector<LatticeAssembler::assembledLatticeStatistics_t> assembledLatticesStatistics;
+        Matrix3Xf candidateVectors_assembler = candidateVectors;
+        RowVectorXf candidateVectorWeights_assembler = candidateVectorWeights;
+        latticeAssembler.assembleLattices(assembledLattices, assembledLatticesStatistics, candidateVectors_assembler, candidateVectorWeights_assembler,
+                                          pointIndicesOnVectors, pointsToFitInReciprocalSpace);
+        const LatticeAssembler::assemblyStatistics_t& statistics = latticeAssembler.getLastAssemblyStatistics();
+
+        // same filters as the assembler, without the pair graph
+        Array<float, 6, 1> knownLatticeParameters;
+        knownLatticeParameters << sampleRealLattice_A.getBasisVectorNorms(), sampleRealLattice_A.getBasisVectorAnglesNormalized_deg();
+        auto checkLatticeParameters = [&](Lattice lattice) {
+            lattice.minimize();
+            Vector3f n = lattice.getBasisVectorNorms();
+            Vector3f angles = lattice.getBasisVectorAnglesNormalized_deg();
+            const int permutations[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+            for (const auto& permutation : permutations)
+            {
+                bool valid = true;
+                for (int row = 0; row < 3; ++row)
+                {
+                    valid &= abs(n[permutation[row]] - knownLatticeParameters[row]) / knownLatticeParameters[row] < tolerance;
+                    valid &= abs(angles[permutation[row]] - knownLatticeParameters[3 + row]) / knownLatticeParameters[3 + row] < tolerance;
+                }
+                if (valid)
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        vector<uint32_t> usedVectors;
+        for (uint32_t i = 0; i < vectors.size(); ++i)
+        {
+            if (pointIndicesOnVectors[i].size() >= accuracyConstants.minPointsOnLattice)
+            {
+                usedVectors.push_back(i);
+            }
+        }
+        vector<vector<bool>> pointOnVector(vectors.size(), vector<bool>(pointsToFitInReciprocalSpace.cols(), false));
+        for (uint32_t i = 0; i < vectors.size(); ++i)
+        {
+            for (uint16_t pointIndex : pointIndicesOnVectors[i])
+            {
+                pointOnVector[i][pointIndex] = true;
+            }
+        }
+
+        uint32_t pairsWithEnoughPointsCount = 0;
+        uint32_t unfilteredCandidateLatticesCount = 0;
+        for (uint32_t i = 0; i < usedVectors.size(); ++i)
+        {
+            for (uint32_t j = i + 1; j < usedVectors.size(); ++j)
+            {
+                uint32_t pointsOnBothVectorsCount = 0;
+                for (uint32_t pointIndex = 0; pointIndex < pointsToFitInReciprocalSpace.cols(); ++pointIndex)
+                {
+                    pointsOnBothVectorsCount += pointOnVector[usedVectors[i]][pointIndex] && pointOnVector[usedVectors[j]][pointIndex];
+                }
+                pairsWithEnoughPointsCount += pointsOnBothVectorsCount >= accuracyConstants.minPointsOnLattice;
+
+                for (uint32_t k = j + 1; k < usedVectors.size(); ++k)
+                {
+                    Lattice latticeToCheck(vectors[usedVectors[i]], vectors[usedVectors[j]], vectors[usedVectors[k]]);
+                    float absDet = abs(latticeToCheck.det());
+                    if (absDet < determinantRange[0] || absDet > determinantRange[1])
+                    {
+                        continue;
+                    }
+
+                    uint32_t pointsOnLatticeCount = 0;
+                    for (uint32_t pointIndex = 0; pointIndex < pointsToFitInReciprocalSpace.cols(); ++pointIndex)
+                    {
+                        pointsOnLatticeCount += pointOnVector[usedVectors[i]][pointIndex] && pointOnVector[usedVectors[j]][pointIndex] &&
+                                                pointOnVector[usedVectors[k]][pointIndex];
+                    }
+                    if (pointsOnLatticeCount >= accuracyConstants.minPointsOnLattice && checkLatticeParameters(latticeToCheck))
+                    {
+                        unfilteredCandidateLatticesCount++;
+                    }
+                }
+            }
+        }
+
+        cout << "pairs with enough points " << pairsWithEnoughPointsCount << ", compatible pairs " << statistics.compatiblePairsCount << endl;
+        cout << "candidate lattices without pair graph " << unfilteredCandidateLatticesCount << ", with pair graph "
+             << statistics.passingLatticeParametersFilterCount << ", assembled lattices " << assembledLattices.size() << endl;
+
+        assert(statistics.passingLatticeParametersFilterCount == unfilteredCandidateLatticesCount);
+        assert(statistics.compatiblePairsCount < pairsWithEnoughPointsCount);
+    }
+
     void test_sparsePeakFinder()
     {
         Matrix3Xf pointPositions;
@@ -852,23 +1163,23 @@ namespace xgandalf
 
         //    cout << t.getInverseTransformEvaluation() << endl << endl << t.getGradient() << endl << endl << t.getCloseToPointsCount() << endl;
 
-        HillClimbingOptimizer h;
-        h.previousStepDirection =
+        Matrix3Xf previousStepDirection =
             (Matrix3Xf(3, 4) << 0.5789, 0.6826, 0.3688, 0.6340, 0.4493, 0.0735, 0.8089, 0.3796, 0.6804, 0.7271, 0.4578, 0.6737).finished();
-        h.previousStepLength = (Array<float, 1, Eigen::Dynamic>(1, 4) << 0.1, 3, 2, 4).finished();
+        Array<float, 1, Eigen::Dynamic> previousStepLength = (Array<float, 1, Eigen::Dynamic>(1, 4) << 0.1, 3, 2, 4).finished();
+        Matrix3Xf step;
 
         HillClimbingOptimizer::stepComputationAccuracyConstants_t stepComputationAccuracyConstants;
         stepComputationAccuracyConstants.directionChangeFactor = 3;
         stepComputationAccuracyConstants.minStep = 0.5;
         stepComputationAccuracyConstants.maxStep = 55;
         stepComputationAccuracyConstants.gamma = 0.2;
-        h.setStepComputationAccuracyConstants(stepComputationAccuracyConstants);
 
         bool useStepOrthogonalization = true;
 
-        h.computeStep(t.getGradient(), t.getCloseToPointsCount(), t.getInverseTransformEvaluation(), useStepOrthogonalization);
+        HillClimbingOptimizer::computeStep(t.getGradient(), t.getCloseToPointsCount(), t.getInverseTransformEvaluation(), useStepOrthogonalization,
+                                           stepComputationAccuracyConstants, step, previousStepDirection, previousStepLength);
 
-        cout << h.step << endl << endl;
+        cout << step << endl << endl;
     }
     void test_InverseSpaceTransform()
     {
@@ -903,6 +1214,118 @@ namespace xgandalf
         }
     }
 
+    // compares the polynomial sine and cosine of function 1 with the standard library version, for choosing a tradeoff between speed and fidelity
+    void test_trigonometryAccuracy()
+    {
+        srand(1);
+        Matrix3Xf pointsToTransform = Matrix3Xf::Random(3, 150) * 0.5;  // reciprocal peaks in 1/A
+        Matrix3Xf positionsToEvaluate = Matrix3Xf::Random(3, 20000) * 100; // real space vectors in A
+
+        const int exponents[] = {1, 5};
+        const char* accuracyNames[] = {"exact", "high", "fast"};
+        const InverseSpaceTransform::TrigonometryAccuracy accuracies[] = {
+            InverseSpaceTransform::TrigonometryAccuracy::exact, InverseSpaceTransform::TrigonometryAccuracy::high, InverseSpaceTransform::TrigonometryAccuracy::fast};
+
+        for (int exponent : exponents)
+        {
+            InverseSpaceTransform reference(0.15);
+            reference.setFunctionSelection(1);
+            reference.setOptionalFunctionArgument(exponent);
+            reference.setPointsToTransform(pointsToTransform);
+            reference.setTrigonometryAccuracy(InverseSpaceTransform::TrigonometryAccuracy::exact);
+            reference.performTransform(positionsToEvaluate);
+            const RowVectorXf referenceEvaluation = reference.getInverseTransformEvaluation();
+            const Matrix3Xf referenceGradient = reference.getGradient();
+            const RowVectorXf referenceCloseToPointsCount = reference.getCloseToPointsCount();
+
+            cout << "function 1, exponent " << exponent << endl;
+            for (int fused = 0; fused < 2; fused++)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    InverseSpaceTransform t(0.15);
+                    t.setFunctionSelection(1);
+                    t.setOptionalFunctionArgument(exponent);
+                    t.setPointsToTransform(pointsToTransform);
+                    t.setTrigonometryAccuracy(accuracies[i]);
+                    if (!fused)
+                    {
+                        t.clearFusedKernelFlag();
+                    }
+
+                    const int repetitions = 5;
+                    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+                    for (int r = 0; r < repetitions; r++)
+                    {
+                        t.performTransform(positionsToEvaluate);
+                    }
+                    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+                    auto duration = chrono::duration_cast<chrono::microseconds>(t2 - t1).count() / repetitions;
+
+                    float evaluationError = (t.getInverseTransformEvaluation() - referenceEvaluation).cwiseAbs().maxCoeff();
+                    float gradientError = (t.getGradient() - referenceGradient).cwiseAbs().maxCoeff() / referenceGradient.cwiseAbs().maxCoeff();
+                    float closeToPointsCountMismatches = ((t.getCloseToPointsCount() - referenceCloseToPointsCount).array() != 0).count();
+
+                    cout << (fused ? "  fused " : "  eigen ") << accuracyNames[i] << ": " << duration << " us, max evaluation error " << evaluationError
+                         << ", max relative gradient error " << gradientError << ", positions with different close points count "
+                         << closeToPointsCountMismatches << " of " << positionsToEvaluate.cols() << endl;
+                }
+            }
+        }
+    }
+
+    // compares performEvaluation() with performTransform(). The evaluation and the close points must be identical
+    void test_evaluationOnlyTransform()
+    {
+        srand(1);
+        Matrix3Xf pointsToTransform = Matrix3Xf::Random(3, 250) * 0.5;  // reciprocal peaks in 1/A
+        Matrix3Xf positionsToEvaluate = Matrix3Xf::Random(3, 20000) * 100; // real space vectors in A
+
+        const int functionSelections[] = {1, 9};
+        for (int functionSelection : functionSelections)
+        {
+            for (int localTransform = 0; localTransform < 2; localTransform++)
+            {
+                for (int fused = 0; fused < 2; fused++)
+                {
+                    InverseSpaceTransform t(0.15);
+                    t.setFunctionSelection(functionSelection);
+                    t.setOptionalFunctionArgument(functionSelection == 1 ? 1 : 4);
+                    t.setPointsToTransform(pointsToTransform);
+                    if (localTransform)
+                    {
+                        t.setLocalTransformFlag();
+                    }
+                    if (!fused)
+                    {
+                        t.clearFusedKernelFlag();
+                    }
+
+                    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+                    t.performTransform(positionsToEvaluate);
+                    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+                    const RowVectorXf transformEvaluation = t.getInverseTransformEvaluation();
+                    const RowVectorXf transformCloseToPointsCount = t.getCloseToPointsCount();
+                    const PointIndicesOnVectors transformCloseToPoints = t.getPointsCloseToEvaluationPositions();
+
+                    chrono::high_resolution_clock::time_point t3 = chrono::high_resolution_clock::now();
+                    t.performEvaluation(positionsToEvaluate, true);
+                    chrono::high_resolution_clock::time_point t4 = chrono::high_resolution_clock::now();
+
+                    float evaluationError = (t.getInverseTransformEvaluation() - transformEvaluation).cwiseAbs().maxCoeff();
+                    float closeToPointsCountMismatches = ((t.getCloseToPointsCount() - transformCloseToPointsCount).array() != 0).count();
+                    bool sameCloseToPoints = t.getPointsCloseToEvaluationPositions().offsets == transformCloseToPoints.offsets &&
+                                             t.getPointsCloseToEvaluationPositions().pointIndices == transformCloseToPoints.pointIndices;
+
+                    cout << "function " << functionSelection << (localTransform ? " local" : " global") << (fused ? " fused: " : " eigen: ")
+                         << chrono::duration_cast<chrono::microseconds>(t2 - t1).count() << " us transform, "
+                         << chrono::duration_cast<chrono::microseconds>(t4 - t3).count() << " us evaluation, max evaluation difference " << evaluationError
+                         << ", close points count mismatches " << closeToPointsCountMismatches << ", same close points " << sameCloseToPoints << endl;
+                }
+            }
+        }
+    }
+
     static ExperimentSettings getExperimentSettingLys()
     {
         float coffset_m = 0.567855;
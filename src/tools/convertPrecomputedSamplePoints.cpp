@@ -0,0 +1,151 @@
+/*
+ * convertPrecomputedSamplePoints.cpp
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Converts the whitespace separated precomputed sample point files into the binary file described in samplePointsFile.h.
+// Usage: xgandalf_convert_sample_points <directory with the text files> <output file>
+
+#include "eigenDiskImport.h"
+#include "samplePointsFile.h"
+#include <Eigen/Dense>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace xgandalf;
+using namespace std;
+using namespace Eigen;
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+static void writePadding(ofstream& file, uint64_t targetOffset)
+{
+    const char zeros[samplePointsFileAlignment] = {0};
+    uint64_t currentOffset = file.tellp();
+    file.write(zeros, targetOffset - currentOffset);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        cerr << "Usage: " << argv[0] << " <directory with the text files> <output file>" << endl;
+        return 1;
+    }
+    string inputDirectory = argv[1];
+    string outputPath = argv[2];
+
+    try
+    {
+        Array<float, 1, Dynamic> pitches, tolerances;
+        loadEigenMatrixFromDisk(pitches, inputDirectory + "/pitches");
+        loadEigenMatrixFromDisk(tolerances, inputDirectory + "/tolerances");
+
+        // same file names as in SamplePointsGenerator::loadPrecomputedSamplePointsFromTextFiles. Missing combinations are skipped
+        vector<samplePointsFileGrid_t> grids;
+        vector<Matrix3Xf> gridPoints;
+        for (int pitchIndex = 0; pitchIndex < pitches.size(); ++pitchIndex)
+        {
+            for (int toleranceIndex = 0; toleranceIndex < tolerances.size(); ++toleranceIndex)
+            {
+                stringstream path;
+                path << inputDirectory << "/pitch" << pitches[pitchIndex] << "_tolerance" << tolerances[toleranceIndex];
+                if (!ifstream(path.str()).is_open())
+                {
+                    continue;
+                }
+
+                MatrixX3f samplePoints_T;
+                loadEigenMatrixFromDisk(samplePoints_T, path.str());
+                gridPoints.push_back(samplePoints_T.transpose());
+
+                samplePointsFileGrid_t grid;
+                memset(&grid, 0, sizeof(grid));
+                grid.pitch = pitches[pitchIndex];
+                grid.tolerance = tolerances[toleranceIndex];
+                grid.pointsCount = samplePoints_T.rows();
+                grids.push_back(grid);
+            }
+        }
+
+        samplePointsFileHeader_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, samplePointsFileMagic, sizeof(header.magic));
+        header.version = samplePointsFileVersion;
+        header.byteOrderMark = samplePointsFileByteOrderMark;
+        header.pitchesCount = pitches.size();
+        header.tolerancesCount = tolerances.size();
+        header.gridsCount = grids.size();
+        header.pitchesOffset = sizeof(header);
+        header.tolerancesOffset = header.pitchesOffset + header.pitchesCount * sizeof(float);
+        header.gridsOffset = alignOffset(header.tolerancesOffset + header.tolerancesCount * sizeof(float), sizeof(uint64_t));
+
+        uint64_t offset = header.gridsOffset + grids.size() * sizeof(samplePointsFileGrid_t);
+        for (auto& grid : grids)
+        {
+            grid.dataOffset = alignOffset(offset, samplePointsFileAlignment);
+            offset = grid.dataOffset + 3 * sizeof(float) * grid.pointsCount;
+        }
+        header.fileSize = offset;
+
+        ofstream file(outputPath, ios::binary | ios::trunc);
+        if (!file.is_open())
+        {
+            cerr << "Cannot open " << outputPath << " for writing" << endl;
+            return 1;
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(pitches.data()), header.pitchesCount * sizeof(float));
+        file.write(reinterpret_cast<const char*>(tolerances.data()), header.tolerancesCount * sizeof(float));
+        writePadding(file, header.gridsOffset);
+        file.write(reinterpret_cast<const char*>(grids.data()), grids.size() * sizeof(samplePointsFileGrid_t));
+        for (size_t i = 0; i < grids.size(); ++i)
+        {
+            writePadding(file, grids[i].dataOffset);
+            file.write(reinterpret_cast<const char*>(gridPoints[i].data()), 3 * sizeof(float) * grids[i].pointsCount);
+        }
+
+        if (!file.good())
+        {
+            cerr << "Writing " << outputPath << " failed" << endl;
+            return 1;
+        }
+
+        cout << "Converted " << grids.size() << " sample point grids to " << outputPath << endl;
+    }
+    catch (exception& e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,449 @@
+/*
+ * xgandalfBenchmark.cpp
+ *
+ * Copyright © 2019 Deutsches Elektronen-Synchrotron DESY,
+ *                       a research centre of the Helmholtz Association.
+ *
+ * Authors:
+ *   2019      Yaroslav Gevorkov <yaroslav.gevorkov@desy.de>
+ *
+ * This file is part of XGANDALF.
+ *
+ * XGANDALF is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * XGANDALF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with XGANDALF.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// End-to-end throughput benchmark of IndexerPlain. Synthetic frames of several unit cells are predicted with random orientations, detector position noise
+// and noise peaks. All frames are indexed with every combination of SamplingPitch, GradientDescentIterationsCount, PeaksRefinementMode and
+// SamplingStrategy. One line per combination is written to stdout as CSV or JSON, progress goes to stderr.
+
+#include "DetectorToReciprocalSpaceTransform.h"
+#include "IndexerPlain.h"
+#include "SimpleMonochromaticDiffractionPatternPrediction.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace xgandalf;
+using namespace std;
+using namespace Eigen;
+
+typedef struct
+{
+    const char* name;
+    float a, b, c;             // A
+    float alpha, beta, gamma; // deg
+} cell_t;
+
+typedef struct
+{
+    int cellIndex;
+    Matrix3f realBasis_A; // true lattice in the frame of the reciprocal peaks, used to check the indexing result
+    Matrix3Xf reciprocalPeaks_1_per_A;
+} frame_t;
+
+typedef struct
+{
+    int framesPerCell;
+    unsigned int seed;
+    bool latticeParametersKnown;
+    uint32_t threadCount; // per frame
+    bool json;
+    vector<string> samplingPitches;          // empty for all
+    vector<string> gradientDescentIterations; // empty for all
+    vector<string> peaksRefinementModes;      // empty for all
+    vector<string> samplingStrategies;        // empty for all
+} options_t;
+
+static const cell_t cells[] = {
+    {"small_cubic", 27.0f, 27.0f, 27.0f, 90.0f, 90.0f, 90.0f},
+    {"lysozyme_tetragonal", 79.1f, 79.1f, 37.9f, 90.0f, 90.0f, 90.0f},
+    {"large_monoclinic", 62.0f, 98.0f, 131.0f, 90.0f, 103.5f, 90.0f},
+};
+static const int cellsCount = sizeof(cells) / sizeof(cells[0]);
+
+static const IndexerPlain::SamplingPitch samplingPitches[] = {
+    IndexerPlain::SamplingPitch::extremelyLoose,
+    IndexerPlain::SamplingPitch::loose,
+    IndexerPlain::SamplingPitch::standard,
+    IndexerPlain::SamplingPitch::dense,
+    IndexerPlain::SamplingPitch::extremelyDense,
+    IndexerPlain::SamplingPitch::standardWithSeondaryMillerIndices,
+    IndexerPlain::SamplingPitch::denseWithSeondaryMillerIndices,
+    IndexerPlain::SamplingPitch::extremelyDenseWithSeondaryMillerIndices,
+};
+static const char* samplingPitchNames[] = {
+    "extremelyLoose", "loose", "standard", "dense", "extremelyDense", "standardWithSeondaryMillerIndices", "denseWithSeondaryMillerIndices",
+    "extremelyDenseWithSeondaryMillerIndices",
+};
+
+static const IndexerPlain::GradientDescentIterationsCount gradientDescentIterationsCounts[] = {
+    IndexerPlain::GradientDescentIterationsCount::exremelyFew, IndexerPlain::GradientDescentIterationsCount::few,
+    IndexerPlain::GradientDescentIterationsCount::standard,    IndexerPlain::GradientDescentIterationsCount::many,
+    IndexerPlain::GradientDescentIterationsCount::manyMany,    IndexerPlain::GradientDescentIterationsCount::extremelyMany,
+};
+static const char* gradientDescentIterationsCountNames[] = {"exremelyFew", "few", "standard", "many", "manyMany", "extremelyMany"};
+
+static const IndexerPlain::PeaksRefinementMode peaksRefinementModes[] = {IndexerPlain::PeaksRefinementMode::hillClimbing,
+                                                                         IndexerPlain::PeaksRefinementMode::leastSquaresSnap};
+static const char* peaksRefinementModeNames[] = {"hillClimbing", "leastSquaresSnap"};
+
+static const IndexerPlain::SamplingStrategy samplingStrategies[] = {IndexerPlain::SamplingStrategy::uniform, IndexerPlain::SamplingStrategy::coarseToFine};
+static const char* samplingStrategyNames[] = {"uniform", "coarseToFine"};
+
+static Matrix3f getRealBasis(const cell_t& cell)
+{
+    const float degToRad = 3.14159265358979f / 180;
+    const float cosAlpha = cos(cell.alpha * degToRad), cosBeta = cos(cell.beta * degToRad);
+    const float cosGamma = cos(cell.gamma * degToRad), sinGamma = sin(cell.gamma * degToRad);
+
+    const float cx = cosBeta;
+    const float cy = (cosAlpha - cosBeta * cosGamma) / sinGamma;
+    const float cz = sqrt(1 - cx * cx - cy * cy);
+
+    Matrix3f basis;
+    basis << cell.a, cell.b * cosGamma, cell.c * cx, 0, cell.b * sinGamma, cell.c * cy, 0, 0, cell.c * cz;
+    return basis;
+}
+
+// detector geometry of the lysozyme test data in tests.cpp
+static ExperimentSettings getExperimentSettings(const Lattice& sampleReciprocalLattice_1A, bool latticeParametersKnown)
+{
+    const float coffset_m = 0.567855;
+    const float clen_mm = -439.9992;
+    const float beamEenergy_eV = 8.0010e+03;
+    const float divergenceAngle_deg = 0.05 * 3.14159265358979f / 180;
+    const float nonMonochromaticity = 0.005;
+    const float pixelLength_m = 110e-6;
+    const float detectorRadius_pixel = 750;
+    const float reflectionRadius_1_per_A = 0.001;
+
+    if (latticeParametersKnown)
+    {
+        const float tolerance = 0.02;
+        return ExperimentSettings(coffset_m, clen_mm, beamEenergy_eV, divergenceAngle_deg, nonMonochromaticity, pixelLength_m, detectorRadius_pixel,
+                                  sampleReciprocalLattice_1A, tolerance, reflectionRadius_1_per_A);
+    }
+    else
+    {
+        const Vector3f realNorms = sampleReciprocalLattice_1A.getReciprocalLattice().getBasisVectorNorms();
+        return ExperimentSettings(coffset_m, clen_mm, beamEenergy_eV, divergenceAngle_deg, nonMonochromaticity, pixelLength_m, detectorRadius_pixel,
+                                  realNorms.minCoeff() * 0.9f, realNorms.maxCoeff() * 1.1f, reflectionRadius_1_per_A);
+    }
+}
+
+static void generateFrames(vector<frame_t>& frames, const options_t& options)
+{
+    mt19937 randomEngine(options.seed);
+    normal_distribution<float> normalDistribution(0, 1);
+    uniform_real_distribution<float> uniformDistribution(0, 1);
+
+    for (int cellIndex = 0; cellIndex < cellsCount; ++cellIndex)
+    {
+        const Matrix3f realBasis = getRealBasis(cells[cellIndex]);
+        const ExperimentSettings experimentSettings = getExperimentSettings(Lattice(realBasis).getReciprocalLattice(), true);
+        SimpleMonochromaticDiffractionPatternPrediction patternPrediction(experimentSettings);
+        DetectorToReciprocalSpaceTransform detectorToReciprocalSpaceTransform(experimentSettings);
+
+        const float detectorRadius_m = experimentSettings.getDetectorRadius_m();
+        const float positionNoise_m = 0.5f * 110e-6f; // half a pixel
+
+        for (int i = 0; i < options.framesPerCell; ++i)
+        {
+            Quaternionf orientation(normalDistribution(randomEngine), normalDistribution(randomEngine), normalDistribution(randomEngine),
+                                    normalDistribution(randomEngine));
+            orientation.normalize();
+
+            Matrix2Xf predictedPeaks;
+            Matrix3Xi millerIndices;
+            Matrix3Xf projectionDirections;
+            patternPrediction.predictPattern(predictedPeaks, millerIndices, projectionDirections,
+                                             Lattice(orientation.toRotationMatrix() * realBasis).getReciprocalLattice());
+
+            // the detector projection does not preserve the coordinate frame of the lattice, so the true lattice is fitted to the noise free peaks
+            Matrix3Xf noiseFreeReciprocalPeaks_1_per_A;
+            detectorToReciprocalSpaceTransform.computeReciprocalPeaksFromDetectorPeaks(noiseFreeReciprocalPeaks_1_per_A, predictedPeaks);
+            const Matrix3Xf millerIndices_float = millerIndices.cast<float>();
+            const Matrix3f reciprocalBasis_1_per_A =
+                noiseFreeReciprocalPeaks_1_per_A * millerIndices_float.transpose() * (millerIndices_float * millerIndices_float.transpose()).inverse();
+
+            frame_t frame;
+            frame.cellIndex = cellIndex;
+            frame.realBasis_A = Lattice(reciprocalBasis_1_per_A).getReciprocalLattice().getBasis();
+
+            // 10% noise peaks, at least 3, uniformly distributed on the detector
+            const int noisePeaksCount = max(3, (int)predictedPeaks.cols() / 10);
+            Matrix2Xf detectorPeaks_m(2, predictedPeaks.cols() + noisePeaksCount);
+            for (int j = 0; j < predictedPeaks.cols(); ++j)
+            {
+                detectorPeaks_m.col(j) = predictedPeaks.col(j) + positionNoise_m * Vector2f(normalDistribution(randomEngine), normalDistribution(randomEngine));
+            }
+            for (int j = 0; j < noisePeaksCount; ++j)
+            {
+                const float radius = detectorRadius_m * sqrt(uniformDistribution(randomEngine));
+                const float angle = 2 * 3.14159265358979f * uniformDistribution(randomEngine);
+                detectorPeaks_m.col(predictedPeaks.cols() + j) << radius * cos(angle), radius * sin(angle);
+            }
+
+            detectorToReciprocalSpaceTransform.computeReciprocalPeaksFromDetectorPeaks(frame.reciprocalPeaks_1_per_A, detectorPeaks_m);
+            frames.push_back(frame);
+        }
+    }
+}
+
+// the found lattice is correct, if it is an integer unimodular transformation of the true lattice
+static bool isCorrectLattice(const Lattice& lattice, const Matrix3f& trueRealBasis_A)
+{
+    const Matrix3f transformation = trueRealBasis_A.inverse() * lattice.getBasis();
+    const Matrix3f roundedTransformation = transformation.array().round().matrix();
+    return (transformation - roundedTransformation).cwiseAbs().maxCoeff() < 0.1f && abs(abs(roundedTransformation.determinant()) - 1) < 0.01f;
+}
+
+static double getPercentile(vector<double> values, double percentile)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    sort(values.begin(), values.end());
+    const size_t index = min(values.size() - 1, (size_t)ceil(percentile / 100 * values.size()) - (percentile > 0 ? 1 : 0));
+    return values[index];
+}
+
+static bool isSelected(const vector<string>& selection, const char* name)
+{
+    return selection.empty() || find(selection.begin(), selection.end(), name) != selection.end();
+}
+
+static void splitList(vector<string>& list, const string& commaSeparatedList)
+{
+    stringstream stream(commaSeparatedList);
+    string item;
+    while (getline(stream, item, ','))
+    {
+        list.push_back(item);
+    }
+}
+
+static void printUsage(const char* programName)
+{
+    cerr << "Usage: " << programName << " [options]\n"
+         << "  --frames <n>            frames per unit cell (default 4)\n"
+         << "  --seed <n>              seed of the frame generation (default 1)\n"
+         << "  --unknown               index without known lattice parameters\n"
+         << "  --threads <n>           hill climbing and lattice assembly threads per frame, 0 for all (default 1)\n"
+         << "  --pitches <a,b,...>     sampling pitches to run (default all)\n"
+         << "  --iterations <a,b,...>  gradient descent iteration counts to run (default all)\n"
+         << "  --refinements <a,b,...> peaks refinement modes to run (default all)\n"
+         << "  --strategies <a,b,...>  sampling strategies to run (default all)\n"
+         << "  --json                  JSON lines instead of CSV\n";
+}
+
+static bool parseOptions(options_t& options, int argc, char** argv)
+{
+    options.framesPerCell = 4;
+    options.seed = 1;
+    options.latticeParametersKnown = true;
+    options.threadCount = 1;
+    options.json = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (argument == "--frames" && hasValue)
+        {
+            options.framesPerCell = atoi(argv[++i]);
+        }
+        else if (argument == "--seed" && hasValue)
+        {
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--unknown")
+        {
+            options.latticeParametersKnown = false;
+        }
+        else if (argument == "--threads" && hasValue)
+        {
+            options.threadCount = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--pitches" && hasValue)
+        {
+            splitList(options.samplingPitches, argv[++i]);
+        }
+        else if (argument == "--iterations" && hasValue)
+        {
+            splitList(options.gradientDescentIterations, argv[++i]);
+        }
+        else if (argument == "--refinements" && hasValue)
+        {
+            splitList(options.peaksRefinementModes, argv[++i]);
+        }
+        else if (argument == "--strategies" && hasValue)
+        {
+            splitList(options.samplingStrategies, argv[++i]);
+        }
+        else if (argument == "--json")
+        {
+            options.json = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return options.framesPerCell > 0;
+}
+
+int main(int argc, char** argv)
+{
+    options_t options;
+    if (!parseOptions(options, argc, argv))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    vector<frame_t> frames;
+    generateFrames(frames, options);
+
+    vector<ExperimentSettings> experimentSettings;
+    for (int cellIndex = 0; cellIndex < cellsCount; ++cellIndex)
+    {
+        experimentSettings.push_back(getExperimentSettings(Lattice(getRealBasis(cells[cellIndex])).getReciprocalLattice(), options.latticeParametersKnown));
+    }
+
+    if (!options.json)
+    {
+        cout << "samplingPitch,gradientDescentIterationsCount,peaksRefinementMode,samplingStrategy,latticeParametersKnown,frames,indexedFrames,"
+                "correctlyIndexedFrames,indexingRate,correctIndexingRate,"
+                "meanPeaksOnLattice,setupTime_s,indexingTime_s,framesPerSecond,latencyP50_ms,latencyP99_ms\n";
+    }
+    cout << setprecision(6);
+
+    const int samplingPitchesCount = sizeof(samplingPitches) / sizeof(samplingPitches[0]);
+    const int gradientDescentIterationsCountsCount = sizeof(gradientDescentIterationsCounts) / sizeof(gradientDescentIterationsCounts[0]);
+    const int peaksRefinementModesCount = sizeof(peaksRefinementModes) / sizeof(peaksRefinementModes[0]);
+    const int samplingStrategiesCount = sizeof(samplingStrategies) / sizeof(samplingStrategies[0]);
+    for (int pitchIndex = 0; pitchIndex < samplingPitchesCount; ++pitchIndex)
+    {
+        if (!isSelected(options.samplingPitches, samplingPitchNames[pitchIndex]))
+        {
+            continue;
+        }
+        for (int iterationsIndex = 0; iterationsIndex < gradientDescentIterationsCountsCount; ++iterationsIndex)
+        {
+            if (!isSelected(options.gradientDescentIterations, gradientDescentIterationsCountNames[iterationsIndex]))
+            {
+                continue;
+            }
+            for (int refinementIndex = 0; refinementIndex < peaksRefinementModesCount; ++refinementIndex)
+            {
+                if (!isSelected(options.peaksRefinementModes, peaksRefinementModeNames[refinementIndex]))
+                {
+                    continue;
+                }
+                for (int strategyIndex = 0; strategyIndex < samplingStrategiesCount; ++strategyIndex)
+                {
+                    if (!isSelected(options.samplingStrategies, samplingStrategyNames[strategyIndex]))
+                    {
+                        continue;
+                    }
+                    cerr << "running " << samplingPitchNames[pitchIndex] << " / " << gradientDescentIterationsCountNames[iterationsIndex] << " / "
+                         << peaksRefinementModeNames[refinementIndex] << " / " << samplingStrategyNames[strategyIndex] << endl;
+
+                    // one indexer per cell. Setup and the first (workspace preparing) call are not part of the latencies
+                    double setupTime_s = 0;
+                    vector<IndexerPlain> indexers;
+                    indexers.reserve(cellsCount);
+                    for (int cellIndex = 0; cellIndex < cellsCount; ++cellIndex)
+                    {
+                        const auto setupStart = chrono::steady_clock::now();
+                        indexers.emplace_back(experimentSettings[cellIndex]);
+                        IndexerPlain& indexer = indexers.back();
+                        indexer.setSamplingPitch(samplingPitches[pitchIndex]);
+                        indexer.setGradientDescentIterationsCount(gradientDescentIterationsCounts[iterationsIndex]);
+                        indexer.setPeaksRefinementMode(peaksRefinementModes[refinementIndex]);
+                        indexer.setSamplingStrategy(samplingStrategies[strategyIndex]);
+                        indexer.setHillClimbingThreadCount(options.threadCount);
+                        indexer.setLatticeAssemblyThreadCount(options.threadCount);
+                        setupTime_s += chrono::duration<double>(chrono::steady_clock::now() - setupStart).count();
+                    }
+                    for (int cellIndex = 0; cellIndex < cellsCount; ++cellIndex)
+                    {
+                        const auto it = find_if(frames.begin(), frames.end(), [cellIndex](const frame_t& frame) { return frame.cellIndex == cellIndex; });
+                        vector<Lattice> lattices;
+                        indexers[cellIndex].index(lattices, it->reciprocalPeaks_1_per_A);
+                    }
+
+                    vector<double> latencies_ms;
+                    int indexedFrames = 0, correctlyIndexedFrames = 0;
+                    double peaksOnLatticeSum = 0; // of the first lattice of every indexed frame
+                    const auto indexingStart = chrono::steady_clock::now();
+                    for (const frame_t& frame : frames)
+                    {
+                        vector<Lattice> lattices;
+                        vector<int> peakCountOnLattices;
+                        const auto frameStart = chrono::steady_clock::now();
+                        indexers[frame.cellIndex].index(lattices, frame.reciprocalPeaks_1_per_A, peakCountOnLattices);
+                        latencies_ms.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count());
+
+                        indexedFrames += lattices.empty() ? 0 : 1;
+                        peaksOnLatticeSum += lattices.empty() ? 0 : peakCountOnLattices[0];
+                        correctlyIndexedFrames += any_of(lattices.begin(), lattices.end(), [&frame](const Lattice& lattice) {
+                            return isCorrectLattice(lattice, frame.realBasis_A);
+                        }) ? 1 : 0;
+                    }
+                    const double indexingTime_s = chrono::duration<double>(chrono::steady_clock::now() - indexingStart).count();
+
+                    const double framesCount = frames.size();
+                    const double meanPeaksOnLattice = indexedFrames > 0 ? peaksOnLatticeSum / indexedFrames : 0;
+                    if (options.json)
+                    {
+                        cout << "{\"samplingPitch\":\"" << samplingPitchNames[pitchIndex] << "\",\"gradientDescentIterationsCount\":\""
+                             << gradientDescentIterationsCountNames[iterationsIndex] << "\",\"peaksRefinementMode\":\""
+                             << peaksRefinementModeNames[refinementIndex] << "\",\"samplingStrategy\":\"" << samplingStrategyNames[strategyIndex]
+                             << "\",\"latticeParametersKnown\":" << (options.latticeParametersKnown ? "true" : "false") << ",\"frames\":" << frames.size()
+                             << ",\"indexedFrames\":" << indexedFrames << ",\"correctlyIndexedFrames\":" << correctlyIndexedFrames
+                             << ",\"indexingRate\":" << indexedFrames / framesCount << ",\"correctIndexingRate\":" << correctlyIndexedFrames / framesCount
+                             << ",\"meanPeaksOnLattice\":" << meanPeaksOnLattice << ",\"setupTime_s\":" << setupTime_s
+                             << ",\"indexingTime_s\":" << indexingTime_s << ",\"framesPerSecond\":" << framesCount / indexingTime_s
+                             << ",\"latencyP50_ms\":" << getPercentile(latencies_ms, 50) << ",\"latencyP99_ms\":" << getPercentile(latencies_ms, 99) << "}"
+                             << endl;
+                    }
+                    else
+                    {
+                        cout << samplingPitchNames[pitchIndex] << "," << gradientDescentIterationsCountNames[iterationsIndex] << ","
+                             << peaksRefinementModeNames[refinementIndex] << "," << samplingStrategyNames[strategyIndex] << ","
+                             << (options.latticeParametersKnown ? 1 : 0) << "," << frames.size() << "," << indexedFrames << "," << correctlyIndexedFrames << ","
+                             << indexedFrames / framesCount << "," << correctlyIndexedFrames / framesCount << "," << meanPeaksOnLattice << ","
+                             << setupTime_s << "," << indexingTime_s << "," << framesCount / indexingTime_s << "," << getPercentile(latencies_ms, 50) << ","
+                             << getPercentile(latencies_ms, 99) << endl;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}